@@ -0,0 +1,452 @@
+// clang-format off
+#include <stdio.h>
+#include <gmp.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "numtheory.h"
+#include "randstate.h"
+#include "rsa.h"
+
+// clang-format on
+
+// a benchmark stops repeating once it has run this long, after MIN_REPS
+#define BENCH_BUDGET 2.0
+#define MIN_REPS 3
+
+// operand sizes of the number theory benchmarks
+static const uint64_t full_sizes[] = {512, 1024, 2048, 3072, 4096};
+static const uint64_t quick_sizes[] = {512, 1024};
+
+// the settings shared by every benchmark
+typedef struct {
+  uint64_t seed;
+  uint64_t reps;   // most timed repetitions per benchmark
+  uint64_t warmup; // untimed repetitions before them
+  uint64_t iters;  // Miller-Rabin iterations
+  FILE *out;
+  bool first; // no result has been written yet
+} bench_config;
+
+// the timed repetitions of one benchmark, in seconds
+typedef struct {
+  double *samples;
+  uint64_t count;
+} bench_samples;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// adds a sample, returns false once the benchmark has enough of them
+static bool bench_add(bench_samples *s, bench_config *config, double t,
+                      double *spent) {
+  s->samples[s->count] = t;
+  s->count += 1;
+  *spent += t;
+  if (s->count >= config->reps) {
+    return false;
+  }
+  return (s->count < MIN_REPS) || (*spent < BENCH_BUDGET);
+}
+
+// writes one result object; bytes is 0 for benchmarks that are not about
+// throughput
+static void bench_report(bench_config *config, const char *name,
+                         uint64_t bits, bench_samples *s, uint64_t bytes) {
+  qsort(s->samples, s->count, sizeof(double), compare_double);
+  double total = 0;
+  for (uint64_t i = 0; i < s->count; i++) {
+    total += s->samples[i];
+  }
+  double median = s->samples[(s->count - 1) / 2];
+  double p99 = s->samples[(((99 * s->count) + 99) / 100) - 1]; // nearest rank
+
+  fprintf(config->out, "%s\n    {\"name\": \"%s\", \"bits\": %" PRIu64
+                       ", \"reps\": %" PRIu64 ", \"median_us\": %.3f, "
+                       "\"p99_us\": %.3f, \"mean_us\": %.3f",
+          config->first ? "" : ",", name, bits, s->count, 1e6 * median,
+          1e6 * p99, 1e6 * total / s->count);
+  if (bytes > 0) {
+    fprintf(config->out, ", \"bytes\": %" PRIu64 ", \"mbps\": %.3f", bytes,
+            (bytes / 1e6) / median);
+  }
+  fprintf(config->out, "}");
+  fflush(config->out);
+  config->first = false;
+
+  fprintf(stderr, "%-24s %5" PRIu64 " bits  median %12.3f us  p99 %12.3f us",
+          name, bits, 1e6 * median, 1e6 * p99);
+  if (bytes > 0) {
+    fprintf(stderr, "  %9.3f MB/s", (bytes / 1e6) / median);
+  }
+  fprintf(stderr, "\n");
+}
+
+// the number theory operations, each run on fresh random operands
+typedef enum {
+  OP_POW_MOD,
+  OP_GCD,
+  OP_MOD_INVERSE,
+  OP_IS_PRIME,
+  OP_MAKE_PRIME
+} op_t;
+
+static const char *op_names[] = {"pow_mod", "gcd", "mod_inverse", "is_prime",
+                                 "make_prime"};
+
+static void bench_op(bench_config *config, op_t op, uint64_t bits) {
+  randstate_init(config->seed); // same operands whatever ran before
+  mpz_t a, b, n, o;
+  mpz_inits(a, b, n, o, NULL);
+
+  // is_prime is timed on a prime, which costs all of its iterations
+  mpz_t prime;
+  mpz_init(prime);
+  if (op == OP_IS_PRIME) {
+    make_prime(prime, bits, config->iters);
+  }
+
+  bench_samples s = {
+      .samples = (double *)calloc(config->reps, sizeof(double)), .count = 0};
+  double spent = 0;
+  bool more = true;
+  for (uint64_t rep = 0; more; rep++) {
+    mpz_urandomb(n, state, bits);
+    mpz_setbit(n, bits - 1);
+    mpz_setbit(n, 0); // odd, as every modulus here is
+    mpz_urandomm(a, state, n);
+    mpz_urandomb(b, state, bits);
+
+    double start = now();
+    switch (op) {
+    case OP_POW_MOD:
+      pow_mod(o, a, b, n);
+      break;
+    case OP_GCD:
+      gcd(o, a, b);
+      break;
+    case OP_MOD_INVERSE:
+      mod_inverse(o, a, n);
+      break;
+    case OP_IS_PRIME:
+      is_prime(prime, config->iters);
+      break;
+    case OP_MAKE_PRIME:
+      make_prime(o, bits, config->iters);
+      break;
+    }
+    double t = now() - start;
+
+    if (rep >= config->warmup) {
+      more = bench_add(&s, config, t, &spent);
+    }
+  }
+
+  bench_report(config, op_names[op], bits, &s, 0);
+  free(s.samples);
+  mpz_clears(a, b, n, o, prime, NULL);
+  randstate_clear();
+}
+
+// a key pair for the file benchmarks, with the CRT components
+typedef struct {
+  mpz_t p, q, n, e, d, dp, dq, qinv;
+} bench_key;
+
+// the file functions timed by the throughput benchmarks
+typedef enum {
+  FILE_ENCRYPT,
+  FILE_DECRYPT,
+  FILE_DECRYPT_CRT,
+  FILE_ENCRYPT_HYBRID,
+  FILE_DECRYPT_HYBRID
+} file_op_t;
+
+static void run_file_op(file_op_t op, FILE *in, FILE *out, bench_key *key) {
+  switch (op) {
+  case FILE_ENCRYPT:
+    rsa_encrypt_file(in, out, key->n, key->e);
+    break;
+  case FILE_DECRYPT:
+    rsa_decrypt_file(in, out, key->n, key->d);
+    break;
+  case FILE_DECRYPT_CRT:
+    rsa_decrypt_file_crt(in, out, key->n, key->p, key->q, key->dp, key->dq,
+                         key->qinv);
+    break;
+  case FILE_ENCRYPT_HYBRID:
+    rsa_encrypt_file_hybrid(in, out, key->n, key->e);
+    break;
+  case FILE_DECRYPT_HYBRID:
+    rsa_decrypt_file_hybrid_crt(in, out, key->n, key->p, key->q, key->dp,
+                                key->dq, key->qinv);
+    break;
+  }
+  fflush(out);
+}
+
+// empties a temporary file for the next repetition
+static void reset_file(FILE *f) {
+  fflush(f);
+  if (ftruncate(fileno(f), 0) != 0) {
+    fprintf(stderr, "./bench: couldn't truncate a temporary file.\n");
+  }
+  rewind(f);
+}
+
+// times one file function reading from in, reporting plaintext MB/s
+static void bench_file(bench_config *config, const char *name, file_op_t op,
+                       FILE *in, uint64_t bytes, bench_key *key) {
+  FILE *out = tmpfile();
+  bench_samples s = {
+      .samples = (double *)calloc(config->reps, sizeof(double)), .count = 0};
+  double spent = 0;
+  bool more = true;
+  for (uint64_t rep = 0; more; rep++) {
+    rewind(in);
+    reset_file(out);
+    double start = now();
+    run_file_op(op, in, out, key);
+    double t = now() - start;
+    if (rep >= config->warmup) {
+      more = bench_add(&s, config, t, &spent);
+    }
+  }
+  bench_report(config, name, mpz_sizeinbase(key->n, 2), &s, bytes);
+  free(s.samples);
+  fclose(out);
+}
+
+// a temporary file of random bytes
+static FILE *random_file(uint64_t bytes) {
+  FILE *f = tmpfile();
+  uint8_t buffer[4096];
+  for (uint64_t done = 0; done < bytes; done += sizeof(buffer)) {
+    for (size_t i = 0; i < sizeof(buffer); i++) {
+      buffer[i] = (uint8_t)randstate_random();
+    }
+    uint64_t left = bytes - done;
+    fwrite(buffer, sizeof(uint8_t),
+           (left < sizeof(buffer)) ? left : sizeof(buffer), f);
+  }
+  fflush(f);
+  return f;
+}
+
+// a temporary file holding the output of one run of a file function
+static FILE *encrypted_file(file_op_t op, FILE *in, bench_key *key) {
+  FILE *f = tmpfile();
+  rewind(in);
+  run_file_op(op, in, f, key);
+  return f;
+}
+
+static void bench_files(bench_config *config, uint64_t bits, uint64_t bytes,
+                        uint64_t hybrid_bytes) {
+  randstate_init(config->seed);
+  bench_key key;
+  mpz_inits(key.p, key.q, key.n, key.e, key.d, key.dp, key.dq, key.qinv,
+            NULL);
+  mpz_set_ui(key.e, 65537);
+  rsa_make_pub_fixed(key.p, key.q, key.n, key.e, bits, config->iters);
+  rsa_make_priv(key.d, key.e, key.p, key.q);
+  rsa_make_crt(key.dp, key.dq, key.qinv, key.d, key.p, key.q);
+
+  FILE *plain = random_file(bytes);
+  FILE *cipher = encrypted_file(FILE_ENCRYPT, plain, &key);
+  rsa_set_mmap(true);
+  bench_file(config, "encrypt_file", FILE_ENCRYPT, plain, bytes, &key);
+  bench_file(config, "decrypt_file", FILE_DECRYPT, cipher, bytes, &key);
+  bench_file(config, "decrypt_file_crt", FILE_DECRYPT_CRT, cipher, bytes,
+             &key);
+
+  // the same through the streaming pipeline used for pipes
+  rsa_set_mmap(false);
+  bench_file(config, "encrypt_file_stream", FILE_ENCRYPT, plain, bytes, &key);
+  bench_file(config, "decrypt_file_crt_stream", FILE_DECRYPT_CRT, cipher,
+             bytes, &key);
+  rsa_set_mmap(true);
+  fclose(plain);
+  fclose(cipher);
+
+  plain = random_file(hybrid_bytes);
+  cipher = encrypted_file(FILE_ENCRYPT_HYBRID, plain, &key);
+  bench_file(config, "encrypt_file_hybrid", FILE_ENCRYPT_HYBRID, plain,
+             hybrid_bytes, &key);
+  bench_file(config, "decrypt_file_hybrid", FILE_DECRYPT_HYBRID, cipher,
+             hybrid_bytes, &key);
+  fclose(plain);
+  fclose(cipher);
+
+  mpz_clears(key.p, key.q, key.n, key.e, key.d, key.dp, key.dq, key.qinv,
+             NULL);
+  randstate_clear();
+}
+
+static void usage(void) {
+  fprintf(stderr, "Usage: ./bench [options]\n");
+  fprintf(stderr, "  ./bench times the number theory functions and file "
+                  "encryption throughput,\n");
+  fprintf(stderr, "  writing the results as JSON.\n");
+  fprintf(stderr, "    -o <outfile>: Write JSON to <outfile>. Default: "
+                  "standard output.\n");
+  fprintf(stderr, "    -s <seed>   : Seed for every operand and key. "
+                  "Default: 1234.\n");
+  fprintf(stderr, "    -r <reps>   : Time at most <reps> repetitions, at "
+                  "least %d. Default: 25.\n",
+          MIN_REPS);
+  fprintf(stderr, "                  A benchmark stops early after %.0f s "
+                  "of timed repetitions.\n",
+          BENCH_BUDGET);
+  fprintf(stderr, "    -w <warmup> : Untimed repetitions before the timed "
+                  "ones. Default: 2.\n");
+  fprintf(stderr, "    -i <iters>  : Miller-Rabin iterations. Default: 50.\n");
+  fprintf(stderr, "    -b <bits>   : Key size of the file benchmarks. "
+                  "Default: 2048.\n");
+  fprintf(stderr, "    -m <KiB>    : Input size of the file benchmarks, "
+                  "64 times that for hybrid\n");
+  fprintf(stderr, "                  mode. Default: 256.\n");
+  fprintf(stderr, "    -t <threads>: File benchmarks run on <threads> "
+                  "threads. Default: 1.\n");
+  fprintf(stderr, "    -A <backend>: Arithmetic backend: reference, gmp, "
+                  "fast, or <a>,<b> to\n");
+  fprintf(stderr, "                  cross-check a against b. Default: "
+                  "$NUMTHEORY_BACKEND or fast.\n");
+  fprintf(stderr, "    -q          : Quick run, 512 and 1024 bits only and "
+                  "a 1024-bit key.\n");
+  fprintf(stderr, "    -h          : Display program synopsis and usage.\n");
+}
+
+int main(int argc, char **argv) {
+  bench_config config = {
+      .seed = 1234, .reps = 25, .warmup = 2, .iters = 50, .first = true};
+  config.out = stdout;
+  uint64_t key_bits = 2048;
+  uint64_t kib = 256;
+  uint64_t threads = 1;
+  bool quick = false;
+  char *output_file_name = NULL;
+
+  int opt = 0;
+  while ((opt = getopt(argc, argv, "o:s:r:w:i:b:m:t:A:qh")) != -1) {
+    switch (opt) {
+    case 'o': // JSON output file name
+      output_file_name = optarg;
+      break;
+    case 's': // seed
+      config.seed = strtoull(optarg, NULL, 10);
+      break;
+    case 'r': // most timed repetitions
+      config.reps = strtoull(optarg, NULL, 10);
+      if (config.reps < MIN_REPS) {
+        config.reps = MIN_REPS;
+      }
+      break;
+    case 'w': // warmup repetitions
+      config.warmup = strtoull(optarg, NULL, 10);
+      break;
+    case 'i': // Miller-Rabin iterations
+      config.iters = strtoull(optarg, NULL, 10);
+      break;
+    case 'b': // key size of the file benchmarks
+      key_bits = strtoull(optarg, NULL, 10);
+      if (key_bits < 512) {
+        fprintf(stderr, "Key size must be at least 512 bits, not %s.\n",
+                optarg);
+        return 1;
+      }
+      break;
+    case 'm': // file size in KiB
+      kib = strtoull(optarg, NULL, 10);
+      if (kib < 1) {
+        fprintf(stderr, "Input size must be at least 1 KiB, not %s.\n",
+                optarg);
+        return 1;
+      }
+      break;
+    case 't': // file threads
+      threads = strtoull(optarg, NULL, 10);
+      if ((threads < 1) || (threads > 1024)) {
+        fprintf(stderr, "Number of threads must be 1-1024, not %s.\n",
+                optarg);
+        return 1;
+      }
+      break;
+    case 'A': // arithmetic backend
+      if (!numtheory_set_backend(optarg)) {
+        fprintf(stderr,
+                "Unknown arithmetic backend %s, expected reference, gmp, "
+                "fast, <a>,<b> or check.\n",
+                optarg);
+        return 1;
+      }
+      break;
+    case 'q': // quick run
+      quick = true;
+      break;
+    case 'h': // help message
+      usage();
+      return 0;
+    default:
+      usage();
+      return 1;
+    }
+  }
+
+  if (output_file_name != NULL) {
+    config.out = fopen(output_file_name, "w");
+    if (config.out == NULL) {
+      fprintf(stderr, "./bench: couldn't open %s to write results.\n",
+              output_file_name);
+      return 1;
+    }
+  }
+
+  const uint64_t *sizes = quick ? quick_sizes : full_sizes;
+  uint64_t size_count = quick ? (sizeof(quick_sizes) / sizeof(uint64_t))
+                              : (sizeof(full_sizes) / sizeof(uint64_t));
+  if (quick) {
+    key_bits = 1024;
+  }
+
+  const char *check = numtheory_check_backend_name();
+  fprintf(config.out, "{\n  \"backend\": \"%s\", \"check\": %s%s%s,\n",
+          numtheory_backend_name(), (check != NULL) ? "\"" : "",
+          (check != NULL) ? check : "null", (check != NULL) ? "\"" : "");
+  fprintf(config.out,
+          "  \"seed\": %" PRIu64 ", \"reps\": %" PRIu64
+          ", \"warmup\": %" PRIu64 ", \"iters\": %" PRIu64
+          ", \"threads\": %" PRIu64 ", \"budget_s\": %.1f,\n  \"results\": [",
+          config.seed, config.reps, config.warmup, config.iters, threads,
+          BENCH_BUDGET);
+
+  for (int op = OP_POW_MOD; op <= OP_MAKE_PRIME; op++) {
+    for (uint64_t i = 0; i < size_count; i++) {
+      bench_op(&config, (op_t)op, sizes[i]);
+    }
+  }
+
+  rsa_set_threads(threads);
+  rsa_set_format(RSA_FORMAT_BINARY);
+  bench_files(&config, key_bits, kib << 10, (kib << 10) * 64);
+
+  fprintf(config.out, "\n  ]\n}\n");
+  if (output_file_name != NULL) {
+    fclose(config.out);
+  }
+  return 0;
+}
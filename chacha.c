@@ -0,0 +1,336 @@
+// clang-format off
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "chacha.h"
+// clang-format on
+
+// little-endian helpers, the byte order of every RFC 8439 field
+static uint32_t load32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+         ((uint32_t)p[3] << 24);
+}
+
+static void store32(uint8_t *p, uint32_t x) {
+  p[0] = (uint8_t)x;
+  p[1] = (uint8_t)(x >> 8);
+  p[2] = (uint8_t)(x >> 16);
+  p[3] = (uint8_t)(x >> 24);
+}
+
+static void store64(uint8_t *p, uint64_t x) {
+  store32(p, (uint32_t)x);
+  store32(p + 4, (uint32_t)(x >> 32));
+}
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// one quarter round on word rows a, b, c, d of every lane
+#define QUARTER(x, a, b, c, d)                                                 \
+  for (int l = 0; l < CHACHA_LANES; l++) {                                     \
+    x[a][l] += x[b][l];                                                        \
+    x[d][l] = ROTL32(x[d][l] ^ x[a][l], 16);                                   \
+    x[c][l] += x[d][l];                                                        \
+    x[b][l] = ROTL32(x[b][l] ^ x[c][l], 12);                                   \
+    x[a][l] += x[b][l];                                                        \
+    x[d][l] = ROTL32(x[d][l] ^ x[a][l], 8);                                    \
+    x[c][l] += x[d][l];                                                        \
+    x[b][l] = ROTL32(x[b][l] ^ x[c][l], 7);                                    \
+  }
+
+// CHACHA_LANES consecutive keystream blocks starting at counter, laid out
+// word-major so every step of a round is the same operation on each lane
+static void chacha20_blocks(uint8_t out[CHACHA_LANES * CHACHA_BLOCK_SIZE],
+                            const uint32_t input[16], uint32_t counter) {
+  uint32_t x[16][CHACHA_LANES];
+  for (int i = 0; i < 16; i++) {
+    for (int l = 0; l < CHACHA_LANES; l++) {
+      x[i][l] = input[i];
+    }
+  }
+  for (int l = 0; l < CHACHA_LANES; l++) {
+    x[12][l] = counter + (uint32_t)l;
+  }
+
+  for (int round = 0; round < 10; round++) { // 20 rounds, two per pass
+    QUARTER(x, 0, 4, 8, 12)
+    QUARTER(x, 1, 5, 9, 13)
+    QUARTER(x, 2, 6, 10, 14)
+    QUARTER(x, 3, 7, 11, 15)
+    QUARTER(x, 0, 5, 10, 15)
+    QUARTER(x, 1, 6, 11, 12)
+    QUARTER(x, 2, 7, 8, 13)
+    QUARTER(x, 3, 4, 9, 14)
+  }
+
+  for (int l = 0; l < CHACHA_LANES; l++) {
+    for (int i = 0; i < 16; i++) {
+      uint32_t word = x[i][l] + ((i == 12) ? counter + (uint32_t)l : input[i]);
+      store32(out + (l * CHACHA_BLOCK_SIZE) + (4 * i), word);
+    }
+  }
+}
+
+void chacha20_xor(uint8_t *out, const uint8_t *in, size_t len,
+                  const uint8_t key[CHACHA_KEY_SIZE], uint32_t counter,
+                  const uint8_t nonce[CHACHA_NONCE_SIZE]) {
+  uint32_t input[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+  for (int i = 0; i < 8; i++) {
+    input[4 + i] = load32(key + (4 * i));
+  }
+  input[12] = counter;
+  for (int i = 0; i < 3; i++) {
+    input[13 + i] = load32(nonce + (4 * i));
+  }
+
+  uint8_t stream[CHACHA_LANES * CHACHA_BLOCK_SIZE];
+  while (len > 0) {
+    chacha20_blocks(stream, input, counter);
+    size_t n = (len < sizeof(stream)) ? len : sizeof(stream);
+    for (size_t i = 0; i < n; i++) {
+      out[i] = in[i] ^ stream[i];
+    }
+    out += n;
+    in += n;
+    len -= n;
+    counter += CHACHA_LANES;
+  }
+}
+
+// Poly1305 with 26-bit limbs, so every product fits in 64 bits
+
+void poly1305_init(poly1305_ctx *ctx, const uint8_t key[32]) {
+  // r &= 0xffffffc0ffffffc0ffffffc0fffffff
+  ctx->r[0] = (load32(key + 0)) & 0x3ffffff;
+  ctx->r[1] = (load32(key + 3) >> 2) & 0x3ffff03;
+  ctx->r[2] = (load32(key + 6) >> 4) & 0x3ffc0ff;
+  ctx->r[3] = (load32(key + 9) >> 6) & 0x3f03fff;
+  ctx->r[4] = (load32(key + 12) >> 8) & 0x00fffff;
+  for (int i = 0; i < 5; i++) {
+    ctx->h[i] = 0;
+  }
+  for (int i = 0; i < 4; i++) {
+    ctx->pad[i] = load32(key + 16 + (4 * i));
+  }
+  ctx->leftover = 0;
+}
+
+// adds 16-byte blocks to the accumulator, hibit is 1 << 24 for full blocks
+static void poly1305_blocks(poly1305_ctx *ctx, const uint8_t *m, size_t len,
+                            uint32_t hibit) {
+  uint32_t r0 = ctx->r[0], r1 = ctx->r[1], r2 = ctx->r[2], r3 = ctx->r[3],
+           r4 = ctx->r[4];
+  uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+  uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], h3 = ctx->h[3],
+           h4 = ctx->h[4];
+
+  while (len >= 16) {
+    // h += m
+    h0 += (load32(m + 0)) & 0x3ffffff;
+    h1 += (load32(m + 3) >> 2) & 0x3ffffff;
+    h2 += (load32(m + 6) >> 4) & 0x3ffffff;
+    h3 += (load32(m + 9) >> 6) & 0x3ffffff;
+    h4 += (load32(m + 12) >> 8) | hibit;
+
+    // h *= r, reduced mod 2^130 - 5 on the way
+    uint64_t d0 = ((uint64_t)h0 * r0) + ((uint64_t)h1 * s4) +
+                  ((uint64_t)h2 * s3) + ((uint64_t)h3 * s2) +
+                  ((uint64_t)h4 * s1);
+    uint64_t d1 = ((uint64_t)h0 * r1) + ((uint64_t)h1 * r0) +
+                  ((uint64_t)h2 * s4) + ((uint64_t)h3 * s3) +
+                  ((uint64_t)h4 * s2);
+    uint64_t d2 = ((uint64_t)h0 * r2) + ((uint64_t)h1 * r1) +
+                  ((uint64_t)h2 * r0) + ((uint64_t)h3 * s4) +
+                  ((uint64_t)h4 * s3);
+    uint64_t d3 = ((uint64_t)h0 * r3) + ((uint64_t)h1 * r2) +
+                  ((uint64_t)h2 * r1) + ((uint64_t)h3 * r0) +
+                  ((uint64_t)h4 * s4);
+    uint64_t d4 = ((uint64_t)h0 * r4) + ((uint64_t)h1 * r3) +
+                  ((uint64_t)h2 * r2) + ((uint64_t)h3 * r1) +
+                  ((uint64_t)h4 * r0);
+
+    // partial carry propagation
+    uint32_t c = (uint32_t)(d0 >> 26);
+    h0 = (uint32_t)d0 & 0x3ffffff;
+    d1 += c;
+    c = (uint32_t)(d1 >> 26);
+    h1 = (uint32_t)d1 & 0x3ffffff;
+    d2 += c;
+    c = (uint32_t)(d2 >> 26);
+    h2 = (uint32_t)d2 & 0x3ffffff;
+    d3 += c;
+    c = (uint32_t)(d3 >> 26);
+    h3 = (uint32_t)d3 & 0x3ffffff;
+    d4 += c;
+    c = (uint32_t)(d4 >> 26);
+    h4 = (uint32_t)d4 & 0x3ffffff;
+    h0 += c * 5;
+    c = h0 >> 26;
+    h0 &= 0x3ffffff;
+    h1 += c;
+
+    m += 16;
+    len -= 16;
+  }
+
+  ctx->h[0] = h0;
+  ctx->h[1] = h1;
+  ctx->h[2] = h2;
+  ctx->h[3] = h3;
+  ctx->h[4] = h4;
+}
+
+void poly1305_update(poly1305_ctx *ctx, const uint8_t *m, size_t len) {
+  if (ctx->leftover > 0) { // top up a partial block first
+    size_t want = 16 - ctx->leftover;
+    if (want > len) {
+      want = len;
+    }
+    memcpy(ctx->buffer + ctx->leftover, m, want);
+    ctx->leftover += want;
+    m += want;
+    len -= want;
+    if (ctx->leftover < 16) {
+      return;
+    }
+    poly1305_blocks(ctx, ctx->buffer, 16, 1 << 24);
+    ctx->leftover = 0;
+  }
+
+  size_t full = len & ~(size_t)15;
+  poly1305_blocks(ctx, m, full, 1 << 24);
+  m += full;
+  len -= full;
+
+  memcpy(ctx->buffer, m, len);
+  ctx->leftover = len;
+}
+
+void poly1305_finish(poly1305_ctx *ctx, uint8_t tag[POLY1305_TAG_SIZE]) {
+  if (ctx->leftover > 0) { // a short last block gets a 1 byte appended
+    ctx->buffer[ctx->leftover] = 1;
+    for (size_t i = ctx->leftover + 1; i < 16; i++) {
+      ctx->buffer[i] = 0;
+    }
+    poly1305_blocks(ctx, ctx->buffer, 16, 0);
+  }
+
+  // fully carry h
+  uint32_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], h3 = ctx->h[3],
+           h4 = ctx->h[4];
+  uint32_t c = h1 >> 26;
+  h1 &= 0x3ffffff;
+  h2 += c;
+  c = h2 >> 26;
+  h2 &= 0x3ffffff;
+  h3 += c;
+  c = h3 >> 26;
+  h3 &= 0x3ffffff;
+  h4 += c;
+  c = h4 >> 26;
+  h4 &= 0x3ffffff;
+  h0 += c * 5;
+  c = h0 >> 26;
+  h0 &= 0x3ffffff;
+  h1 += c;
+
+  // g = h + 5 - 2^130, and pick h or g without branching on secret data
+  uint32_t g0 = h0 + 5;
+  c = g0 >> 26;
+  g0 &= 0x3ffffff;
+  uint32_t g1 = h1 + c;
+  c = g1 >> 26;
+  g1 &= 0x3ffffff;
+  uint32_t g2 = h2 + c;
+  c = g2 >> 26;
+  g2 &= 0x3ffffff;
+  uint32_t g3 = h3 + c;
+  c = g3 >> 26;
+  g3 &= 0x3ffffff;
+  uint32_t g4 = h4 + c - (1UL << 26);
+
+  uint32_t mask = (g4 >> 31) - 1; // all ones if h >= 2^130 - 5
+  g0 &= mask;
+  g1 &= mask;
+  g2 &= mask;
+  g3 &= mask;
+  g4 &= mask;
+  mask = ~mask;
+  h0 = (h0 & mask) | g0;
+  h1 = (h1 & mask) | g1;
+  h2 = (h2 & mask) | g2;
+  h3 = (h3 & mask) | g3;
+  h4 = (h4 & mask) | g4;
+
+  // h = h mod 2^128, then tag = h + s mod 2^128
+  h0 = (h0 | (h1 << 26)) & 0xffffffff;
+  h1 = ((h1 >> 6) | (h2 << 20)) & 0xffffffff;
+  h2 = ((h2 >> 12) | (h3 << 14)) & 0xffffffff;
+  h3 = ((h3 >> 18) | (h4 << 8)) & 0xffffffff;
+
+  uint64_t f = (uint64_t)h0 + ctx->pad[0];
+  h0 = (uint32_t)f;
+  f = (uint64_t)h1 + ctx->pad[1] + (f >> 32);
+  h1 = (uint32_t)f;
+  f = (uint64_t)h2 + ctx->pad[2] + (f >> 32);
+  h2 = (uint32_t)f;
+  f = (uint64_t)h3 + ctx->pad[3] + (f >> 32);
+  h3 = (uint32_t)f;
+
+  store32(tag + 0, h0);
+  store32(tag + 4, h1);
+  store32(tag + 8, h2);
+  store32(tag + 12, h3);
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+// the RFC 8439 tag over aad and ciphertext, with a key from block 0
+static void aead_tag(uint8_t tag[POLY1305_TAG_SIZE], const uint8_t *ct,
+                     size_t len, const uint8_t *aad, size_t aad_len,
+                     const uint8_t key[CHACHA_KEY_SIZE],
+                     const uint8_t nonce[CHACHA_NONCE_SIZE]) {
+  uint8_t otk[32] = {0};
+  chacha20_xor(otk, otk, sizeof(otk), key, 0, nonce);
+
+  static const uint8_t zeros[16] = {0};
+  poly1305_ctx poly;
+  poly1305_init(&poly, otk);
+  poly1305_update(&poly, aad, aad_len);
+  poly1305_update(&poly, zeros, (16 - (aad_len % 16)) % 16);
+  poly1305_update(&poly, ct, len);
+  poly1305_update(&poly, zeros, (16 - (len % 16)) % 16);
+  uint8_t lengths[16];
+  store64(lengths, aad_len);
+  store64(lengths + 8, len);
+  poly1305_update(&poly, lengths, sizeof(lengths));
+  poly1305_finish(&poly, tag);
+  memset(otk, 0, sizeof(otk));
+}
+
+void aead_seal(uint8_t *out, uint8_t tag[POLY1305_TAG_SIZE], const uint8_t *in,
+               size_t len, const uint8_t *aad, size_t aad_len,
+               const uint8_t key[CHACHA_KEY_SIZE],
+               const uint8_t nonce[CHACHA_NONCE_SIZE]) {
+  chacha20_xor(out, in, len, key, 1, nonce);
+  aead_tag(tag, out, len, aad, aad_len, key, nonce);
+}
+
+bool aead_open(uint8_t *out, const uint8_t *in, size_t len,
+               const uint8_t tag[POLY1305_TAG_SIZE], const uint8_t *aad,
+               size_t aad_len, const uint8_t key[CHACHA_KEY_SIZE],
+               const uint8_t nonce[CHACHA_NONCE_SIZE]) {
+  uint8_t expected[POLY1305_TAG_SIZE];
+  aead_tag(expected, in, len, aad, aad_len, key, nonce);
+
+  uint8_t diff = 0; // compare in constant time
+  for (int i = 0; i < POLY1305_TAG_SIZE; i++) {
+    diff |= expected[i] ^ tag[i];
+  }
+  if (diff != 0) {
+    return false;
+  }
+  chacha20_xor(out, in, len, key, 1, nonce);
+  return true;
+}
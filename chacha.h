@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// ChaCha20-Poly1305 authenticated encryption (RFC 8439), implemented in
+// portable C. The ChaCha20 core works on CHACHA_LANES blocks at once in
+// plain arrays, so the compiler can turn each round into vector code.
+//
+
+#define CHACHA_KEY_SIZE 32
+#define CHACHA_NONCE_SIZE 12
+#define CHACHA_BLOCK_SIZE 64
+#define CHACHA_LANES 4
+#define POLY1305_TAG_SIZE 16
+
+//
+// XORs a ChaCha20 keystream into a buffer: out = in ^ keystream.
+// out may alias in.
+//
+// out: will store the result, len bytes.
+// in: the input, len bytes.
+// len: the number of bytes.
+// key: the 32-byte key.
+// counter: the block counter of the first block.
+// nonce: the 12-byte nonce.
+//
+void chacha20_xor(uint8_t *out, const uint8_t *in, size_t len,
+                  const uint8_t key[CHACHA_KEY_SIZE], uint32_t counter,
+                  const uint8_t nonce[CHACHA_NONCE_SIZE]);
+
+//
+// Incremental Poly1305 one-time authenticator.
+//
+typedef struct {
+  uint32_t r[5];   // the clamped key r, 26-bit limbs
+  uint32_t h[5];   // the accumulator, 26-bit limbs
+  uint32_t pad[4]; // the key s
+  uint8_t buffer[16];
+  size_t leftover; // bytes waiting in buffer
+} poly1305_ctx;
+
+//
+// Starts a Poly1305 computation with a 32-byte one-time key.
+//
+// ctx: the state to initialize.
+// key: the one-time key, r followed by s.
+//
+void poly1305_init(poly1305_ctx *ctx, const uint8_t key[32]);
+
+//
+// Adds message bytes to a Poly1305 computation.
+//
+// ctx: the state.
+// m: the bytes to add.
+// len: the number of bytes.
+//
+void poly1305_update(poly1305_ctx *ctx, const uint8_t *m, size_t len);
+
+//
+// Finishes a Poly1305 computation.
+//
+// ctx: the state, which must not be used again.
+// tag: will store the 16-byte tag.
+//
+void poly1305_finish(poly1305_ctx *ctx, uint8_t tag[POLY1305_TAG_SIZE]);
+
+//
+// Encrypts and authenticates a message with ChaCha20-Poly1305.
+// out may alias in.
+//
+// out: will store the ciphertext, len bytes.
+// tag: will store the 16-byte tag.
+// in: the plaintext, len bytes.
+// len: the number of bytes.
+// aad: additional data that is authenticated but not encrypted.
+// aad_len: the number of bytes of aad.
+// key: the 32-byte key.
+// nonce: the 12-byte nonce, never to be reused with the same key.
+//
+void aead_seal(uint8_t *out, uint8_t tag[POLY1305_TAG_SIZE], const uint8_t *in,
+               size_t len, const uint8_t *aad, size_t aad_len,
+               const uint8_t key[CHACHA_KEY_SIZE],
+               const uint8_t nonce[CHACHA_NONCE_SIZE]);
+
+//
+// Checks and decrypts a message sealed with aead_seal().
+// out may alias in. Nothing is decrypted if the tag does not match.
+//
+// out: will store the plaintext, len bytes.
+// in: the ciphertext, len bytes.
+// len: the number of bytes.
+// tag: the 16-byte tag to check.
+// aad: the additional data given to aead_seal().
+// aad_len: the number of bytes of aad.
+// key: the 32-byte key.
+// nonce: the 12-byte nonce.
+// returns: true if the tag matched and out holds the plaintext.
+//
+bool aead_open(uint8_t *out, const uint8_t *in, size_t len,
+               const uint8_t tag[POLY1305_TAG_SIZE], const uint8_t *aad,
+               size_t aad_len, const uint8_t key[CHACHA_KEY_SIZE],
+               const uint8_t nonce[CHACHA_NONCE_SIZE]);
@@ -0,0 +1,176 @@
+// clang-format off
+#include <stdio.h>
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "container.h"
+// clang-format on
+
+// big-endian helpers for the header fields
+static void put_u32(uint8_t *buf, uint32_t x) {
+  for (int i = 3; i >= 0; i--) {
+    buf[i] = (uint8_t)(x & 0xFF);
+    x >>= 8;
+  }
+}
+
+static void put_u64(uint8_t *buf, uint64_t x) {
+  for (int i = 7; i >= 0; i--) {
+    buf[i] = (uint8_t)(x & 0xFF);
+    x >>= 8;
+  }
+}
+
+static uint32_t get_u32(const uint8_t *buf) {
+  uint32_t x = 0;
+  for (int i = 0; i < 4; i++) {
+    x = (x << 8) | buf[i];
+  }
+  return x;
+}
+
+static uint64_t get_u64(const uint8_t *buf) {
+  uint64_t x = 0;
+  for (int i = 0; i < 8; i++) {
+    x = (x << 8) | buf[i];
+  }
+  return x;
+}
+
+uint64_t container_fingerprint(mpz_t n) {
+  size_t count;
+  uint8_t *bytes = (uint8_t *)mpz_export(NULL, &count, 1, sizeof(uint8_t), 1,
+                                         0, n); // big-endian bytes of n
+
+  uint64_t hash = 0xcbf29ce484222325ULL; // FNV-1a offset basis
+  for (size_t i = 0; i < count; i++) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL; // FNV-1a prime
+  }
+
+  free(bytes);
+  return hash;
+}
+
+void container_init(container_header *h, mpz_t n) {
+  uint64_t bits = mpz_sizeinbase(n, 2);
+  h->version = CONTAINER_VERSION;
+  h->record_size = (uint32_t)((bits + 7) / 8);
+  h->block_size = (uint32_t)(((bits - 1) / 8) - 1); // k - 1, as in encrypt
+  h->block_count = 0;
+  h->fingerprint = container_fingerprint(n);
+}
+
+bool container_check(container_header *h, mpz_t n) {
+  container_header expected;
+  container_init(&expected, n);
+  return (h->version == CONTAINER_VERSION) &&
+         (h->record_size == expected.record_size) &&
+         (h->block_size == expected.block_size) &&
+         (h->fingerprint == expected.fingerprint);
+}
+
+bool container_check_count(container_header *h, uint64_t records) {
+  return (h->block_count == 0) || (h->block_count == records);
+}
+
+void container_encode(uint8_t *buf, container_header *h) {
+  memset(buf, 0, CONTAINER_HEADER_SIZE);
+  memcpy(buf, CONTAINER_MAGIC, 4);
+  buf[4] = h->version;
+  put_u32(buf + 8, h->record_size);
+  put_u32(buf + 12, h->block_size);
+  put_u64(buf + 16, h->block_count);
+  put_u64(buf + 24, h->fingerprint);
+}
+
+bool container_decode(container_header *h, const uint8_t *buf) {
+  if (memcmp(buf, CONTAINER_MAGIC, 4) != 0) {
+    return false;
+  }
+  h->version = buf[4];
+  h->record_size = get_u32(buf + 8);
+  h->block_size = get_u32(buf + 12);
+  h->block_count = get_u64(buf + 16);
+  h->fingerprint = get_u64(buf + 24);
+  return true;
+}
+
+void container_write_header(container_header *h, FILE *outfile) {
+  uint8_t buf[CONTAINER_HEADER_SIZE];
+  container_encode(buf, h);
+  fwrite(buf, sizeof(uint8_t), CONTAINER_HEADER_SIZE, outfile);
+}
+
+void container_patch_count(FILE *outfile, uint64_t block_count) {
+  long end = ftell(outfile);
+  if ((end < 0) || (fseek(outfile, 16, SEEK_SET) != 0)) {
+    return; // not seekable, leave the count as unknown
+  }
+  uint8_t buf[8];
+  put_u64(buf, block_count);
+  fwrite(buf, sizeof(uint8_t), 8, outfile);
+  fseek(outfile, end, SEEK_SET);
+}
+
+uint64_t container_offset(container_header *h, uint64_t i) {
+  return CONTAINER_HEADER_SIZE + (i * h->record_size);
+}
+
+void container_export(uint8_t *record, uint64_t width, mpz_t c) {
+  size_t count = (mpz_sizeinbase(c, 2) + 7) / 8;
+  if (mpz_sgn(c) == 0) {
+    count = 0;
+  }
+  memset(record, 0, width - count); // leading zero padding
+  mpz_export(record + (width - count), NULL, 1, sizeof(uint8_t), 1, 0, c);
+}
+
+void container_import(mpz_t c, const uint8_t *record, uint64_t width) {
+  mpz_import(c, width, 1, sizeof(uint8_t), 1, 0, record);
+}
+
+void hybrid_init(hybrid_header *h, mpz_t n, uint64_t key_bytes) {
+  uint64_t bits = mpz_sizeinbase(n, 2);
+  uint64_t block_size = ((bits - 1) / 8) - 1; // k - 1, as in encrypt
+  h->version = HYBRID_VERSION;
+  h->record_size = (uint32_t)((bits + 7) / 8);
+  h->wrap_count = (uint32_t)((key_bytes + block_size - 1) / block_size);
+  h->chunk_size = HYBRID_CHUNK_SIZE;
+  h->fingerprint = container_fingerprint(n);
+}
+
+bool hybrid_check(hybrid_header *h, mpz_t n, uint64_t key_bytes) {
+  hybrid_header expected;
+  hybrid_init(&expected, n, key_bytes);
+  return (h->version == HYBRID_VERSION) &&
+         (h->record_size == expected.record_size) &&
+         (h->wrap_count == expected.wrap_count) &&
+         (h->chunk_size == expected.chunk_size) &&
+         (h->fingerprint == expected.fingerprint);
+}
+
+void hybrid_encode(uint8_t *buf, hybrid_header *h) {
+  memset(buf, 0, HYBRID_HEADER_SIZE);
+  memcpy(buf, HYBRID_MAGIC, 4);
+  buf[4] = h->version;
+  put_u32(buf + 8, h->record_size);
+  put_u32(buf + 12, h->wrap_count);
+  put_u32(buf + 16, h->chunk_size);
+  put_u64(buf + 24, h->fingerprint);
+}
+
+bool hybrid_decode(hybrid_header *h, const uint8_t *buf) {
+  if (memcmp(buf, HYBRID_MAGIC, 4) != 0) {
+    return false;
+  }
+  h->version = buf[4];
+  h->record_size = get_u32(buf + 8);
+  h->wrap_count = get_u32(buf + 12);
+  h->chunk_size = get_u32(buf + 16);
+  h->fingerprint = get_u64(buf + 24);
+  return true;
+}
@@ -0,0 +1,203 @@
+#pragma once
+
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//
+// Binary ciphertext container.
+// A fixed-size header is followed by one fixed-width, big-endian record per
+// encrypted block, so block i always starts at container_offset(h, i).
+//
+// Header layout (all integers big-endian):
+//   magic        4 bytes  "RSAC"
+//   version      1 byte
+//   reserved     3 bytes  zero
+//   record_size  4 bytes  bytes per record, ceil(bits(n) / 8)
+//   block_size   4 bytes  plaintext bytes per full block, k - 1
+//   block_count  8 bytes  number of records, 0 if unknown (streamed output)
+//   fingerprint  8 bytes  container_fingerprint(n)
+//
+
+#define CONTAINER_MAGIC "RSAC"
+#define CONTAINER_VERSION 1
+#define CONTAINER_HEADER_SIZE 32
+
+typedef struct {
+  uint8_t version;
+  uint32_t record_size;
+  uint32_t block_size;
+  uint64_t block_count;
+  uint64_t fingerprint;
+} container_header;
+
+//
+// Computes a 64-bit fingerprint of a public modulus (FNV-1a over its
+// big-endian bytes). Used to catch decryption with the wrong key, it is not
+// a cryptographic hash.
+//
+// n: the public modulus.
+//
+uint64_t container_fingerprint(mpz_t n);
+
+//
+// Fills in a header for ciphertext under the given modulus.
+// The block count is set to 0 (unknown).
+//
+// h: the header to fill in.
+// n: the public modulus.
+//
+void container_init(container_header *h, mpz_t n);
+
+//
+// Checks that a header describes ciphertext under the given modulus.
+//
+// h: the header read from the ciphertext.
+// n: the public modulus of the private key.
+// returns: true if the version, sizes and fingerprint all match.
+//
+bool container_check(container_header *h, mpz_t n);
+
+//
+// Checks the block count of a header against the records that were read.
+// A truncated container has fewer records than its header promises.
+//
+// h: the header read from the ciphertext.
+// records: the number of whole records that followed it.
+// returns: true if the count is 0 (unknown) or equals records.
+//
+bool container_check_count(container_header *h, uint64_t records);
+
+//
+// Serializes a header into CONTAINER_HEADER_SIZE bytes.
+//
+// buf: the destination, at least CONTAINER_HEADER_SIZE bytes.
+// h: the header to serialize.
+//
+void container_encode(uint8_t *buf, container_header *h);
+
+//
+// Parses a header from CONTAINER_HEADER_SIZE bytes.
+//
+// h: will store the parsed header.
+// buf: the source bytes.
+// returns: false if the magic number does not match.
+//
+bool container_decode(container_header *h, const uint8_t *buf);
+
+//
+// Writes a header to a file.
+//
+// h: the header to write.
+// outfile: the file to write to.
+//
+void container_write_header(container_header *h, FILE *outfile);
+
+
+//
+// Rewrites the block count of a header that was already written to the
+// start of a file. Does nothing if the file is not seekable (e.g. a pipe).
+//
+// outfile: the file the header was written to.
+// block_count: the final number of records.
+//
+void container_patch_count(FILE *outfile, uint64_t block_count);
+
+//
+// Returns the byte offset of record i from the start of the container.
+//
+// h: the container header.
+// i: the index of the record.
+//
+uint64_t container_offset(container_header *h, uint64_t i);
+
+//
+// Writes a value as a fixed-width, zero-padded big-endian record.
+// The value must fit in width bytes.
+//
+// record: the destination, width bytes.
+// width: the record size.
+// c: the value to write.
+//
+void container_export(uint8_t *record, uint64_t width, mpz_t c);
+
+//
+// Reads a fixed-width big-endian record into a value.
+//
+// c: will store the value.
+// record: the source, width bytes.
+// width: the record size.
+//
+void container_import(mpz_t c, const uint8_t *record, uint64_t width);
+
+//
+// Hybrid ciphertext (encrypt -H).
+// A fixed-size header is followed by wrap_count RSA records that carry the
+// session secret, then by chunks of ChaCha20-Poly1305 ciphertext:
+//   length       4 bytes  plaintext bytes in the chunk, big-endian
+//   ciphertext   length bytes
+//   tag          16 bytes
+// Every chunk but the last holds exactly chunk_size bytes, the last one is
+// shorter (possibly empty) so a truncated file never looks complete.
+//
+// Header layout (all integers big-endian):
+//   magic        4 bytes  "RSAH"
+//   version      1 byte
+//   reserved     3 bytes  zero
+//   record_size  4 bytes  bytes per record, ceil(bits(n) / 8)
+//   wrap_count   4 bytes  number of records holding the session secret
+//   chunk_size   4 bytes  plaintext bytes per full chunk
+//   reserved     4 bytes  zero
+//   fingerprint  8 bytes  container_fingerprint(n)
+//
+
+#define HYBRID_MAGIC "RSAH"
+#define HYBRID_VERSION 1
+#define HYBRID_HEADER_SIZE 32
+#define HYBRID_CHUNK_SIZE 65536
+
+typedef struct {
+  uint8_t version;
+  uint32_t record_size;
+  uint32_t wrap_count;
+  uint32_t chunk_size;
+  uint64_t fingerprint;
+} hybrid_header;
+
+//
+// Fills in a header for hybrid ciphertext under the given modulus, with
+// enough records for a secret of key_bytes bytes.
+//
+// h: the header to fill in.
+// n: the public modulus.
+// key_bytes: the size of the session secret.
+//
+void hybrid_init(hybrid_header *h, mpz_t n, uint64_t key_bytes);
+
+//
+// Checks that a header describes hybrid ciphertext under the given modulus.
+//
+// h: the header read from the ciphertext.
+// n: the public modulus of the private key.
+// key_bytes: the size of the session secret.
+// returns: true if the version, sizes and fingerprint all match.
+//
+bool hybrid_check(hybrid_header *h, mpz_t n, uint64_t key_bytes);
+
+//
+// Serializes a header into HYBRID_HEADER_SIZE bytes.
+//
+// buf: the destination, at least HYBRID_HEADER_SIZE bytes.
+// h: the header to serialize.
+//
+void hybrid_encode(uint8_t *buf, hybrid_header *h);
+
+//
+// Parses a header from HYBRID_HEADER_SIZE bytes.
+//
+// h: will store the parsed header.
+// buf: the source bytes.
+// returns: false if the magic number does not match.
+//
+bool hybrid_decode(hybrid_header *h, const uint8_t *buf);
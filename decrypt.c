@@ -4,6 +4,7 @@
 #include <gmp.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,11 +15,10 @@
 #include "numtheory.h"
 #include "randstate.h"
 #include "rsa.h"
+#include "stats.h"
 
 // clang-format on
 
-gmp_randstate_t state;
-
 int main(int argc, char **argv) { // allows compiled file to get command line
                                   // args (usually its void)
   randstate_init(69420);
@@ -56,9 +56,12 @@ int main(int argc, char **argv) { // allows compiled file to get command line
   strcpy(pv_file_name, "rsa.priv");
 
   int verbose = 0;
+  uint64_t threads = 1;
+  uint64_t memory = RSA_DEFAULT_MEMORY;
+  bool hybrid = false;
 
   // while loop to read getopt command line args
-  while ((opt = getopt(argc, argv, "i:o:n:vh")) != -1) {
+  while ((opt = getopt(argc, argv, "i:o:n:t:m:A:Hvh")) != -1) {
     switch (opt) {
     case 'i': // input file name
       strcpy(input_file_name, optarg);
@@ -73,6 +76,47 @@ int main(int argc, char **argv) { // allows compiled file to get command line
       strcpy(pv_file_name, optarg);
       break;
 
+    case 't': // number of decryption threads
+      threads = strtoul(optarg, NULL, 10);
+      if ((threads < 1) || (threads > 1024)) {
+        fprintf(stderr, "Number of threads must be 1-1024, not %s.\n",
+                optarg);
+        free(pv_file_name);
+        free(output_file_name);
+        free(input_file_name);
+        return 1;
+      }
+      break;
+
+    case 'H': // input was written by encrypt -H
+      hybrid = true;
+      break;
+
+    case 'm': // memory cap of the streaming pipeline, in MiB
+      memory = strtoul(optarg, NULL, 10);
+      if ((memory < 1) || (memory > 65536)) {
+        fprintf(stderr, "Memory cap must be 1-65536 MiB, not %s.\n", optarg);
+        free(pv_file_name);
+        free(output_file_name);
+        free(input_file_name);
+        return 1;
+      }
+      memory <<= 20;
+      break;
+
+    case 'A': // arithmetic backend
+      if (!numtheory_set_backend(optarg)) {
+        fprintf(stderr,
+                "Unknown arithmetic backend %s, expected reference, gmp, "
+                "fast, <a>,<b> or check.\n",
+                optarg);
+        free(pv_file_name);
+        free(output_file_name);
+        free(input_file_name);
+        return 1;
+      }
+      break;
+
     case 'v': // verbose
       verbose = 1;
       break;
@@ -88,7 +132,19 @@ int main(int argc, char **argv) { // allows compiled file to get command line
                       "standard output.\n");
       fprintf(stderr, "    -n <keyfile>: Private key is in <keyfile>. Default: "
                       "rsa.priv.\n");
-      fprintf(stderr, "    -v          : Enable verbose output.\n");
+      fprintf(stderr, "    -t <threads>: Decrypt blocks on <threads> threads. "
+                      "Default: 1.\n");
+      fprintf(stderr, "    -m <MiB>    : Hold at most <MiB> of blocks in "
+                      "flight when streaming.\n");
+      fprintf(stderr, "                  Default: 64.\n");
+      fprintf(stderr, "    -H          : Input was written by encrypt -H "
+                      "(hybrid mode).\n");
+      fprintf(stderr, "    -A <backend>: Arithmetic backend: reference, gmp, "
+                      "fast, or <a>,<b> to\n");
+      fprintf(stderr, "                  cross-check a against b. Default: "
+                      "$NUMTHEORY_BACKEND or fast.\n");
+      fprintf(stderr, "    -v          : Enable verbose output, with "
+                      "hot-path stats as JSON.\n");
       fprintf(stderr,
               "    -h          : Display program synopsis and usage.\n");
 
@@ -109,7 +165,19 @@ int main(int argc, char **argv) { // allows compiled file to get command line
                       "standard output.\n");
       fprintf(stderr, "    -n <keyfile>: Private key is in <keyfile>. Default: "
                       "rsa.priv.\n");
-      fprintf(stderr, "    -v          : Enable verbose output.\n");
+      fprintf(stderr, "    -t <threads>: Decrypt blocks on <threads> threads. "
+                      "Default: 1.\n");
+      fprintf(stderr, "    -m <MiB>    : Hold at most <MiB> of blocks in "
+                      "flight when streaming.\n");
+      fprintf(stderr, "                  Default: 64.\n");
+      fprintf(stderr, "    -H          : Input was written by encrypt -H "
+                      "(hybrid mode).\n");
+      fprintf(stderr, "    -A <backend>: Arithmetic backend: reference, gmp, "
+                      "fast, or <a>,<b> to\n");
+      fprintf(stderr, "                  cross-check a against b. Default: "
+                      "$NUMTHEORY_BACKEND or fast.\n");
+      fprintf(stderr, "    -v          : Enable verbose output, with "
+                      "hot-path stats as JSON.\n");
       fprintf(stderr,
               "    -h          : Display program synopsis and usage.\n");
       free(pv_file_name);
@@ -119,11 +187,21 @@ int main(int argc, char **argv) { // allows compiled file to get command line
     }
   }
 
+  stats_init(verbose == 1);
+
   mpz_t n;
   mpz_init(n);
   mpz_t d;
   mpz_init(d);
 
+  // primes and CRT components, only present in extended private key files
+  mpz_t primes[RSA_MAX_PRIMES];
+  mpz_t exps[RSA_MAX_PRIMES];
+  mpz_t coeffs[RSA_MAX_PRIMES];
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_inits(primes[i], exps[i], coeffs[i], NULL);
+  }
+
   FILE *input_file;
   FILE *output_file;
   FILE *pv_file;
@@ -142,7 +220,8 @@ int main(int argc, char **argv) { // allows compiled file to get command line
   }
 
   if (output_stdout == 0) { // if the user specified an output file
-    output_file = fopen(output_file_name, "w");
+    output_file = fopen(output_file_name,
+                        "w+"); // read-write so the output can be mapped
   } else {
     output_file = stdout;
   }
@@ -158,19 +237,65 @@ int main(int argc, char **argv) { // allows compiled file to get command line
     return 1;
   }
 
-  rsa_read_priv(n, d, pv_file); // values for n,e,s,username should be filled
+  uint64_t count = rsa_read_priv_primes(
+      n, d, primes, exps, coeffs, pv_file); // count is 0 for old key files
+  bool crt = (count > 0);
+  if (mpz_sgn(n) == 0) {
+    fprintf(stderr, "./decrypt: couldn't read a private key from %s.\n",
+            pv_file_name);
+    fclose(pv_file);
+    return 1;
+  }
 
   if (verbose == 1) { // if verbose is on
     gmp_fprintf(stderr, "n - modulus (%zu bits): %Zd\n", mpz_sizeinbase(n, 2),
                 n);
     gmp_fprintf(stderr, "d - private exponent (%zu bits): %Zd\n",
                 mpz_sizeinbase(d, 2), d);
+    if (crt) {
+      fprintf(stderr, "crt decryption: enabled (%lu primes)\n", count);
+    } else {
+      fprintf(stderr, "crt decryption: disabled\n");
+    }
   }
 
-  rsa_decrypt_file(input_file, output_file, n, d); // decrypting the input_file
+  rsa_set_threads(threads);
+  rsa_set_memory(memory);
+
+  bool decrypted;
+  if (hybrid && crt) { // decrypting the input_file
+    decrypted = rsa_decrypt_file_hybrid_primes(input_file, output_file, n,
+                                               primes, exps, coeffs, count);
+  } else if (hybrid) {
+    decrypted = rsa_decrypt_file_hybrid(input_file, output_file, n, d);
+  } else if (crt) {
+    decrypted = rsa_decrypt_file_primes(input_file, output_file, n, primes,
+                                        exps, coeffs, count);
+  } else {
+    decrypted = rsa_decrypt_file(input_file, output_file, n, d);
+  }
+
+  int status = 0;
+  if (!decrypted && hybrid) {
+    fprintf(stderr,
+            "./decrypt: ciphertext is not for %s, is damaged or truncated, "
+            "or the plaintext couldn't be written.\n",
+            pv_file_name);
+    status = 1;
+  } else if (!decrypted) {
+    fprintf(stderr,
+            "./decrypt: ciphertext header does not match %s, the "
+            "ciphertext is damaged or truncated, or it couldn't be read or "
+            "written.\n",
+            pv_file_name);
+    status = 1;
+  }
 
   mpz_clear(d);
   mpz_clear(n);
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_clears(primes[i], exps[i], coeffs[i], NULL);
+  }
 
   fclose(pv_file); // closing the private key file
 
@@ -188,5 +313,5 @@ int main(int argc, char **argv) { // allows compiled file to get command line
   free(output_file_name);
 
   randstate_clear();
-  return 0;
+  return status;
 }
@@ -4,6 +4,7 @@
 #include <gmp.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,10 +15,127 @@
 #include "numtheory.h"
 #include "randstate.h"
 #include "rsa.h"
+#include "stats.h"
 
 // clang-format on
 
-gmp_randstate_t state;
+// most recipients a single run can encrypt for
+#define MAX_RECIPIENTS 256
+
+// adds a public key file to the recipient list, returns false if full
+static bool add_recipient(char **names, uint64_t *count, const char *name) {
+  if (*count == MAX_RECIPIENTS) {
+    fprintf(stderr, "Too many recipients, at most %d are allowed.\n",
+            MAX_RECIPIENTS);
+    return false;
+  }
+  names[*count] = strdup(name);
+  *count += 1;
+  return true;
+}
+
+// adds every public key file listed in a keyring (one path per line)
+static bool read_keyring(char **names, uint64_t *count, const char *keyring) {
+  FILE *file = fopen(keyring, "r");
+  if (file == NULL) {
+    fprintf(stderr, "./encrypt: couldn't open keyring %s.\n", keyring);
+    return false;
+  }
+  char line[4096];
+  bool ok = true;
+  while (ok && (fgets(line, sizeof(line), file) != NULL)) {
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] != '\0') {
+      ok = add_recipient(names, count, line);
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+// encrypts the input once for every recipient into <outfile>.<i>, after
+// checking the signature of each key, returns the exit code
+static int encrypt_multi(FILE *input_file, const char *output_file_name,
+                         char **names, uint64_t count, int verbose) {
+  mpz_t *n = (mpz_t *)calloc(count, sizeof(mpz_t));
+  mpz_t *e = (mpz_t *)calloc(count, sizeof(mpz_t));
+  FILE **outfiles = (FILE **)calloc(count, sizeof(FILE *));
+  char *username = (char *)(calloc(sizeof(char), 4096));
+  char *name = (char *)(calloc(sizeof(char), 4096 + 32));
+  mpz_t s;
+  mpz_init(s);
+  mpz_t mpz_username;
+  mpz_init(mpz_username);
+
+  int status = 0;
+  uint64_t opened = 0;
+  for (uint64_t r = 0; (r < count) && (status == 0); r++) {
+    mpz_init(n[r]);
+    mpz_init(e[r]);
+    FILE *pb_file = fopen(names[r], "r");
+    if (pb_file == NULL) {
+      fprintf(stderr, "./encrypt: couldn't open %s to read public key.\n",
+              names[r]);
+      status = 1;
+      break;
+    }
+    bool read = rsa_read_pub(n[r], e[r], s, username, pb_file);
+    fclose(pb_file);
+    if (!read) {
+      fprintf(stderr, "./encrypt: couldn't read a public key from %s.\n",
+              names[r]);
+      status = 1;
+      break;
+    }
+
+    if (verbose == 1) {
+      fprintf(stderr, "recipient %lu: %s (%s, %zu bits)\n", r, names[r],
+              username, mpz_sizeinbase(n[r], 2));
+    }
+
+    mpz_set_str(mpz_username, username, 62);
+    if (!rsa_verify(mpz_username, s, e[r], n[r])) {
+      fprintf(stderr, "Decrypted signature and username do not lineup for "
+                      "%s.\n",
+              names[r]);
+      status = 1;
+      break;
+    }
+
+    snprintf(name, 4096 + 32, "%s.%lu", output_file_name, r);
+    outfiles[r] = fopen(name, "w");
+    if (outfiles[r] == NULL) {
+      fprintf(stderr, "./encrypt: couldn't open %s to write ciphertext.\n",
+              name);
+      status = 1;
+      break;
+    }
+    opened += 1;
+  }
+
+  if ((status == 0) &&
+      !rsa_encrypt_file_multi(input_file, outfiles, n, e, count)) {
+    fprintf(stderr, "./encrypt: couldn't read the input or write the "
+                    "ciphertext.\n");
+    status = 1;
+  }
+
+  for (uint64_t r = 0; r < count; r++) {
+    if (r < opened) {
+      fclose(outfiles[r]);
+    }
+    mpz_clear(n[r]);
+    mpz_clear(e[r]);
+  }
+  mpz_clear(s);
+  mpz_clear(mpz_username);
+  free(n);
+  free(e);
+  free(outfiles);
+  free(username);
+  free(name);
+  return status;
+}
 
 int main(int argc, char **argv) {
   randstate_init(69420); // initializing randstate
@@ -54,9 +172,17 @@ int main(int argc, char **argv) {
   strcpy(pb_file_name, "rsa.pub");
 
   int verbose = 0;
+  uint64_t threads = 1;
+  uint64_t memory = RSA_DEFAULT_MEMORY;
+  rsa_format_t format = RSA_FORMAT_BINARY;
+  bool hybrid = false;
+
+  // public key files given with -n or -K
+  char *recipients[MAX_RECIPIENTS];
+  uint64_t recipient_count = 0;
 
   // while loop to read getopt command line args
-  while ((opt = getopt(argc, argv, "i:o:n:vh")) != -1) {
+  while ((opt = getopt(argc, argv, "i:o:n:K:t:m:A:xHvh")) != -1) {
     switch (opt) {
     case 'i': // input file name
       strcpy(input_file_name, optarg);
@@ -67,8 +193,68 @@ int main(int argc, char **argv) {
       output_stdout = 0;
       break;
 
-    case 'n': // public key file name
+    case 'n': // public key file name, repeat for more recipients
       strcpy(pb_file_name, optarg);
+      if (!add_recipient(recipients, &recipient_count, optarg)) {
+        free(pb_file_name);
+        free(output_file_name);
+        free(input_file_name);
+        return 1;
+      }
+      break;
+
+    case 'K': // keyring file listing recipients
+      if (!read_keyring(recipients, &recipient_count, optarg)) {
+        free(pb_file_name);
+        free(output_file_name);
+        free(input_file_name);
+        return 1;
+      }
+      break;
+
+    case 't': // number of encryption threads
+      threads = strtoul(optarg, NULL, 10);
+      if ((threads < 1) || (threads > 1024)) {
+        fprintf(stderr, "Number of threads must be 1-1024, not %s.\n",
+                optarg);
+        free(pb_file_name);
+        free(output_file_name);
+        free(input_file_name);
+        return 1;
+      }
+      break;
+
+    case 'x': // legacy hex output
+      format = RSA_FORMAT_HEX;
+      break;
+
+    case 'H': // session key plus ChaCha20-Poly1305
+      hybrid = true;
+      break;
+
+    case 'm': // memory cap of the streaming pipeline, in MiB
+      memory = strtoul(optarg, NULL, 10);
+      if ((memory < 1) || (memory > 65536)) {
+        fprintf(stderr, "Memory cap must be 1-65536 MiB, not %s.\n", optarg);
+        free(pb_file_name);
+        free(output_file_name);
+        free(input_file_name);
+        return 1;
+      }
+      memory <<= 20;
+      break;
+
+    case 'A': // arithmetic backend
+      if (!numtheory_set_backend(optarg)) {
+        fprintf(stderr,
+                "Unknown arithmetic backend %s, expected reference, gmp, "
+                "fast, <a>,<b> or check.\n",
+                optarg);
+        free(pb_file_name);
+        free(output_file_name);
+        free(input_file_name);
+        return 1;
+      }
       break;
 
     case 'v': // verbose
@@ -87,7 +273,27 @@ int main(int argc, char **argv) {
       fprintf(
           stderr,
           "    -n <keyfile>: Public key is in <keyfile>. Default: rsa.pub.\n");
-      fprintf(stderr, "    -v          : Enable verbose output.\n");
+      fprintf(stderr, "                  Repeat -n to encrypt for several "
+                      "recipients into <outfile>.<i>.\n");
+      fprintf(stderr, "    -K <keyring>: Add every public key file listed "
+                      "in <keyring> as a recipient.\n");
+      fprintf(stderr, "    -t <threads>: Encrypt blocks on <threads> threads. "
+                      "Default: 1.\n");
+      fprintf(stderr, "    -m <MiB>    : Hold at most <MiB> of blocks in "
+                      "flight when streaming.\n");
+      fprintf(stderr, "                  Default: 64.\n");
+      fprintf(stderr, "    -x          : Write legacy hex ciphertext instead "
+                      "of a binary container.\n");
+      fprintf(stderr, "    -H          : Hybrid mode, wrap a random session "
+                      "key with RSA and\n");
+      fprintf(stderr, "                  encrypt the data with "
+                      "ChaCha20-Poly1305.\n");
+      fprintf(stderr, "    -A <backend>: Arithmetic backend: reference, gmp, "
+                      "fast, or <a>,<b> to\n");
+      fprintf(stderr, "                  cross-check a against b. Default: "
+                      "$NUMTHEORY_BACKEND or fast.\n");
+      fprintf(stderr, "    -v          : Enable verbose output, with "
+                      "hot-path stats as JSON.\n");
       fprintf(stderr,
               "    -h          : Display program synopsis and usage.\n");
 
@@ -109,7 +315,27 @@ int main(int argc, char **argv) {
       fprintf(
           stderr,
           "    -n <keyfile>: Public key is in <keyfile>. Default: rsa.pub.\n");
-      fprintf(stderr, "    -v          : Enable verbose output.\n");
+      fprintf(stderr, "                  Repeat -n to encrypt for several "
+                      "recipients into <outfile>.<i>.\n");
+      fprintf(stderr, "    -K <keyring>: Add every public key file listed "
+                      "in <keyring> as a recipient.\n");
+      fprintf(stderr, "    -t <threads>: Encrypt blocks on <threads> threads. "
+                      "Default: 1.\n");
+      fprintf(stderr, "    -m <MiB>    : Hold at most <MiB> of blocks in "
+                      "flight when streaming.\n");
+      fprintf(stderr, "                  Default: 64.\n");
+      fprintf(stderr, "    -x          : Write legacy hex ciphertext instead "
+                      "of a binary container.\n");
+      fprintf(stderr, "    -H          : Hybrid mode, wrap a random session "
+                      "key with RSA and\n");
+      fprintf(stderr, "                  encrypt the data with "
+                      "ChaCha20-Poly1305.\n");
+      fprintf(stderr, "    -A <backend>: Arithmetic backend: reference, gmp, "
+                      "fast, or <a>,<b> to\n");
+      fprintf(stderr, "                  cross-check a against b. Default: "
+                      "$NUMTHEORY_BACKEND or fast.\n");
+      fprintf(stderr, "    -v          : Enable verbose output, with "
+                      "hot-path stats as JSON.\n");
       fprintf(stderr,
               "    -h          : Display program synopsis and usage.\n");
       free(pb_file_name);
@@ -119,6 +345,53 @@ int main(int argc, char **argv) {
     }
   }
 
+  stats_init(verbose == 1);
+
+  if (recipient_count > 1) { // several recipients, one pass over the input
+    int status = 0;
+    if (output_stdout == 1) {
+      fprintf(stderr, "./encrypt: several recipients need -o <outfile>.\n");
+      status = 1;
+    }
+    if (hybrid) {
+      fprintf(stderr, "./encrypt: -H takes a single recipient.\n");
+      status = 1;
+    }
+    FILE *input_file = stdin;
+    if ((status == 0) && (input_stdin == 0)) {
+      input_file = fopen(input_file_name, "r");
+      if (input_file == NULL) {
+        fprintf(stderr,
+                "encrypt: Couldn't open %s to read plaintext: No such file or "
+                "directory\n",
+                input_file_name);
+        status = 1;
+      }
+    }
+    if (status == 0) {
+      rsa_set_threads(threads);
+      rsa_set_memory(memory);
+      rsa_set_format(format);
+      status = encrypt_multi(input_file, output_file_name, recipients,
+                             recipient_count, verbose);
+      if (input_stdin == 0) {
+        fclose(input_file);
+      }
+    }
+    for (uint64_t r = 0; r < recipient_count; r++) {
+      free(recipients[r]);
+    }
+    free(input_file_name);
+    free(output_file_name);
+    free(pb_file_name);
+    randstate_clear();
+    return status;
+  }
+  if (recipient_count == 1) {
+    strcpy(pb_file_name, recipients[0]); // a keyring of one key
+    free(recipients[0]);
+  }
+
   mpz_t n;
   mpz_init(n);
   mpz_t e;
@@ -149,7 +422,8 @@ int main(int argc, char **argv) {
   }
 
   if (output_stdout == 0) { // if the user specified an output file
-    output_file = fopen(output_file_name, "w");
+    output_file = fopen(output_file_name,
+                        "w+"); // read-write so the output can be mapped
   } else {
     output_file = stdout;
   }
@@ -173,8 +447,14 @@ int main(int argc, char **argv) {
     return 1;
   }
 
-  rsa_read_pub(n, e, s, username,
-               pb_file); // values for n,e,s,username should be filled
+  if (!rsa_read_pub(n, e, s, username,
+                    pb_file)) { // values for n,e,s,username should be filled
+    fprintf(stderr, "./encrypt: couldn't read a public key from %s.\n",
+            pb_file_name);
+    fclose(pb_file);
+    free(username);
+    return 1;
+  }
 
   if (verbose == 1) { // if verbose is on
     fprintf(stderr, "username: %s\n", username);
@@ -195,12 +475,28 @@ int main(int argc, char **argv) {
   int verified =
       rsa_verify(mpz_username, s, e,
                  n);   // storing the result of the verification into verified
+  int status = 0;
   if (verified == 1) { // if they are verified
     // printf("verified\n");
-    rsa_encrypt_file(input_file, output_file, n, e);
-    // rsa_encrypt_file(input_file, output_file, n, e);
+    rsa_set_threads(threads);
+    rsa_set_memory(memory);
+    rsa_set_format(format);
+    if (!hybrid) {
+      if (!rsa_encrypt_file(input_file, output_file, n, e)) {
+        fprintf(stderr, "./encrypt: couldn't read the input or write the "
+                        "ciphertext.\n");
+        status = 1;
+      }
+    } else if (!rsa_encrypt_file_hybrid(input_file, output_file, n, e)) {
+      fprintf(stderr, "./encrypt: couldn't draw a random session key, read "
+                      "the input or write the ciphertext.\n");
+      status = 1;
+    }
   } else {
     fprintf(stderr, "Decrypted signature and username do not lineup.\n");
+    status = 1;
+  }
+  if (status != 0) {
     mpz_clear(e);
     mpz_clear(n);
     mpz_clear(s);
@@ -0,0 +1,66 @@
+// clang-format off
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+// clang-format on
+
+// writes primetable.c to stdout: the first count odd primes and their
+// grouping into unsigned long products (see primetable.h)
+int main(int argc, char **argv) {
+  uint64_t count = 2048; // number of odd primes in the table
+  if (argc > 1) {
+    count = strtoul(argv[1], NULL, 10);
+  }
+  if ((count == 0) || (count > 100000)) {
+    fprintf(stderr, "gen_primes: count must be 1-100000, not %lu.\n", count);
+    return 1;
+  }
+
+  uint32_t *primes = (uint32_t *)malloc(count * sizeof(uint32_t));
+  if (primes == NULL) {
+    fprintf(stderr, "No more memory!\n");
+    return 1;
+  }
+
+  // trial division by the odd primes found so far is plenty at this size
+  uint64_t found = 0;
+  for (uint32_t c = 3; found < count; c += 2) {
+    int composite = 0;
+    for (uint64_t i = 0; (i < found) && (primes[i] * primes[i] <= c); i++) {
+      if (c % primes[i] == 0) {
+        composite = 1;
+        break;
+      }
+    }
+    if (!composite) {
+      primes[found++] = c;
+    }
+  }
+
+  printf("// generated by gen_primes, do not edit\n\n");
+  printf("#include \"primetable.h\"\n\n");
+  printf("const uint64_t small_primes_count = %lu;\n\n", count);
+  printf("const uint32_t small_primes[] = {");
+  for (uint64_t i = 0; i < count; i++) {
+    printf("%s%u,", (i % 10 == 0) ? "\n    " : " ", primes[i]);
+  }
+  printf("\n};\n\n");
+
+  printf("const prime_group small_prime_groups[] = {\n");
+  uint64_t groups = 0;
+  for (uint64_t i = 0; i < count;) {
+    unsigned long product = primes[i];
+    uint64_t first = i++;
+    while ((i < count) && (product <= ULONG_MAX / primes[i])) {
+      product *= primes[i++];
+    }
+    printf("    {%luUL, %lu, %lu},\n", product, first, i - first);
+    groups += 1;
+  }
+  printf("};\n\n");
+  printf("const uint64_t small_prime_groups_count = %lu;\n", groups);
+
+  free(primes);
+  return 0;
+}
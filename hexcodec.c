@@ -0,0 +1,321 @@
+// clang-format off
+#include <gmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hexcodec.h"
+// clang-format on
+
+// the vector paths work on 64-bit limbs, 16 digits each
+#if defined(__x86_64__) && (GMP_NUMB_BITS == 64) && (GMP_NAIL_BITS == 0) &&   \
+    !defined(RSA_NO_SIMD)
+#define HEX_X86 1
+#include <immintrin.h>
+#endif
+
+#define LIMB_DIGITS (GMP_NUMB_BITS / 4)
+
+static const char digits[] = "0123456789abcdef";
+
+// returns the value of a hex digit, or -1
+static int digit_value(uint8_t c) {
+  if ((c >= '0') && (c <= '9')) {
+    return c - '0';
+  }
+  c |= 0x20; // lower case
+  if ((c >= 'a') && (c <= 'f')) {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// writes limbs[count - 1] down to limbs[0] with all their digits
+static void encode_scalar(uint8_t *dst, const mp_limb_t *limbs,
+                          mp_size_t count) {
+  for (mp_size_t i = count - 1; i >= 0; i--) {
+    mp_limb_t x = limbs[i];
+    for (int j = LIMB_DIGITS - 1; j >= 0; j--) {
+      dst[j] = digits[x & 0xf];
+      x >>= 4;
+    }
+    dst += LIMB_DIGITS;
+  }
+}
+
+// reads count full limbs of digits into limbs[count - 1] down to limbs[0]
+// unused when the vector paths are built, but test_hexcodec.c checks them
+// against it
+__attribute__((unused)) static bool
+decode_scalar(mp_limb_t *limbs, const uint8_t *src, mp_size_t count) {
+  for (mp_size_t i = count - 1; i >= 0; i--) {
+    mp_limb_t x = 0;
+    for (int j = 0; j < LIMB_DIGITS; j++) {
+      int v = digit_value(src[j]);
+      if (v < 0) {
+        return false;
+      }
+      x = (x << 4) | (mp_limb_t)v;
+    }
+    limbs[i] = x;
+    src += LIMB_DIGITS;
+  }
+  return true;
+}
+
+#ifdef HEX_X86
+
+// the digits of the nibbles in v, each byte 0 to 15
+static inline __m128i nibble_digits_sse2(__m128i v) {
+  __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(9)),
+                                  _mm_set1_epi8('a' - '0' - 10));
+  return _mm_add_epi8(v, _mm_add_epi8(_mm_set1_epi8('0'), letters));
+}
+
+// the values of the digits in c, with *valid set to a bit per hex digit
+static inline __m128i digit_values_sse2(__m128i c, int *valid) {
+  __m128i lower = _mm_or_si128(c, _mm_set1_epi8(0x20));
+  __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                   _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+  __m128i is_letter =
+      _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                    _mm_cmpgt_epi8(_mm_set1_epi8('f' + 1), lower));
+  *valid = _mm_movemask_epi8(_mm_or_si128(is_digit, is_letter));
+  return _mm_or_si128(
+      _mm_and_si128(is_digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+      _mm_and_si128(is_letter,
+                    _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+}
+
+// two limbs (32 digits) at a time
+static void encode_sse2(uint8_t *dst, const mp_limb_t *limbs,
+                        mp_size_t count) {
+  __m128i low_nibbles = _mm_set1_epi8(0x0f);
+  while (count >= 2) {
+    // big-endian bytes, the higher limb first
+    __m128i v = _mm_set_epi64x((long long)__builtin_bswap64(limbs[count - 2]),
+                               (long long)__builtin_bswap64(limbs[count - 1]));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low_nibbles);
+    __m128i lo = _mm_and_si128(v, low_nibbles);
+    _mm_storeu_si128((__m128i *)dst,
+                     nibble_digits_sse2(_mm_unpacklo_epi8(hi, lo)));
+    _mm_storeu_si128((__m128i *)(dst + 16),
+                     nibble_digits_sse2(_mm_unpackhi_epi8(hi, lo)));
+    dst += 2 * LIMB_DIGITS;
+    count -= 2;
+  }
+  encode_scalar(dst, limbs, count);
+}
+
+// one limb (16 digits) at a time
+static bool decode_sse2(mp_limb_t *limbs, const uint8_t *src,
+                        mp_size_t count) {
+  __m128i low_bytes = _mm_set1_epi16(0x00ff);
+  for (mp_size_t i = count - 1; i >= 0; i--) {
+    int valid;
+    __m128i v =
+        digit_values_sse2(_mm_loadu_si128((const __m128i *)src), &valid);
+    if (valid != 0xffff) {
+      return false;
+    }
+    // each pair of digits into one byte, then the 8 bytes into a limb
+    __m128i pairs = _mm_and_si128(
+        _mm_or_si128(_mm_slli_epi16(v, 4), _mm_srli_epi16(v, 8)), low_bytes);
+    __m128i bytes = _mm_packus_epi16(pairs, _mm_setzero_si128());
+    limbs[i] = __builtin_bswap64((uint64_t)_mm_cvtsi128_si64(bytes));
+    src += LIMB_DIGITS;
+  }
+  return true;
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+nibble_digits_avx2(__m256i v) {
+  __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(9)),
+                                     _mm256_set1_epi8('a' - '0' - 10));
+  return _mm256_add_epi8(v, _mm256_add_epi8(_mm256_set1_epi8('0'), letters));
+}
+
+__attribute__((target("avx2"))) static inline __m256i
+digit_values_avx2(__m256i c, uint32_t *valid) {
+  __m256i lower = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+  __m256i is_digit =
+      _mm256_and_si256(_mm256_cmpgt_epi8(c, _mm256_set1_epi8('0' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), c));
+  __m256i is_letter =
+      _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)),
+                       _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), lower));
+  *valid = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_letter));
+  return _mm256_or_si256(
+      _mm256_and_si256(is_digit, _mm256_sub_epi8(c, _mm256_set1_epi8('0'))),
+      _mm256_and_si256(is_letter,
+                       _mm256_sub_epi8(lower, _mm256_set1_epi8('a' - 10))));
+}
+
+// four limbs (64 digits) at a time
+__attribute__((target("avx2"))) static void
+encode_avx2(uint8_t *dst, const mp_limb_t *limbs, mp_size_t count) {
+  __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+  while (count >= 4) {
+    // the first lane holds the top two limbs, the second the next two
+    __m256i v =
+        _mm256_set_epi64x((long long)__builtin_bswap64(limbs[count - 4]),
+                          (long long)__builtin_bswap64(limbs[count - 3]),
+                          (long long)__builtin_bswap64(limbs[count - 2]),
+                          (long long)__builtin_bswap64(limbs[count - 1]));
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_nibbles);
+    __m256i lo = _mm256_and_si256(v, low_nibbles);
+    // unpacking works within lanes, so put the lanes back in limb order
+    __m256i first = _mm256_unpacklo_epi8(hi, lo);
+    __m256i second = _mm256_unpackhi_epi8(hi, lo);
+    _mm256_storeu_si256(
+        (__m256i *)dst,
+        nibble_digits_avx2(_mm256_permute2x128_si256(first, second, 0x20)));
+    _mm256_storeu_si256(
+        (__m256i *)(dst + 32),
+        nibble_digits_avx2(_mm256_permute2x128_si256(first, second, 0x31)));
+    dst += 4 * LIMB_DIGITS;
+    count -= 4;
+  }
+  encode_sse2(dst, limbs, count);
+}
+
+// two limbs (32 digits) at a time
+__attribute__((target("avx2"))) static bool
+decode_avx2(mp_limb_t *limbs, const uint8_t *src, mp_size_t count) {
+  __m256i low_bytes = _mm256_set1_epi16(0x00ff);
+  while (count >= 2) {
+    uint32_t valid;
+    __m256i v = digit_values_avx2(_mm256_loadu_si256((const __m256i *)src),
+                                  &valid);
+    if (valid != 0xffffffffu) {
+      return false;
+    }
+    __m256i pairs = _mm256_and_si256(
+        _mm256_or_si256(_mm256_slli_epi16(v, 4), _mm256_srli_epi16(v, 8)),
+        low_bytes);
+    __m256i bytes = _mm256_packus_epi16(pairs, _mm256_setzero_si256());
+    limbs[count - 1] =
+        __builtin_bswap64((uint64_t)_mm256_extract_epi64(bytes, 0));
+    limbs[count - 2] =
+        __builtin_bswap64((uint64_t)_mm256_extract_epi64(bytes, 2));
+    src += 2 * LIMB_DIGITS;
+    count -= 2;
+  }
+  return decode_sse2(limbs, src, count);
+}
+
+static bool have_avx2(void) { return __builtin_cpu_supports("avx2"); }
+
+#endif
+
+// writes count full limbs with the fastest path the machine has
+static void encode_limbs(uint8_t *dst, const mp_limb_t *limbs,
+                         mp_size_t count) {
+#ifdef HEX_X86
+  if (have_avx2()) {
+    encode_avx2(dst, limbs, count);
+  } else {
+    encode_sse2(dst, limbs, count);
+  }
+#else
+  encode_scalar(dst, limbs, count);
+#endif
+}
+
+static bool decode_limbs(mp_limb_t *limbs, const uint8_t *src,
+                         mp_size_t count) {
+#ifdef HEX_X86
+  if (have_avx2()) {
+    return decode_avx2(limbs, src, count);
+  }
+  return decode_sse2(limbs, src, count);
+#else
+  return decode_scalar(limbs, src, count);
+#endif
+}
+
+size_t hex_max_digits(mp_size_t size) {
+  return (size == 0) ? 1 : (size_t)size * LIMB_DIGITS;
+}
+
+size_t hex_encode(uint8_t *dst, const mp_limb_t *limbs, mp_size_t size) {
+  if (size == 0) {
+    dst[0] = '0';
+    return 1;
+  }
+
+  // the top limb without its leading zeros, the rest in full
+  mp_limb_t top = limbs[size - 1];
+  int shift = GMP_NUMB_BITS - 4;
+  while ((shift > 0) && ((top >> shift) == 0)) {
+    shift -= 4;
+  }
+  size_t used = 0;
+  for (; shift >= 0; shift -= 4) {
+    dst[used++] = digits[(top >> shift) & 0xf];
+  }
+  encode_limbs(dst + used, limbs, size - 1);
+  return used + ((size_t)(size - 1) * LIMB_DIGITS);
+}
+
+mp_size_t hex_limbs(size_t length) {
+  return (mp_size_t)((length + LIMB_DIGITS - 1) / LIMB_DIGITS);
+}
+
+bool hex_decode(mp_limb_t *limbs, const uint8_t *src, size_t length) {
+  mp_size_t size = hex_limbs(length);
+  if (size == 0) {
+    return true;
+  }
+
+  // the leading digits that don't fill a limb go into the top one
+  size_t partial = length % LIMB_DIGITS;
+  if (partial == 0) {
+    partial = LIMB_DIGITS;
+  }
+  mp_limb_t top = 0;
+  for (size_t i = 0; i < partial; i++) {
+    int v = digit_value(src[i]);
+    if (v < 0) {
+      return false;
+    }
+    top = (top << 4) | (mp_limb_t)v;
+  }
+  limbs[size - 1] = top;
+  return decode_limbs(limbs, src + partial, size - 1);
+}
+
+size_t hex_span(const uint8_t *src, size_t length) {
+  size_t i = 0;
+#ifdef HEX_X86
+  while (i + 16 <= length) {
+    int valid;
+    digit_values_sse2(_mm_loadu_si128((const __m128i *)(src + i)), &valid);
+    if (valid != 0xffff) {
+      return i + (size_t)__builtin_ctz(~valid);
+    }
+    i += 16;
+  }
+#endif
+  while ((i < length) && (digit_value(src[i]) >= 0)) {
+    i += 1;
+  }
+  return i;
+}
+
+size_t hex_encode_mpz(uint8_t *dst, mpz_t x) {
+  return hex_encode(dst, mpz_limbs_read(x), (mp_size_t)mpz_size(x));
+}
+
+bool hex_decode_mpz(mpz_t x, const uint8_t *src, size_t length) {
+  mp_size_t size = hex_limbs(length);
+  if (size == 0) {
+    mpz_set_ui(x, 0);
+    return true;
+  }
+  if (!hex_decode(mpz_limbs_write(x, size), src, length)) {
+    return false;
+  }
+  mpz_limbs_finish(x, size); // drops the leading zero limbs
+  return true;
+}
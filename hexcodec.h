@@ -0,0 +1,79 @@
+#pragma once
+
+#include <gmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//
+// Hex encoding and decoding of numbers for the text ciphertext format.
+// Converts straight between GMP limbs and hex digits, 16 or 32 digits at a
+// time with SSE2 or AVX2 where the machine has them and a byte at a time
+// elsewhere. Encoding writes the same digits as gmp_printf("%Zx"): lower
+// case, no leading zeros and "0" for zero. Decoding accepts either case.
+//
+
+//
+// Returns the most hex digits hex_encode() writes for a number of size limbs.
+//
+// size: the number of limbs.
+//
+size_t hex_max_digits(mp_size_t size);
+
+//
+// Writes a number as hex digits, without a terminating NUL.
+//
+// dst: will store the digits, at least hex_max_digits(size) bytes.
+// limbs: the limbs of the number, least significant first.
+// size: the number of limbs, the top one non-zero unless size is 0.
+// returns: the number of digits written.
+//
+size_t hex_encode(uint8_t *dst, const mp_limb_t *limbs, mp_size_t size);
+
+//
+// Reads a run of hex digits into limbs.
+//
+// limbs: will store the number, hex_limbs(length) limbs, least significant
+//        first and possibly with zero limbs on top.
+// src: the digits, most significant first.
+// length: the number of digits.
+// returns: false if src holds anything but hex digits.
+//
+bool hex_decode(mp_limb_t *limbs, const uint8_t *src, size_t length);
+
+//
+// Returns the number of limbs hex_decode() writes for length digits.
+//
+// length: the number of digits.
+//
+mp_size_t hex_limbs(size_t length);
+
+//
+// Returns the length of the run of hex digits at the start of src.
+//
+// src: the bytes to scan.
+// length: the number of bytes.
+//
+size_t hex_span(const uint8_t *src, size_t length);
+
+//
+// Writes an mpz as hex digits, like hex_encode().
+// The mpz_t argument is expected to be initialized and non-negative.
+//
+// dst: will store the digits, at least hex_max_digits(mpz_size(x)) bytes.
+// x: the number.
+// returns: the number of digits written.
+//
+size_t hex_encode_mpz(uint8_t *dst, mpz_t x);
+
+//
+// Reads a run of hex digits into an mpz, like hex_decode().
+// The mpz_t argument is expected to be initialized.
+//
+// x: will store the number.
+// src: the digits, most significant first.
+// length: the number of digits.
+// returns: false (leaving x unspecified) if src holds anything but hex
+//          digits.
+//
+bool hex_decode_mpz(mpz_t x, const uint8_t *src, size_t length);
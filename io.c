@@ -0,0 +1,578 @@
+// clang-format off
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "io.h"
+// clang-format on
+
+#if defined(__linux__) && !defined(RSA_NO_URING)
+#define IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+// one buffer of a reader or writer
+typedef struct {
+  uint8_t *data;
+  size_t length;   // reader: bytes read in, writer: bytes queued
+  size_t pos;      // reader: bytes handed out, writer: bytes written
+  uint64_t offset; // the file offset of data
+  bool busy;       // a transfer is in flight (or, without a ring, due)
+  bool last;       // reader: the input ends in this chunk
+} io_chunk;
+
+#ifdef IO_URING
+
+// an io_uring instance driven by raw system calls
+typedef struct {
+  int fd;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+  void *sq_map, *cq_map; // the same mapping with IORING_FEAT_SINGLE_MMAP
+  size_t sq_map_size, cq_map_size, sqes_size;
+} uring;
+
+static bool uring_init(uring *ring, unsigned entries) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (ring->fd < 0) {
+    return false; // no io_uring in this kernel, or not allowed to use it
+  }
+  if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+    close(ring->fd); // older than IORING_OP_READ and IORING_OP_WRITE
+    return false;
+  }
+
+  ring->sq_map_size = p.sq_off.array + (p.sq_entries * sizeof(unsigned));
+  ring->cq_map_size =
+      p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+  bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single && (ring->cq_map_size > ring->sq_map_size)) {
+    ring->sq_map_size = ring->cq_map_size;
+  }
+  ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_map == MAP_FAILED) {
+    close(ring->fd);
+    return false;
+  }
+  ring->cq_map = ring->sq_map;
+  if (!single) {
+    ring->cq_map =
+        mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_map == MAP_FAILED) {
+      munmap(ring->sq_map, ring->sq_map_size);
+      close(ring->fd);
+      return false;
+    }
+  }
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = (struct io_uring_sqe *)mmap(
+      NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+      ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    if (!single) {
+      munmap(ring->cq_map, ring->cq_map_size);
+    }
+    munmap(ring->sq_map, ring->sq_map_size);
+    close(ring->fd);
+    return false;
+  }
+
+  uint8_t *sq = (uint8_t *)ring->sq_map;
+  uint8_t *cq = (uint8_t *)ring->cq_map;
+  ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+  ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return true;
+}
+
+static void uring_clear(uring *ring) {
+  munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_map != ring->sq_map) {
+    munmap(ring->cq_map, ring->cq_map_size);
+  }
+  munmap(ring->sq_map, ring->sq_map_size);
+  close(ring->fd);
+}
+
+// queues one read or write and hands it to the kernel
+static bool uring_submit(uring *ring, uint8_t op, int fd, void *buf,
+                         size_t len, uint64_t offset, uint64_t user_data) {
+  unsigned tail = *ring->sq_tail; // only this thread moves the tail
+  unsigned index = tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = op;
+  sqe->fd = fd;
+  sqe->addr = (uint64_t)(uintptr_t)buf;
+  sqe->len = (len > (1u << 30)) ? (1u << 30) : (uint32_t)len;
+  sqe->off = offset;
+  sqe->user_data = user_data;
+  ring->sq_array[index] = index;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  long submitted;
+  do {
+    submitted = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+  } while ((submitted < 0) && (errno == EINTR));
+  return submitted == 1;
+}
+
+// waits for the next completion
+static bool uring_wait(uring *ring, uint64_t *user_data, int *res) {
+  for (;;) {
+    unsigned head = *ring->cq_head; // only this thread moves the head
+    if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+      struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+      *user_data = cqe->user_data;
+      *res = cqe->res;
+      __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+    if ((syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS,
+                 NULL, 0) < 0) &&
+        (errno != EINTR)) {
+      return false;
+    }
+  }
+}
+
+#endif
+
+struct io_reader {
+  FILE *f;
+  int fd;       // -1 if f has no descriptor, then stdio does the reading
+  bool regular; // reads go to explicit file offsets
+  uint8_t *buffer;
+  io_chunk *chunks;
+  size_t chunk;
+  unsigned depth;
+  unsigned head;     // the chunk being handed out
+  uint64_t next;     // the file offset of the next chunk to start
+  uint64_t consumed; // the file offset just past the bytes handed out
+  bool ended;        // a read reached the end, start no more
+  bool failed;
+  bool ring_on;
+#ifdef IO_URING
+  uring ring;
+#endif
+};
+
+struct io_writer {
+  FILE *f;
+  int fd;
+  bool regular; // writes go to explicit file offsets
+  uint8_t *buffer;
+  io_chunk *chunks;
+  size_t chunk;
+  unsigned depth;
+  unsigned current; // the chunk being filled
+  uint64_t next;    // the file offset of the next chunk to write
+  bool failed;
+  bool ring_on;
+#ifdef IO_URING
+  uring ring;
+#endif
+};
+
+// sets up the chunks of a reader or writer
+static io_chunk *chunks_init(uint8_t **buffer, size_t chunk, unsigned depth) {
+  *buffer = (uint8_t *)malloc(chunk * depth);
+  io_chunk *chunks = (io_chunk *)calloc(depth, sizeof(io_chunk));
+  for (unsigned i = 0; i < depth; i++) {
+    chunks[i].data = *buffer + (i * chunk);
+  }
+  return chunks;
+}
+
+// fills a chunk with blocking reads, up to its end or the end of the input
+static void reader_fill(io_reader_t *r, io_chunk *c) {
+  while (c->length < r->chunk) {
+    ssize_t n;
+    if (r->fd < 0) {
+      n = (ssize_t)fread(c->data + c->length, sizeof(uint8_t),
+                         r->chunk - c->length, r->f);
+      if ((n == 0) && ferror(r->f)) {
+        n = -1;
+      }
+    } else if (r->regular) {
+      n = pread(r->fd, c->data + c->length, r->chunk - c->length,
+                (off_t)(c->offset + c->length));
+    } else {
+      n = read(r->fd, c->data + c->length, r->chunk - c->length);
+    }
+    if ((n < 0) && (errno == EINTR)) {
+      continue;
+    }
+    if (n <= 0) {
+      r->failed |= (n < 0);
+      r->ended = true;
+      c->last = true;
+      break;
+    }
+    c->length += (size_t)n;
+  }
+  c->busy = false;
+}
+
+#ifdef IO_URING
+// asks the ring for the rest of a chunk
+static void reader_submit(io_reader_t *r, io_chunk *c) {
+  if (!uring_submit(&r->ring, IORING_OP_READ, r->fd, c->data + c->length,
+                    r->chunk - c->length, c->offset + c->length,
+                    (uint64_t)(c - r->chunks))) {
+    reader_fill(r, c);
+  }
+}
+
+// takes one read completion
+static bool reader_complete(io_reader_t *r) {
+  uint64_t index;
+  int res;
+  if (!uring_wait(&r->ring, &index, &res)) {
+    return false;
+  }
+  io_chunk *c = &r->chunks[index];
+  if ((res == -EINTR) || (res == -EAGAIN)) {
+    reader_submit(r, c);
+  } else if (res <= 0) {
+    r->failed |= (res < 0);
+    r->ended = true;
+    c->last = true;
+    c->busy = false;
+  } else {
+    c->length += (size_t)res;
+    if (c->length < r->chunk) {
+      reader_submit(r, c); // a short read, not necessarily the end
+    } else {
+      c->busy = false;
+    }
+  }
+  return true;
+}
+#endif
+
+// starts reading the next part of the file into a chunk
+static void reader_start(io_reader_t *r, io_chunk *c) {
+  c->length = 0;
+  c->pos = 0;
+  c->last = r->ended;
+  c->busy = !r->ended;
+  if (r->ended) {
+    return;
+  }
+  c->offset = r->next;
+  r->next += r->chunk;
+#ifdef IO_URING
+  if (r->ring_on) {
+    reader_submit(r, c);
+  }
+#endif
+}
+
+// waits until a chunk has been read
+static void reader_wait(io_reader_t *r, io_chunk *c) {
+#ifdef IO_URING
+  while (r->ring_on && c->busy) {
+    if (!reader_complete(r)) {
+      r->failed = true;
+      r->ended = true;
+      c->last = true;
+      c->busy = false;
+    }
+  }
+#endif
+  if (c->busy) {
+    reader_fill(r, c);
+  }
+}
+
+// returns the chunk holding the next byte, or NULL at the end of the input
+static io_chunk *reader_ready(io_reader_t *r) {
+  for (;;) {
+    io_chunk *c = &r->chunks[r->head];
+    reader_wait(r, c);
+    if (c->pos < c->length) {
+      return c;
+    }
+    if (c->last) {
+      return NULL;
+    }
+    reader_start(r, c); // reuse it for the part after every other chunk
+    r->head = (r->head + 1) % r->depth;
+  }
+}
+
+io_reader_t *io_reader_open(FILE *f, size_t chunk, unsigned depth) {
+  io_reader_t *r = (io_reader_t *)calloc(1, sizeof(io_reader_t));
+  r->f = f;
+  r->fd = fileno(f);
+  struct stat st;
+  off_t start = ftello(f);
+  r->regular = (r->fd >= 0) && (fstat(r->fd, &st) == 0) &&
+               S_ISREG(st.st_mode) && (start >= 0);
+  r->next = r->regular ? (uint64_t)start : 0;
+  r->consumed = r->next;
+#ifdef IO_URING
+  r->ring_on = r->regular && uring_init(&r->ring, depth);
+#endif
+  if (!r->ring_on) {
+    depth = 1; // blocking reads only ever fill one chunk at a time
+  }
+  r->chunk = chunk;
+  r->depth = depth;
+  r->chunks = chunks_init(&r->buffer, chunk, depth);
+  for (unsigned i = 0; i < depth; i++) {
+    reader_start(r, &r->chunks[i]);
+  }
+  return r;
+}
+
+size_t io_read(io_reader_t *r, uint8_t *dst, size_t len) {
+  size_t copied = 0;
+  io_chunk *c;
+  while ((copied < len) && ((c = reader_ready(r)) != NULL)) {
+    size_t take = c->length - c->pos;
+    if (take > len - copied) {
+      take = len - copied;
+    }
+    memcpy(dst + copied, c->data + c->pos, take);
+    c->pos += take;
+    copied += take;
+  }
+  r->consumed += copied;
+  return copied;
+}
+
+int io_peek(io_reader_t *r) {
+  io_chunk *c = reader_ready(r);
+  return (c == NULL) ? EOF : c->data[c->pos];
+}
+
+ssize_t io_getline(io_reader_t *r, char **line, size_t *size) {
+  size_t used = 0;
+  io_chunk *c;
+  while ((c = reader_ready(r)) != NULL) {
+    uint8_t *start = c->data + c->pos;
+    uint8_t *nl = (uint8_t *)memchr(start, '\n', c->length - c->pos);
+    size_t take = (nl != NULL) ? (size_t)(nl - start) + 1 : c->length - c->pos;
+    if (used + take + 1 > *size) {
+      size_t grown = 2 * (used + take + 1);
+      *line = (char *)realloc(*line, grown);
+      *size = grown;
+    }
+    memcpy(*line + used, start, take);
+    c->pos += take;
+    used += take;
+    if (nl != NULL) {
+      break;
+    }
+  }
+  r->consumed += used;
+  if (used == 0) {
+    return -1;
+  }
+  (*line)[used] = '\0';
+  return (ssize_t)used;
+}
+
+bool io_reader_close(io_reader_t *r) {
+#ifdef IO_URING
+  if (r->ring_on) {
+    r->ended = true; // short reads still finish, but nothing new starts
+    for (unsigned i = 0; i < r->depth; i++) {
+      reader_wait(r, &r->chunks[i]);
+    }
+    uring_clear(&r->ring);
+  }
+#endif
+  if (r->regular) {
+    fseeko(r->f, (off_t)r->consumed, SEEK_SET);
+  }
+  bool ok = !r->failed;
+  free(r->chunks);
+  free(r->buffer);
+  free(r);
+  return ok;
+}
+
+// writes a chunk out with blocking writes
+static void writer_flush(io_writer_t *w, io_chunk *c) {
+  while (c->pos < c->length) {
+    ssize_t n;
+    if (w->fd < 0) {
+      n = (ssize_t)fwrite(c->data + c->pos, sizeof(uint8_t),
+                          c->length - c->pos, w->f);
+    } else if (w->regular) {
+      n = pwrite(w->fd, c->data + c->pos, c->length - c->pos,
+                 (off_t)(c->offset + c->pos));
+    } else {
+      n = write(w->fd, c->data + c->pos, c->length - c->pos);
+    }
+    if ((n < 0) && (errno == EINTR)) {
+      continue;
+    }
+    if (n <= 0) {
+      w->failed = true;
+      break;
+    }
+    c->pos += (size_t)n;
+  }
+  c->length = 0;
+  c->busy = false;
+}
+
+#ifdef IO_URING
+// asks the ring to write the rest of a chunk
+static void writer_submit(io_writer_t *w, io_chunk *c) {
+  if (!uring_submit(&w->ring, IORING_OP_WRITE, w->fd, c->data + c->pos,
+                    c->length - c->pos, c->offset + c->pos,
+                    (uint64_t)(c - w->chunks))) {
+    writer_flush(w, c);
+  }
+}
+
+// takes one write completion
+static bool writer_complete(io_writer_t *w) {
+  uint64_t index;
+  int res;
+  if (!uring_wait(&w->ring, &index, &res)) {
+    return false;
+  }
+  io_chunk *c = &w->chunks[index];
+  if ((res == -EINTR) || (res == -EAGAIN)) {
+    writer_submit(w, c);
+  } else if (res <= 0) {
+    w->failed = true;
+    c->length = 0;
+    c->busy = false;
+  } else {
+    c->pos += (size_t)res;
+    if (c->pos < c->length) {
+      writer_submit(w, c); // a short write, send the rest
+    } else {
+      c->length = 0;
+      c->busy = false;
+    }
+  }
+  return true;
+}
+#endif
+
+// starts writing a filled chunk at the next file offset
+static void writer_start(io_writer_t *w, io_chunk *c) {
+  c->offset = w->next;
+  c->pos = 0;
+  w->next += c->length;
+#ifdef IO_URING
+  if (w->ring_on) {
+    c->busy = true;
+    writer_submit(w, c);
+    return;
+  }
+#endif
+  writer_flush(w, c);
+}
+
+// waits until a chunk has been written out
+static void writer_wait(io_writer_t *w, io_chunk *c) {
+#ifdef IO_URING
+  while (c->busy) {
+    if (!writer_complete(w)) {
+      w->failed = true;
+      c->length = 0;
+      c->busy = false;
+    }
+  }
+#else
+  (void)w;
+  (void)c;
+#endif
+}
+
+io_writer_t *io_writer_open(FILE *f, size_t chunk, unsigned depth) {
+  io_writer_t *w = (io_writer_t *)calloc(1, sizeof(io_writer_t));
+  fflush(f);
+  w->f = f;
+  w->fd = fileno(f);
+  struct stat st;
+  off_t start = ftello(f);
+  int mode = (w->fd >= 0) ? fcntl(w->fd, F_GETFL) : -1;
+  // appending ignores offsets, so chunks could land out of order
+  w->regular = (w->fd >= 0) && (fstat(w->fd, &st) == 0) &&
+               S_ISREG(st.st_mode) && (start >= 0) && (mode >= 0) &&
+               !(mode & O_APPEND);
+  w->next = w->regular ? (uint64_t)start : 0;
+#ifdef IO_URING
+  w->ring_on = w->regular && uring_init(&w->ring, depth);
+#endif
+  if (!w->ring_on) {
+    depth = 1;
+  }
+  w->chunk = chunk;
+  w->depth = depth;
+  w->chunks = chunks_init(&w->buffer, chunk, depth);
+  return w;
+}
+
+bool io_write(io_writer_t *w, const uint8_t *src, size_t len) {
+  while (len > 0) {
+    io_chunk *c = &w->chunks[w->current];
+    writer_wait(w, c);
+    size_t take = w->chunk - c->length;
+    if (take > len) {
+      take = len;
+    }
+    memcpy(c->data + c->length, src, take);
+    c->length += take;
+    src += take;
+    len -= take;
+    if (c->length == w->chunk) {
+      writer_start(w, c);
+      w->current = (w->current + 1) % w->depth;
+    }
+  }
+  return !w->failed;
+}
+
+bool io_writer_close(io_writer_t *w) {
+  io_chunk *c = &w->chunks[w->current];
+  if (c->length > 0) {
+    writer_start(w, c);
+  }
+#ifdef IO_URING
+  if (w->ring_on) {
+    for (unsigned i = 0; i < w->depth; i++) {
+      writer_wait(w, &w->chunks[i]);
+    }
+    uring_clear(&w->ring);
+  }
+#endif
+  if (w->regular) {
+    fseeko(w->f, (off_t)w->next, SEEK_SET);
+  }
+  bool ok = !w->failed;
+  free(w->chunks);
+  free(w->buffer);
+  free(w);
+  return ok;
+}
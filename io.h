@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+//
+// Large-buffer streaming input and output for the file loops.
+// A reader hands out exactly the bytes asked for, however the kernel splits
+// them (a pipe returns at most 64 KiB per read), and a writer gathers small
+// writes into large chunks. Both own depth chunks of chunk bytes each.
+// On Linux, regular files keep all of those chunks in flight at once through
+// an io_uring ring, so reads run ahead of the consumer and writes drain
+// behind the producer at the full queue depth. Pipes, terminals, files
+// opened for appending, kernels without io_uring and builds with
+// make URING=0 (-DRSA_NO_URING) use plain read()/write() one chunk at a
+// time instead.
+// A reader or writer must only be used by one thread at a time.
+//
+typedef struct io_reader io_reader_t;
+typedef struct io_writer io_writer_t;
+
+// the default chunk size and queue depth
+#define IO_CHUNK ((size_t)4 << 20)
+#define IO_DEPTH 4
+
+//
+// Starts reading a file from its current position.
+// Until io_reader_close(), the file must not be read through stdio. For
+// anything but a regular file, nothing may have been read through stdio
+// before either, since bytes stdio buffered would be skipped.
+//
+// f: the file to read.
+// chunk: the size of each chunk (at least 1).
+// depth: the number of chunks (at least 1).
+// returns: the new reader.
+//
+io_reader_t *io_reader_open(FILE *f, size_t chunk, unsigned depth);
+
+//
+// Reads up to len bytes, only returning fewer at the end of the input.
+//
+// r: the reader.
+// dst: will store the bytes.
+// len: the number of bytes wanted.
+// returns: the number of bytes read.
+//
+size_t io_read(io_reader_t *r, uint8_t *dst, size_t len);
+
+//
+// Returns the next byte without consuming it.
+//
+// r: the reader.
+// returns: the byte, or EOF at the end of the input.
+//
+int io_peek(io_reader_t *r);
+
+//
+// Reads a line including its newline, like getline().
+//
+// r: the reader.
+// line: the line buffer, grown with realloc() as needed.
+// size: the size of *line.
+// returns: the length of the line, or -1 at the end of the input.
+//
+ssize_t io_getline(io_reader_t *r, char **line, size_t *size);
+
+//
+// Waits for the reads still in flight, frees the reader and, for a regular
+// file, moves the stdio position just past the bytes that were consumed.
+// Other files lose whatever was read ahead.
+//
+// r: the reader.
+// returns: false if a read failed.
+//
+bool io_reader_close(io_reader_t *r);
+
+//
+// Starts writing a file at its current position, flushing stdio first.
+// Until io_writer_close(), the file must not be written through stdio.
+//
+// f: the file to write.
+// chunk: the size of each chunk (at least 1).
+// depth: the number of chunks (at least 1).
+// returns: the new writer.
+//
+io_writer_t *io_writer_open(FILE *f, size_t chunk, unsigned depth);
+
+//
+// Queues bytes for writing.
+//
+// w: the writer.
+// src: the bytes.
+// len: the number of bytes.
+// returns: false if a write has failed.
+//
+bool io_write(io_writer_t *w, const uint8_t *src, size_t len);
+
+//
+// Writes out everything queued, waits for it, frees the writer and, for a
+// regular file, moves the stdio position to the end of what was written.
+//
+// w: the writer.
+// returns: false if a write failed.
+//
+bool io_writer_close(io_writer_t *w);
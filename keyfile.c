@@ -0,0 +1,626 @@
+// clang-format off
+#include <stdio.h>
+#include <gmp.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keyfile.h"
+#include "mapfile.h"
+#include "montgomery.h"
+// clang-format on
+
+// a growable buffer the sections of a key file are assembled in
+typedef struct {
+  uint8_t *data;
+  size_t length;
+  size_t capacity;
+  uint32_t sections;
+} key_writer;
+
+static void *writer_reserve(key_writer *w, size_t bytes) {
+  size_t padded = (bytes + 7) & ~(size_t)7;
+  if (w->length + padded > w->capacity) {
+    w->capacity = (w->capacity * 2 > w->length + padded)
+                      ? w->capacity * 2
+                      : w->length + padded;
+    w->data = (uint8_t *)realloc(w->data, w->capacity);
+  }
+  uint8_t *p = w->data + w->length;
+  memset(p, 0, padded);
+  w->length += padded;
+  return p;
+}
+
+// appends a section header and returns room for its payload
+static void *writer_section(key_writer *w, keyfile_tag tag, uint64_t length) {
+  uint8_t *header = (uint8_t *)writer_reserve(w, 16);
+  uint32_t tag32 = tag;
+  memcpy(header, &tag32, 4);
+  memcpy(header + 8, &length, 8);
+  w->sections += 1;
+  return writer_reserve(w, length);
+}
+
+static void write_number(key_writer *w, keyfile_tag tag, mpz_t x) {
+  size_t size = mpz_size(x);
+  void *p = writer_section(w, tag, size * sizeof(mp_limb_t));
+  if (size > 0) {
+    memcpy(p, mpz_limbs_read(x), size * sizeof(mp_limb_t));
+  }
+}
+
+static void write_mont(key_writer *w, keyfile_tag tag, mpz_t n) {
+  if (!mont_supported(n)) {
+    return;
+  }
+  mont_ctx ctx;
+  mont_init(&ctx, n);
+  size_t bytes = ctx.size * sizeof(mp_limb_t);
+  uint8_t *p = (uint8_t *)writer_section(w, tag, sizeof(mp_limb_t) + 2 * bytes);
+  memcpy(p, &ctx.ninv, sizeof(mp_limb_t));
+  memcpy(p + sizeof(mp_limb_t), ctx.r2, bytes);
+  memcpy(p + sizeof(mp_limb_t) + bytes, ctx.one, bytes);
+  mont_clear(&ctx);
+}
+
+static void write_sched(key_writer *w, keyfile_tag tag, mpz_t d) {
+  if (mpz_sizeinbase(d, 2) <= MONT_SMALL_EXPONENT_BITS) {
+    return; // small exponents take mont_powm_ui(), which needs no schedule
+  }
+  mont_sched sched;
+  mont_sched_init(&sched, d);
+  uint64_t steps = sched.steps;
+  uint64_t tail = sched.tail;
+  uint8_t *p = (uint8_t *)writer_section(w, tag, 24 + 8 * steps);
+  memcpy(p, &sched.width, 4);
+  memcpy(p + 8, &steps, 8);
+  memcpy(p + 16, &tail, 8);
+  memcpy(p + 24, sched.squarings, 4 * steps);
+  memcpy(p + 24 + 4 * steps, sched.digits, 4 * steps);
+  mont_sched_clear(&sched);
+}
+
+static void writer_start(key_writer *w) {
+  w->data = NULL;
+  w->length = 0;
+  w->capacity = 0;
+  w->sections = 0;
+  writer_reserve(w, KEYFILE_HEADER_SIZE);
+}
+
+// fills in the header and writes the whole file
+static void writer_finish(key_writer *w, uint8_t kind, FILE *f) {
+  uint8_t *h = w->data;
+  uint32_t order = KEYFILE_BYTE_ORDER;
+  uint64_t size = w->length;
+  memcpy(h, KEYFILE_MAGIC, 4);
+  h[4] = KEYFILE_VERSION;
+  h[5] = kind;
+  h[6] = sizeof(mp_limb_t);
+  memcpy(h + 8, &order, 4);
+  memcpy(h + 12, &w->sections, 4);
+  memcpy(h + 16, &size, 8);
+  fwrite(w->data, 1, w->length, f);
+  free(w->data);
+}
+
+void keyfile_write_pub(mpz_t n, mpz_t e, mpz_t s, char username[],
+                       FILE *pbfile) {
+  key_writer w;
+  writer_start(&w);
+  write_number(&w, KEY_N, n);
+  write_number(&w, KEY_E, e);
+  write_number(&w, KEY_S, s);
+  size_t length = strlen(username) + 1;
+  memcpy(writer_section(&w, KEY_USER, length), username, length);
+  write_mont(&w, KEY_MONT_N, n);
+  write_sched(&w, KEY_SCHED_E, e);
+  writer_finish(&w, KEYFILE_PUB, pbfile);
+}
+
+// the sections of each prime of a private key: the prime, its CRT exponent
+// and coefficient (none for q), its Montgomery constants and the schedule
+// of its exponent
+typedef struct {
+  keyfile_tag prime, exp, coeff, mont, sched;
+} prime_sections;
+
+static const prime_sections prime_tags[KEYFILE_MAX_PRIMES] = {
+    {KEY_P, KEY_DP, KEY_QINV, KEY_MONT_P, KEY_SCHED_DP},
+    {KEY_Q, KEY_DQ, 0, KEY_MONT_Q, KEY_SCHED_DQ},
+    {KEY_P3, KEY_DP3, KEY_COEFF3, KEY_MONT_P3, KEY_SCHED_DP3},
+    {KEY_P4, KEY_DP4, KEY_COEFF4, KEY_MONT_P4, KEY_SCHED_DP4}};
+
+void keyfile_write_priv(mpz_t n, mpz_t d, mpz_t *primes, mpz_t *exps,
+                        mpz_t *coeffs, uint64_t count, FILE *pvfile) {
+  // two-prime keys come out section for section as they always did
+  key_writer w;
+  writer_start(&w);
+  write_number(&w, KEY_N, n);
+  write_number(&w, KEY_D, d);
+  for (uint64_t i = 0; i < count; i++) {
+    write_number(&w, prime_tags[i].prime, primes[i]);
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    write_number(&w, prime_tags[i].exp, exps[i]);
+  }
+  for (uint64_t i = 0; i < count; i++) {
+    if (prime_tags[i].coeff != 0) {
+      write_number(&w, prime_tags[i].coeff, coeffs[i]);
+    }
+  }
+  write_mont(&w, KEY_MONT_N, n);
+  for (uint64_t i = 0; i < count; i++) {
+    write_mont(&w, prime_tags[i].mont, primes[i]);
+  }
+  write_sched(&w, KEY_SCHED_D, d);
+  for (uint64_t i = 0; i < count; i++) {
+    write_sched(&w, prime_tags[i].sched, exps[i]);
+  }
+  writer_finish(&w, KEYFILE_PRIV, pvfile);
+}
+
+bool keyfile_detect(FILE *f) {
+  int c = getc(f);
+  if (c == EOF) {
+    return false;
+  }
+  ungetc(c, f);
+  return c == KEYFILE_MAGIC[0];
+}
+
+// the bytes of a key file, mapped or (for pipes) read into memory
+typedef struct {
+  uint8_t *data;
+  size_t length;
+  bool mapped;
+  mapped_file map;
+} key_bytes;
+
+// a key file that has been read, with a pointer to each section's payload
+typedef struct loaded_key {
+  const uint8_t *payload[KEY_TAGS]; // NULL if the section is absent
+  uint64_t length[KEY_TAGS];
+  uint8_t kind;
+  key_bytes bytes;    // what the payloads point into
+  uint64_t borrowers; // contexts and schedules still pointing into bytes
+  bool registered;    // searched by keyfile_mont() and keyfile_sched()
+  struct loaded_key *next;
+} loaded_key;
+
+// every key file that is registered or still borrowed from, guarded by
+// loaded_lock since librsa contexts may be made on any thread
+static loaded_key *loaded = NULL;
+static pthread_mutex_t loaded_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void load_bytes(key_bytes *b, FILE *f) {
+  b->mapped = map_input(&b->map, f);
+  if (b->mapped && (((uintptr_t)b->map.data % sizeof(mp_limb_t)) == 0)) {
+    b->data = b->map.data; // stays mapped, the views point into it
+    b->length = b->map.length;
+    return;
+  }
+  if (b->mapped) { // not limb aligned, copy it instead
+    unmap_input(&b->map, f, 0);
+    b->mapped = false;
+  }
+  size_t capacity = 4096;
+  b->data = (uint8_t *)malloc(capacity); // malloc aligns for limbs
+  b->length = 0;
+  size_t got;
+  while ((got = fread(b->data + b->length, 1, capacity - b->length, f)) > 0) {
+    b->length += got;
+    if (b->length == capacity) {
+      capacity *= 2;
+      b->data = (uint8_t *)realloc(b->data, capacity);
+    }
+  }
+}
+
+// releases the bytes of a key file that turned out to be invalid
+static loaded_key *reject(key_bytes *b, FILE *f) {
+  if (b->mapped) {
+    unmap_input(&b->map, f, 0);
+  } else {
+    free(b->data);
+  }
+  return NULL;
+}
+
+// frees a key file nothing points into any more, its FILE may be closed
+static void unload(loaded_key *key) {
+  if (key->bytes.mapped) {
+    release_input(&key->bytes.map);
+  } else {
+    free(key->bytes.data);
+  }
+  free(key);
+}
+
+// unlinks and frees a key file once it is neither registered nor borrowed
+// from, with loaded_lock held
+static void unload_unused(loaded_key *key) {
+  if (key->registered || (key->borrowers > 0)) {
+    return;
+  }
+  loaded_key **link = &loaded;
+  while (*link != key) {
+    link = &(*link)->next;
+  }
+  *link = key->next;
+  unload(key);
+}
+
+static uint64_t limbs_of(const loaded_key *key, keyfile_tag tag) {
+  return key->length[tag] / sizeof(mp_limb_t);
+}
+
+// points a read-only mpz at a number section
+static mpz_srcptr view(mpz_t x, const loaded_key *key, keyfile_tag tag) {
+  return mpz_roinit_n(x, (const mp_limb_t *)key->payload[tag],
+                      (mp_size_t)limbs_of(key, tag));
+}
+
+// checks that a Montgomery section fits its modulus and holds its constants:
+// n' must be -n^-1 mod 2^GMP_NUMB_BITS, and with it REDC(R mod n) = 1 and
+// REDC(R^2 mod n) = R mod n, which two reductions (far less than the
+// division mont_init() does) show for any R mod n and R^2 mod n below n
+static bool mont_valid(const loaded_key *key, keyfile_tag tag,
+                       keyfile_tag modulus) {
+  if (key->payload[tag] == NULL) {
+    return true;
+  }
+  uint64_t size = limbs_of(key, modulus);
+  if ((key->payload[modulus] == NULL) || (size == 0) ||
+      (key->length[tag] != (1 + 2 * size) * sizeof(mp_limb_t))) {
+    return false;
+  }
+  const mp_limb_t *n = (const mp_limb_t *)key->payload[modulus];
+  const mp_limb_t *limbs = (const mp_limb_t *)key->payload[tag];
+  mont_ctx ctx = {.size = (mp_size_t)size,
+                  .n = (mp_limb_t *)n,
+                  .ninv = limbs[0],
+                  .r2 = (mp_limb_t *)(limbs + 1),
+                  .one = (mp_limb_t *)(limbs + 1 + size),
+                  .borrowed = true};
+  if ((n[size - 1] == 0) || ((n[0] & 1) == 0) ||
+      ((mp_limb_t)(n[0] * ctx.ninv) != (mp_limb_t)-1) ||
+      (mpn_cmp(ctx.r2, n, size) >= 0) || (mpn_cmp(ctx.one, n, size) >= 0)) {
+    return false;
+  }
+
+  mp_limb_t *t = (mp_limb_t *)malloc(
+      (3 * size + mont_scratch_size(&ctx)) * sizeof(mp_limb_t));
+  mp_limb_t *r = t + 2 * size;
+  mp_limb_t *scratch = r + size;
+  mpn_copyi(t, ctx.one, size);
+  mpn_zero(t + size, size);
+  mont_redc(&ctx, r, t, scratch);
+  bool valid = (r[0] == 1) && ((size == 1) || mpn_zero_p(r + 1, size - 1));
+  mpn_copyi(t, ctx.r2, size);
+  mpn_zero(t + size, size);
+  mont_redc(&ctx, r, t, scratch);
+  valid = valid && (mpn_cmp(r, ctx.one, size) == 0);
+  free(t);
+  return valid;
+}
+
+// checks that a schedule section really recodes its exponent: every window
+// digit is odd and fits the window width, and the windows add back up to the
+// exponent (a few shifts per window, far less than one exponentiation)
+static bool sched_valid(const loaded_key *key, keyfile_tag tag,
+                        keyfile_tag exponent) {
+  const uint8_t *p = key->payload[tag];
+  if (p == NULL) {
+    return true;
+  }
+  if ((key->payload[exponent] == NULL) || (key->length[tag] < 24)) {
+    return false;
+  }
+  uint32_t width;
+  uint64_t steps, tail;
+  memcpy(&width, p, 4);
+  memcpy(&steps, p + 8, 8);
+  memcpy(&tail, p + 16, 8);
+  if ((width == 0) || (width > MONT_MAX_WIDTH) || (steps == 0) ||
+      (steps > (key->length[tag] - 24) / 8) ||
+      (key->length[tag] != 24 + 8 * steps)) {
+    return false;
+  }
+  const uint32_t *squarings = (const uint32_t *)(p + 24);
+  const uint32_t *digits = (const uint32_t *)(p + 24 + 4 * steps);
+  // the shifts can never add up to more bits than the exponent has
+  uint64_t bits = 8 * key->length[exponent];
+  uint64_t shifted = tail;
+  for (uint64_t i = 0; i < steps; i++) {
+    shifted += (i > 0) ? squarings[i] : 0;
+    if (((digits[i] & 1) == 0) || (digits[i] >= ((uint32_t)1 << width)) ||
+        (shifted > bits)) {
+      return false;
+    }
+  }
+
+  mpz_t d;
+  mpz_init2(d, bits);
+  mpz_set_ui(d, digits[0]);
+  for (uint64_t i = 1; i < steps; i++) {
+    mpz_mul_2exp(d, d, squarings[i]);
+    mpz_add_ui(d, d, digits[i]);
+  }
+  mpz_mul_2exp(d, d, tail);
+  mpz_t v;
+  bool valid = (mpz_cmp(d, view(v, key, exponent)) == 0);
+  mpz_clear(d);
+  return valid;
+}
+
+// maps and validates a key file of the given kind, not yet registered
+static loaded_key *load(FILE *f, uint8_t kind) {
+  key_bytes b;
+  load_bytes(&b, f);
+  const uint8_t *data = b.data;
+  size_t length = b.length;
+  uint32_t order, sections;
+  uint64_t size;
+  if (length < KEYFILE_HEADER_SIZE) {
+    return reject(&b, f);
+  }
+  memcpy(&order, data + 8, 4);
+  memcpy(&sections, data + 12, 4);
+  memcpy(&size, data + 16, 8);
+  if ((memcmp(data, KEYFILE_MAGIC, 4) != 0) || (data[4] != KEYFILE_VERSION) ||
+      (data[5] != kind) || (data[6] != sizeof(mp_limb_t)) ||
+      (order != KEYFILE_BYTE_ORDER) || (size != length)) {
+    return reject(&b, f);
+  }
+
+  loaded_key key;
+  memset(&key, 0, sizeof(key));
+  key.kind = kind;
+  size_t offset = KEYFILE_HEADER_SIZE;
+  for (uint32_t i = 0; i < sections; i++) {
+    uint32_t tag;
+    uint64_t bytes;
+    if (length - offset < 16) {
+      return reject(&b, f);
+    }
+    memcpy(&tag, data + offset, 4);
+    memcpy(&bytes, data + offset + 8, 8);
+    offset += 16;
+    uint64_t padded = (bytes + 7) & ~(uint64_t)7;
+    if ((tag == 0) || (tag >= KEY_TAGS) || (padded < bytes) ||
+        (padded > length - offset)) {
+      return reject(&b, f);
+    }
+    key.payload[tag] = data + offset;
+    key.length[tag] = bytes;
+    offset += padded;
+  }
+
+  // the numbers every key of this kind has, and the layout of the rest
+  static const keyfile_tag numbers[] = {
+      KEY_N,  KEY_E,    KEY_S,  KEY_D,  KEY_P,   KEY_Q,   KEY_DP,
+      KEY_DQ, KEY_QINV, KEY_P3, KEY_P4, KEY_DP3, KEY_DP4, KEY_COEFF3,
+      KEY_COEFF4};
+  for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+    if ((key.length[numbers[i]] % sizeof(mp_limb_t)) != 0) {
+      return reject(&b, f);
+    }
+  }
+  bool complete = (kind == KEYFILE_PUB)
+                      ? ((key.payload[KEY_N] != NULL) &&
+                         (key.payload[KEY_E] != NULL) &&
+                         (key.payload[KEY_S] != NULL) &&
+                         (key.payload[KEY_USER] != NULL) &&
+                         (memchr(key.payload[KEY_USER], '\0',
+                                 (key.length[KEY_USER] < KEYFILE_USERNAME_MAX)
+                                     ? key.length[KEY_USER]
+                                     : KEYFILE_USERNAME_MAX) != NULL))
+                      : ((key.payload[KEY_N] != NULL) &&
+                         (key.payload[KEY_D] != NULL));
+  if (!complete || !mont_valid(&key, KEY_MONT_N, KEY_N) ||
+      !sched_valid(&key, KEY_SCHED_E, KEY_E) ||
+      !sched_valid(&key, KEY_SCHED_D, KEY_D)) {
+    return reject(&b, f);
+  }
+  for (size_t i = 0; i < KEYFILE_MAX_PRIMES; i++) {
+    if (!mont_valid(&key, prime_tags[i].mont, prime_tags[i].prime) ||
+        !sched_valid(&key, prime_tags[i].sched, prime_tags[i].exp)) {
+      return reject(&b, f);
+    }
+  }
+
+  loaded_key *kept = (loaded_key *)malloc(sizeof(loaded_key));
+  *kept = key;
+  kept->bytes = b;
+  kept->borrowers = 0;
+  kept->registered = false;
+  kept->next = NULL;
+  return kept;
+}
+
+// makes a loaded key file visible to keyfile_mont() and keyfile_sched()
+static void publish(loaded_key *key) {
+  pthread_mutex_lock(&loaded_lock);
+  key->registered = true;
+  key->next = loaded;
+  loaded = key;
+  pthread_mutex_unlock(&loaded_lock);
+}
+
+// copies a number section into x, if x is wanted
+static void read_number(mpz_t x, const loaded_key *key, keyfile_tag tag) {
+  if (x != NULL) {
+    mpz_t v;
+    mpz_set(x, view(v, key, tag));
+  }
+}
+
+bool keyfile_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[],
+                      FILE *pbfile) {
+  loaded_key *key = load(pbfile, KEYFILE_PUB);
+  if (key == NULL) {
+    return false;
+  }
+  read_number(n, key, KEY_N);
+  read_number(e, key, KEY_E);
+  read_number(s, key, KEY_S);
+  strcpy(username, (const char *)key->payload[KEY_USER]);
+  publish(key);
+  return true;
+}
+
+bool keyfile_read_priv(mpz_t n, mpz_t d, mpz_t *primes, mpz_t *exps,
+                       mpz_t *coeffs, uint64_t *count, FILE *pvfile) {
+  loaded_key *key = load(pvfile, KEYFILE_PRIV);
+  if (key == NULL) {
+    return false;
+  }
+  read_number(n, key, KEY_N);
+  read_number(d, key, KEY_D);
+
+  // the primes run from p up to the first one missing
+  uint64_t found = 0;
+  while ((found < KEYFILE_MAX_PRIMES) &&
+         (key->payload[prime_tags[found].prime] != NULL)) {
+    found += 1;
+  }
+  for (uint64_t i = 0; (primes != NULL) && (i < found); i++) {
+    read_number(primes[i], key, prime_tags[i].prime);
+    read_number(exps[i], key, prime_tags[i].exp);
+    if (prime_tags[i].coeff != 0) {
+      read_number(coeffs[i], key, prime_tags[i].coeff);
+    } else {
+      mpz_set_ui(coeffs[i], 0);
+    }
+  }
+  if (count != NULL) {
+    *count = found;
+  }
+  publish(key);
+  return true;
+}
+
+// the modulus each Montgomery section belongs to
+static const keyfile_tag mont_tags[][2] = {
+    {KEY_MONT_N, KEY_N},   {KEY_MONT_P, KEY_P},   {KEY_MONT_Q, KEY_Q},
+    {KEY_MONT_P3, KEY_P3}, {KEY_MONT_P4, KEY_P4}};
+
+bool keyfile_mont(mont_ctx *ctx, mpz_t n) {
+  pthread_mutex_lock(&loaded_lock);
+  for (loaded_key *key = loaded; key != NULL; key = key->next) {
+    for (size_t i = 0; i < sizeof(mont_tags) / sizeof(mont_tags[0]); i++) {
+      keyfile_tag tag = mont_tags[i][0];
+      keyfile_tag modulus = mont_tags[i][1];
+      mpz_t v;
+      if ((key->payload[tag] == NULL) ||
+          (mpz_cmp(view(v, key, modulus), n) != 0)) {
+        continue;
+      }
+      mp_size_t size = limbs_of(key, modulus);
+      const mp_limb_t *limbs = (const mp_limb_t *)key->payload[tag];
+      ctx->size = size;
+      ctx->n = (mp_limb_t *)key->payload[modulus];
+      ctx->ninv = limbs[0];
+      ctx->r2 = (mp_limb_t *)(limbs + 1);
+      ctx->one = (mp_limb_t *)(limbs + 1 + size);
+      ctx->borrowed = true;
+      key->borrowers += 1;
+      pthread_mutex_unlock(&loaded_lock);
+      return true;
+    }
+  }
+  pthread_mutex_unlock(&loaded_lock);
+  return false;
+}
+
+// the exponent each schedule section belongs to
+static const keyfile_tag sched_tags[][2] = {{KEY_SCHED_E, KEY_E},
+                                            {KEY_SCHED_D, KEY_D},
+                                            {KEY_SCHED_DP, KEY_DP},
+                                            {KEY_SCHED_DQ, KEY_DQ},
+                                            {KEY_SCHED_DP3, KEY_DP3},
+                                            {KEY_SCHED_DP4, KEY_DP4}};
+
+bool keyfile_sched(mont_sched *sched, mpz_t d) {
+  pthread_mutex_lock(&loaded_lock);
+  for (loaded_key *key = loaded; key != NULL; key = key->next) {
+    for (size_t i = 0; i < sizeof(sched_tags) / sizeof(sched_tags[0]);
+         i++) {
+      keyfile_tag tag = sched_tags[i][0];
+      keyfile_tag exponent = sched_tags[i][1];
+      mpz_t v;
+      if ((key->payload[tag] == NULL) || (key->payload[exponent] == NULL) ||
+          (mpz_cmp(view(v, key, exponent), d) != 0)) {
+        continue;
+      }
+      const uint8_t *p = key->payload[tag];
+      uint64_t steps, tail;
+      memcpy(&sched->width, p, 4);
+      memcpy(&steps, p + 8, 8);
+      memcpy(&tail, p + 16, 8);
+      sched->steps = steps;
+      sched->tail = tail;
+      sched->squarings = (uint32_t *)(p + 24);
+      sched->digits = (uint32_t *)(p + 24 + 4 * steps);
+      sched->capacity = 0;
+      sched->borrowed = true;
+      key->borrowers += 1;
+      pthread_mutex_unlock(&loaded_lock);
+      return true;
+    }
+  }
+  pthread_mutex_unlock(&loaded_lock);
+  return false;
+}
+
+// hands back a borrow of the key file whose bytes hold p
+static void release(const void *p) {
+  const uint8_t *at = (const uint8_t *)p;
+  pthread_mutex_lock(&loaded_lock);
+  for (loaded_key *key = loaded; key != NULL; key = key->next) {
+    if ((at >= key->bytes.data) && (at < key->bytes.data + key->bytes.length)) {
+      key->borrowers -= 1;
+      unload_unused(key);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&loaded_lock);
+}
+
+void keyfile_release_mont(mont_ctx *ctx) {
+  if (!ctx->borrowed) {
+    return;
+  }
+  release(ctx->n);
+  ctx->n = ctx->r2 = ctx->one = NULL;
+  ctx->borrowed = false;
+}
+
+void keyfile_release_sched(mont_sched *sched) {
+  if (!sched->borrowed) {
+    return;
+  }
+  release(sched->squarings);
+  sched->squarings = NULL;
+  sched->digits = NULL;
+  sched->borrowed = false;
+}
+
+void keyfile_unregister(mpz_t n) {
+  pthread_mutex_lock(&loaded_lock);
+  loaded_key *key = loaded;
+  while (key != NULL) {
+    loaded_key *next = key->next;
+    mpz_t v;
+    if (key->registered && (mpz_cmp(view(v, key, KEY_N), n) == 0)) {
+      key->registered = false;
+      unload_unused(key);
+    }
+    key = next;
+  }
+  pthread_mutex_unlock(&loaded_lock);
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "montgomery.h"
+
+//
+// Binary key files (keygen -B).
+// Besides the raw limbs of the key, a binary key file stores what readers
+// would otherwise recompute from it on every run: the Montgomery constants
+// of each modulus and the sliding-window schedule of each large exponent.
+// Loading one maps the file and points mpz views, Montgomery contexts and
+// schedules straight into the mapping, with nothing to parse or compute.
+// Everything is in the byte order and limb size of the machine that wrote
+// it; other machines reject the file and need the hex key files.
+//
+// Header layout (native byte order):
+//   magic       4 bytes  "RSAK"
+//   version     1 byte
+//   kind        1 byte   KEYFILE_PUB or KEYFILE_PRIV
+//   limb_bytes  1 byte   sizeof(mp_limb_t)
+//   reserved    1 byte   zero
+//   byte_order  4 bytes  KEYFILE_BYTE_ORDER
+//   sections    4 bytes  number of sections after the header
+//   size        8 bytes  size of the whole file
+//   reserved    8 bytes  zero
+//
+// Each section is a tag (4 bytes), 4 reserved bytes and the length of its
+// payload (8 bytes), followed by the payload padded to a multiple of 8.
+//   numbers:   the limbs of the value, least significant first
+//   username:  the NUL-terminated username
+//   mont:      n' (one limb), R^2 mod n and R mod n (size limbs each)
+//   schedules: width (4), reserved (4), steps (8), tail (8), then steps
+//              squarings and steps digits (4 bytes each)
+//
+
+#define KEYFILE_MAGIC "RSAK"
+#define KEYFILE_VERSION 1
+#define KEYFILE_HEADER_SIZE 32
+#define KEYFILE_BYTE_ORDER 0x01020304u
+
+// the most primes a private key file holds, the same as RSA_MAX_PRIMES
+#define KEYFILE_MAX_PRIMES 4
+
+#define KEYFILE_PUB 1
+#define KEYFILE_PRIV 2
+
+// the size of the username buffer readers pass in, NUL included
+#define KEYFILE_USERNAME_MAX 4096
+
+typedef enum {
+  KEY_N = 1,
+  KEY_E,
+  KEY_S,
+  KEY_USER,
+  KEY_D,
+  KEY_P,
+  KEY_Q,
+  KEY_DP,
+  KEY_DQ,
+  KEY_QINV,
+  KEY_MONT_N, // Montgomery constants of n, p and q
+  KEY_MONT_P,
+  KEY_MONT_Q,
+  KEY_SCHED_E, // window schedules of e, d, dp and dq
+  KEY_SCHED_D,
+  KEY_SCHED_DP,
+  KEY_SCHED_DQ,
+  KEY_P3, // the third and fourth primes of multi-prime keys (keygen -P)
+  KEY_P4,
+  KEY_DP3, // and their exponents, coefficients, constants and schedules
+  KEY_DP4,
+  KEY_COEFF3,
+  KEY_COEFF4,
+  KEY_MONT_P3,
+  KEY_MONT_P4,
+  KEY_SCHED_DP3,
+  KEY_SCHED_DP4,
+  KEY_TAGS
+} keyfile_tag;
+
+//
+// Checks whether a key file is binary, without consuming any of it.
+// Hex key files start with a hex digit, binary ones with the magic.
+//
+// f: the key file, at its start.
+//
+bool keyfile_detect(FILE *f);
+
+//
+// Writes a binary public key file.
+// All mpz_t arguments are expected to be initialized.
+//
+// n, e: the public modulus and exponent.
+// s: the signature of the username.
+// username: the username.
+// pbfile: the file to write to.
+//
+void keyfile_write_pub(mpz_t n, mpz_t e, mpz_t s, char username[],
+                       FILE *pbfile);
+
+//
+// Writes a binary private key file with its CRT components.
+// All mpz_t arguments are expected to be initialized.
+//
+// n, d: the public modulus and the private exponent.
+// primes, exps, coeffs: the primes of n and their CRT components, laid out
+//                       as rsa_make_crt_primes() computes them.
+// count: the number of primes, 2 to KEYFILE_MAX_PRIMES.
+// pvfile: the file to write to.
+//
+void keyfile_write_priv(mpz_t n, mpz_t d, mpz_t *primes, mpz_t *exps,
+                        mpz_t *coeffs, uint64_t count, FILE *pvfile);
+
+//
+// Reads a binary public key file.
+// The file stays mapped, and its Montgomery constants and schedules
+// registered for keyfile_mont() and keyfile_sched(), until
+// keyfile_unregister() and the release of everything borrowed from it.
+// All mpz_t arguments are expected to be initialized.
+//
+// n, e, s: will store the modulus, exponent and signature.
+// username: will store the username, KEYFILE_USERNAME_MAX bytes.
+// pbfile: the file to read, at its start.
+// returns: false if the file is not a valid binary public key.
+//
+bool keyfile_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[],
+                      FILE *pbfile);
+
+//
+// Reads a binary private key file, registering it like keyfile_read_pub().
+// All mpz_t arguments are expected to be initialized; the CRT components
+// may be NULL when they are not wanted.
+//
+// n, d: will store the modulus and private exponent.
+// primes, exps, coeffs: will store the primes and CRT components,
+//                       KEYFILE_MAX_PRIMES entries each.
+// count: will store the number of primes, 0 if the file has none.
+// pvfile: the file to read, at its start.
+// returns: false if the file is not a valid binary private key.
+//
+bool keyfile_read_priv(mpz_t n, mpz_t d, mpz_t *primes, mpz_t *exps,
+                       mpz_t *coeffs, uint64_t *count, FILE *pvfile);
+
+//
+// Looks up the stored Montgomery constants of a modulus among the binary
+// key files that are registered. Only call it once the keys have been read.
+// The key file stays mapped until the context is handed back with
+// keyfile_release_mont(). Safe to call from any thread.
+//
+// ctx: will store a borrowed context for n.
+// n: the modulus.
+// returns: false if no key file holds constants for n.
+//
+bool keyfile_mont(mont_ctx *ctx, mpz_t n);
+
+//
+// Looks up the stored window schedule of an exponent, like keyfile_mont().
+//
+// sched: will store a borrowed schedule for d.
+// d: the exponent.
+// returns: false if no key file holds a schedule for d.
+//
+bool keyfile_sched(mont_sched *sched, mpz_t d);
+
+//
+// Hands back a context borrowed with keyfile_mont(), which is cleared.
+// Does nothing to a context that is not borrowed.
+//
+// ctx: the context.
+//
+void keyfile_release_mont(mont_ctx *ctx);
+
+//
+// Hands back a schedule borrowed with keyfile_sched(), which is cleared.
+// Does nothing to a schedule that is not borrowed.
+//
+// sched: the schedule.
+//
+void keyfile_release_sched(mont_sched *sched);
+
+//
+// Stops keyfile_mont() and keyfile_sched() from finding the key files read
+// for a modulus. Each one is unmapped once nothing borrows from it.
+//
+// n: the modulus of the keys.
+//
+void keyfile_unregister(mpz_t n);
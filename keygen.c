@@ -2,9 +2,12 @@
 // clang-format off
 #include <stdio.h>
 #include <assert.h>
+#include <errno.h>
 #include <gmp.h>
 #include <inttypes.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,13 +15,297 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "keyfile.h"
 #include "numtheory.h"
+#include "pool.h"
 #include "randstate.h"
 #include "rsa.h"
+#include "stats.h"
 
 // clang-format on
 
-gmp_randstate_t state;
+// the components of one key pair
+typedef struct {
+  mpz_t e, n, d;
+  mpz_t primes[RSA_MAX_PRIMES]; // p and q, then any further primes (-P)
+  mpz_t exps[RSA_MAX_PRIMES];   // CRT components stored alongside d
+  mpz_t coeffs[RSA_MAX_PRIMES];
+  uint64_t count; // number of primes
+  mpz_t s;        // signature of the username
+} keypair;
+
+static void keypair_init(keypair *key, uint64_t count) {
+  mpz_inits(key->e, key->n, key->d, key->s, NULL);
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_inits(key->primes[i], key->exps[i], key->coeffs[i], NULL);
+  }
+  key->count = count;
+}
+
+static void keypair_clear(keypair *key) {
+  mpz_clears(key->e, key->n, key->d, key->s, NULL);
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_clears(key->primes[i], key->exps[i], key->coeffs[i], NULL);
+  }
+}
+
+// makes a key pair from the calling thread's random state and signs the
+// username with it, fixed_e of 0 means a random public exponent
+// two primes keep the original uneven split of nbits between p and q,
+// more are balanced
+static void make_keypair(keypair *key, uint64_t nbits, uint64_t iters,
+                         uint64_t fixed_e, mpz_t mpz_username) {
+  mpz_ptr p = key->primes[0];
+  mpz_ptr q = key->primes[1];
+  if (fixed_e != 0) {
+    mpz_set_ui(key->e, fixed_e);
+  }
+  if (key->count > 2) {
+    if (fixed_e != 0) {
+      rsa_make_pub_primes_fixed(key->primes, key->count, key->n, key->e,
+                                nbits, iters);
+    } else {
+      rsa_make_pub_primes(key->primes, key->count, key->n, key->e, nbits,
+                          iters);
+    }
+    rsa_make_priv_primes(key->d, key->e, key->primes, key->count);
+  } else {
+    if (fixed_e != 0) {
+      rsa_make_pub_fixed(p, q, key->n, key->e, nbits, iters);
+    } else {
+      rsa_make_pub(p, q, key->n, key->e, nbits, iters);
+    }
+    rsa_make_priv(key->d, key->e, p, q);
+  }
+  rsa_make_crt_primes(key->exps, key->coeffs, key->d, key->primes,
+                      key->count);
+  rsa_sign(key->s, mpz_username, key->d, key->n);
+}
+
+// binary writes the keygen -B files, with the per-modulus constants
+static void write_keypair(keypair *key, char *username, FILE *pb_file,
+                          FILE *pv_file, bool binary) {
+  if (binary) {
+    keyfile_write_pub(key->n, key->e, key->s, username, pb_file);
+    keyfile_write_priv(key->n, key->d, key->primes, key->exps, key->coeffs,
+                       key->count, pv_file);
+    return;
+  }
+  rsa_write_pub(key->n, key->e, key->s, username, pb_file);
+  rsa_write_priv_primes(key->n, key->d, key->primes, key->exps, key->coeffs,
+                        key->count, pv_file);
+}
+
+// state shared by the workers of a batch run (keygen -c)
+typedef struct {
+  const char *dir;
+  uint64_t count;
+  uint64_t seed; // master seed, every key derives its own from it
+  uint64_t nbits, iters, fixed_e;
+  uint64_t primes; // primes per modulus
+  bool binary;     // write binary key files
+  char *username;
+  mpz_ptr mpz_username;
+  double *latency;           // seconds taken by each key, -1 if it failed
+  atomic_uint_fast64_t done;   // keys finished, written or failed
+  atomic_uint_fast64_t failed; // keys whose files couldn't be opened
+} key_batch;
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+// the seed of key index, a splitmix64 step from the master seed so keys are
+// independent of each other and of the number of threads
+static uint64_t key_seed(uint64_t seed, uint64_t index) {
+  uint64_t z = seed + ((index + 1) * 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// counts a finished key and prints the progress every 5% of the batch
+static void batch_progress(key_batch *batch) {
+  uint64_t done = atomic_fetch_add(&batch->done, 1) + 1;
+  if ((done * 20 / batch->count) != ((done - 1) * 20 / batch->count)) {
+    fprintf(stderr, "finished %lu/%lu keys\n", done, batch->count);
+  }
+}
+
+static void batch_task(void *arg, uint64_t index, uint64_t worker) {
+  (void)worker;
+  key_batch *batch = (key_batch *)arg;
+  double start = now();
+
+  char pb_name[4096];
+  char pv_name[4096];
+  snprintf(pb_name, sizeof(pb_name), "%s/rsa%lu.pub", batch->dir, index);
+  snprintf(pv_name, sizeof(pv_name), "%s/rsa%lu.priv", batch->dir, index);
+  FILE *pb_file = fopen(pb_name, "w");
+  FILE *pv_file = fopen(pv_name, "w");
+  if ((pb_file == NULL) || (pv_file == NULL)) {
+    fprintf(stderr, "Couldn't open key files for key %lu in %s.\n", index,
+            batch->dir);
+    if (pb_file != NULL) {
+      fclose(pb_file);
+    }
+    if (pv_file != NULL) {
+      fclose(pv_file);
+    }
+    batch->latency[index] = -1;
+    atomic_fetch_add(&batch->failed, 1);
+    batch_progress(batch);
+    return;
+  }
+  fchmod(fileno(pv_file), 0600);
+
+  // the random state is per thread, so every key draws from its own seed
+  randstate_init(key_seed(batch->seed, index));
+  keypair key;
+  keypair_init(&key, batch->primes);
+  make_keypair(&key, batch->nbits, batch->iters, batch->fixed_e,
+               batch->mpz_username);
+  write_keypair(&key, batch->username, pb_file, pv_file, batch->binary);
+  keypair_clear(&key);
+  randstate_clear();
+  fclose(pb_file);
+  fclose(pv_file);
+
+  batch->latency[index] = now() - start;
+  batch_progress(batch);
+}
+
+static void print_prime_stats(void) {
+  prime_stats stats;
+  prime_stats_get(&stats);
+  fprintf(stderr, "prime candidates tested: %lu\n", stats.tested);
+  fprintf(stderr, "  rejected by sieve: %lu (%.1f%%)\n", stats.sieved,
+          (stats.tested > 0) ? (100.0 * stats.sieved) / stats.tested : 0.0);
+  fprintf(stderr, "  rejected by miller-rabin: %lu\n", stats.rejected);
+  fprintf(stderr, "  accepted as prime: %lu\n", stats.passed);
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// generates count key pairs into dir on threads threads and prints a
+// throughput and latency summary, returns the exit code
+static int make_batch(const char *dir, uint64_t count, uint64_t threads,
+                      uint64_t seed, uint64_t nbits, uint64_t iters,
+                      uint64_t fixed_e, uint64_t primes, bool binary,
+                      char *username, mpz_t mpz_username) {
+  if ((mkdir(dir, 0700) != 0) && (errno != EEXIST)) {
+    fprintf(stderr, "Couldn't create directory %s.\n", dir);
+    return 1;
+  }
+
+  key_batch batch = {
+      .dir = dir,
+      .count = count,
+      .seed = seed,
+      .nbits = nbits,
+      .iters = iters,
+      .fixed_e = fixed_e,
+      .primes = primes,
+      .binary = binary,
+      .username = username,
+      .mpz_username = mpz_username,
+      .latency = (double *)calloc(count, sizeof(double)),
+  };
+  atomic_init(&batch.done, 0);
+  atomic_init(&batch.failed, 0);
+  pool_t *pool = pool_create(threads);
+  if ((batch.latency == NULL) || (pool == NULL)) {
+    fprintf(stderr, "No more memory!\n");
+    free(batch.latency);
+    return 1;
+  }
+
+  double start = now();
+  pool_run(pool, batch_task, &batch, count);
+  double elapsed = now() - start;
+  pool_delete(pool);
+
+  // the latency stats cover the keys that were written, failed ones took
+  // no time worth measuring
+  uint64_t made = 0;
+  double total = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    if (batch.latency[i] >= 0) {
+      total += batch.latency[i];
+      batch.latency[made++] = batch.latency[i];
+    }
+  }
+  uint64_t failed = atomic_load(&batch.failed);
+  fprintf(stderr, "generated %lu keys in %.3f s (%.1f keys/sec)\n", made,
+          elapsed, made / elapsed);
+  if (failed > 0) {
+    fprintf(stderr, "%lu keys failed\n", failed);
+  }
+  if (made > 0) {
+    qsort(batch.latency, made, sizeof(double), compare_double);
+    fprintf(stderr,
+            "latency: mean %.1f ms, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, "
+            "max %.1f ms\n",
+            1e3 * total / made, 1e3 * batch.latency[(made - 1) / 2],
+            1e3 * batch.latency[(made - 1) * 90 / 100],
+            1e3 * batch.latency[(made - 1) * 99 / 100],
+            1e3 * batch.latency[made - 1]);
+  }
+
+  free(batch.latency);
+  return (failed > 0) ? 1 : 0;
+}
+
+// prints the program synopsis and usage
+static void usage(void) {
+  fprintf(stderr, "Usage: ./keygen [options]\n");
+  fprintf(stderr, "  ./keygen generates a public / private key pair, "
+                  "placing the keys into the public and private\n");
+  fprintf(stderr, "  key files as specified below. The keys have a modulus "
+                  "(n) whose length is specified in\n");
+  fprintf(stderr, "  the program options.\n");
+  fprintf(stderr, "    -s <seed>   : Use <seed> as the random number seed. "
+                  "Default: time()\n");
+  fprintf(stderr, "    -b <bits>   : Public modulus n must have at least "
+                  "<bits> bits. Default: 1024\n");
+  fprintf(stderr, "    -i <iters>  : Run <iters> Miller-Rabin iterations "
+                  "for primality testing. Default: 50\n");
+  fprintf(stderr,
+          "    -n <pbfile> : Public key file is <pbfile>. Default: rsa.pub\n");
+  fprintf(stderr, "    -d <pvfile> : Private key file is <pvfile>. "
+                  "Default: rsa.priv\n");
+  fprintf(stderr, "    -E          : Use a small fixed public exponent "
+                  "(65537) instead of a random one.\n");
+  fprintf(stderr, "    -e <exp>    : Use <exp> as the fixed public exponent "
+                  "(implies -E).\n");
+  fprintf(stderr, "    -t <threads>: Search for p and q in parallel on "
+                  "<threads> threads.\n");
+  fprintf(stderr, "    -P <primes> : Make n the product of <primes> "
+                  "balanced primes (2-4), for faster\n");
+  fprintf(stderr, "                  key generation and CRT decryption. "
+                  "Default: 2\n");
+  fprintf(stderr, "    -c <count>  : Generate <count> key pairs into "
+                  "<dir>/rsa<i>.pub and <dir>/rsa<i>.priv.\n");
+  fprintf(stderr, "    -D <dir>    : Directory for the keys of -c, created "
+                  "if needed. Default: .\n");
+  fprintf(stderr, "    -B          : Write binary key files with "
+                  "precomputed Montgomery constants\n");
+  fprintf(stderr, "                  and exponent schedules, for faster "
+                  "loading.\n");
+  fprintf(stderr, "    -A <backend>: Arithmetic backend: reference, gmp, "
+                  "fast, or <a>,<b> to\n");
+  fprintf(stderr, "                  cross-check a against b. Default: "
+                  "$NUMTHEORY_BACKEND or fast.\n");
+  fprintf(stderr, "    -v          : Enable verbose output, with "
+                  "hot-path stats as JSON.\n");
+  fprintf(stderr, "    -h          : Display program synopsis and usage.\n");
+}
 
 int main(int argc, char **argv) { // allows compiled file to get command line
                                   // args (usually its void)
@@ -54,8 +341,30 @@ int main(int argc, char **argv) { // allows compiled file to get command line
   uint64_t seed = time(NULL);
   int verbose = 0;
 
+  // fixed public exponent mode, 0 means a random e as before
+  uint64_t fixed_e = 0;
+
+  // threads for the prime search (or for the keys of a batch), 0 keeps the
+  // original serial search
+  uint64_t threads = 0;
+
+  // batch mode, 0 means a single key pair
+  uint64_t count = 0;
+  char *batch_dir = (char *)(calloc(sizeof(char), 4096));
+  if (batch_dir == NULL) {
+    fprintf(stderr, "No more memory!\n");
+    return 1;
+  }
+  strcpy(batch_dir, ".");
+
+  // binary key files (-B) instead of hex
+  bool binary = false;
+
+  // primes per modulus (-P), 2 keeps the original p and q
+  uint64_t primes = 2;
+
   // while loop to read getopt command line args
-  while ((opt = getopt(argc, argv, "b:i:n:d:s:vh")) != -1) {
+  while ((opt = getopt(argc, argv, "b:i:n:d:s:Ee:t:P:c:D:BA:vh")) != -1) {
     switch (opt) {
     case 'b': // specifies bits
       nbits = strtoul(optarg, NULL, 10);
@@ -63,28 +372,11 @@ int main(int argc, char **argv) { // allows compiled file to get command line
           (nbits < 50)) { // if nbits are not in range, print help message and
                           // return non-zero exit code
         fprintf(stderr, "Number of bits must be 50-4096, not %lu.\n", nbits);
-        fprintf(stderr, "Usage: ./keygen [options]\n");
-        fprintf(stderr, "  ./keygen generates a public / private key pair, "
-                        "placing the keys into the public and private\n");
-        fprintf(stderr, "  key files as specified below. The keys have a "
-                        "modulus (n) whose length is specified in\n");
-        fprintf(stderr, "  the program options.\n");
-        fprintf(stderr, "    -s <seed>   : Use <seed> as the random number "
-                        "seed. Default: time()\n");
-        fprintf(stderr, "    -b <bits>   : Public modulus n must have at least "
-                        "<bits> bits. Default: 1024\n");
-        fprintf(stderr, "    -i <iters>  : Run <iters> Miller-Rabin iterations "
-                        "for primality testing. Default: 50\n");
-        fprintf(stderr, "    -n <pbfile> : Public key file is <pbfile>. "
-                        "Default: rsa.pub\n");
-        fprintf(stderr, "    -d <pvfile> : Private key file is <pvfile>. "
-                        "Default: rsa.priv\n");
-        fprintf(stderr, "    -v          : Enable verbose output.\n");
-        fprintf(stderr,
-                "    -h          : Display program synopsis and usage.\n");
+        usage();
 
         free(pb_file_name);
         free(pv_file_name);
+        free(batch_dir);
         return 1;
       }
 
@@ -96,28 +388,11 @@ int main(int argc, char **argv) { // allows compiled file to get command line
           (iters < 1)) { // if iters are not in range, print help message and
                          // return non-zero exit code
         fprintf(stderr, "Number of bits must be 50-4096, not %lu.\n", nbits);
-        fprintf(stderr, "Usage: ./keygen [options]\n");
-        fprintf(stderr, "  ./keygen generates a public / private key pair, "
-                        "placing the keys into the public and private\n");
-        fprintf(stderr, "  key files as specified below. The keys have a "
-                        "modulus (n) whose length is specified in\n");
-        fprintf(stderr, "  the program options.\n");
-        fprintf(stderr, "    -s <seed>   : Use <seed> as the random number "
-                        "seed. Default: time()\n");
-        fprintf(stderr, "    -b <bits>   : Public modulus n must have at least "
-                        "<bits> bits. Default: 1024\n");
-        fprintf(stderr, "    -i <iters>  : Run <iters> Miller-Rabin iterations "
-                        "for primality testing. Default: 50\n");
-        fprintf(stderr, "    -n <pbfile> : Public key file is <pbfile>. "
-                        "Default: rsa.pub\n");
-        fprintf(stderr, "    -d <pvfile> : Private key file is <pvfile>. "
-                        "Default: rsa.priv\n");
-        fprintf(stderr, "    -v          : Enable verbose output.\n");
-        fprintf(stderr,
-                "    -h          : Display program synopsis and usage.\n");
+        usage();
 
         free(pb_file_name);
         free(pv_file_name);
+        free(batch_dir);
         return 1;
       }
       break;
@@ -136,81 +411,154 @@ int main(int argc, char **argv) { // allows compiled file to get command line
       seed = strtoul(optarg, NULL, 10);
       break;
 
+    case 'E': // fixed small public exponent
+      if (fixed_e == 0) {
+        fixed_e = 65537;
+      }
+      break;
+
+    case 'e': // fixed public exponent value
+      fixed_e = strtoul(optarg, NULL, 10);
+      if ((fixed_e < 3) || ((fixed_e % 2) == 0)) {
+        fprintf(stderr, "Public exponent must be odd and at least 3, not %s.\n",
+                optarg);
+        usage();
+
+        free(pb_file_name);
+        free(pv_file_name);
+        free(batch_dir);
+        return 1;
+      }
+      break;
+
+    case 't': // number of prime search threads
+      threads = strtoul(optarg, NULL, 10);
+      if ((threads < 1) || (threads > 1024)) {
+        fprintf(stderr, "Number of threads must be 1-1024, not %s.\n",
+                optarg);
+        usage();
+
+        free(pb_file_name);
+        free(pv_file_name);
+        free(batch_dir);
+        return 1;
+      }
+      break;
+
+    case 'P': // number of primes per modulus
+      primes = strtoul(optarg, NULL, 10);
+      if ((primes < 2) || (primes > RSA_MAX_PRIMES)) {
+        fprintf(stderr, "Number of primes must be 2-%d, not %s.\n",
+                RSA_MAX_PRIMES, optarg);
+        usage();
+
+        free(pb_file_name);
+        free(pv_file_name);
+        free(batch_dir);
+        return 1;
+      }
+      break;
+
+    case 'c': // number of key pairs in batch mode
+      count = strtoul(optarg, NULL, 10);
+      if ((count < 1) || (count > 1000000)) {
+        fprintf(stderr, "Number of keys must be 1-1000000, not %s.\n",
+                optarg);
+        usage();
+
+        free(pb_file_name);
+        free(pv_file_name);
+        free(batch_dir);
+        return 1;
+      }
+      break;
+
+    case 'D': // directory for batch mode key files
+      snprintf(batch_dir, 4096, "%s", optarg);
+      break;
+
+    case 'B': // binary key files
+      binary = true;
+      break;
+
+    case 'A': // arithmetic backend
+      if (!numtheory_set_backend(optarg)) {
+        fprintf(stderr,
+                "Unknown arithmetic backend %s, expected reference, gmp, "
+                "fast, <a>,<b> or check.\n",
+                optarg);
+        usage();
+
+        free(pb_file_name);
+        free(pv_file_name);
+        free(batch_dir);
+        return 1;
+      }
+      break;
+
     case 'v': // verbose
       verbose = 1;
       break;
 
     case 'h': // help message
 
-      fprintf(stderr, "Usage: ./keygen [options]\n");
-      fprintf(stderr, "  ./keygen generates a public / private key pair, "
-                      "placing the keys into the public and private\n");
-      fprintf(stderr, "  key files as specified below. The keys have a modulus "
-                      "(n) whose length is specified in\n");
-      fprintf(stderr, "  the program options.\n");
-      fprintf(stderr, "    -s <seed>   : Use <seed> as the random number seed. "
-                      "Default: time()\n");
-      fprintf(stderr, "    -b <bits>   : Public modulus n must have at least "
-                      "<bits> bits. Default: 1024\n");
-      fprintf(stderr, "    -i <iters>  : Run <iters> Miller-Rabin iterations "
-                      "for primality testing. Default: 50\n");
-      fprintf(
-          stderr,
-          "    -n <pbfile> : Public key file is <pbfile>. Default: rsa.pub\n");
-      fprintf(stderr, "    -d <pvfile> : Private key file is <pvfile>. "
-                      "Default: rsa.priv\n");
-      fprintf(stderr, "    -v          : Enable verbose output.\n");
-      fprintf(stderr,
-              "    -h          : Display program synopsis and usage.\n");
+      usage();
 
       free(pb_file_name);
       free(pv_file_name);
+      free(batch_dir);
       return 0;
     default: // if the user has an invalid option, print help message and return
              // a non zero exit code
-      fprintf(stderr, "Usage: ./keygen [options]\n");
-      fprintf(stderr, "  ./keygen generates a public / private key pair, "
-                      "placing the keys into the public and private\n");
-      fprintf(stderr, "  key files as specified below. The keys have a modulus "
-                      "(n) whose length is specified in\n");
-      fprintf(stderr, "  the program options.\n");
-      fprintf(stderr, "    -s <seed>   : Use <seed> as the random number seed. "
-                      "Default: time()\n");
-      fprintf(stderr, "    -b <bits>   : Public modulus n must have at least "
-                      "<bits> bits. Default: 1024\n");
-      fprintf(stderr, "    -i <iters>  : Run <iters> Miller-Rabin iterations "
-                      "for primality testing. Default: 50\n");
-      fprintf(
-          stderr,
-          "    -n <pbfile> : Public key file is <pbfile>. Default: rsa.pub\n");
-      fprintf(stderr, "    -d <pvfile> : Private key file is <pvfile>. "
-                      "Default: rsa.priv\n");
-      fprintf(stderr, "    -v          : Enable verbose output.\n");
-      fprintf(stderr,
-              "    -h          : Display program synopsis and usage.\n");
+      usage();
 
       free(pb_file_name);
       free(pv_file_name);
+      free(batch_dir);
       return 1;
     }
   }
 
+  stats_init(verbose == 1);
+
+  char *username = (char *)(calloc(
+      sizeof(char),
+      4096)); // credit to Lev Teytelman for telling me about the buffersize
+
+  if (username == NULL) { // check if pointers return null
+    fprintf(stderr, "No more memory!\n");
+    return 1;
+  }
+
+  strcpy(username, getenv("USER"));
+  mpz_t mpz_username;
+  mpz_init_set_str(mpz_username, username,
+                   62); // converting username into mpz for signature
+
+  if (count > 0) { // batch mode, every key gets its own files in batch_dir
+    int status =
+        make_batch(batch_dir, count, (threads > 0) ? threads : 1, seed, nbits,
+                   iters, fixed_e, primes, binary, username, mpz_username);
+    if (verbose == 1) {
+      print_prime_stats();
+    }
+    mpz_clear(mpz_username);
+    free(pb_file_name);
+    free(pv_file_name);
+    free(batch_dir);
+    free(username);
+    return status;
+  }
+
   // initilize randstate
   randstate_init(seed);
+  rsa_set_keygen_threads(threads);
 
   FILE *pb_file;
   FILE *pv_file;
 
-  mpz_t p;
-  mpz_init(p);
-  mpz_t q;
-  mpz_init(q);
-  mpz_t e;
-  mpz_init(e);
-  mpz_t n;
-  mpz_init(n);
-  mpz_t d;
-  mpz_init(d);
+  keypair key;
+  keypair_init(&key, primes);
 
   // opening files
 
@@ -234,54 +582,34 @@ int main(int argc, char **argv) { // allows compiled file to get command line
   int file_num = fileno(pv_file);
   fchmod(file_num, 0600);
 
-  char *username = (char *)(calloc(
-      sizeof(char),
-      4096)); // credit to Lev Teytelman for telling me about the buffersize
-
-  if (username == NULL) { // check if pointers return null
-    fprintf(stderr, "No more memory!\n");
-    return 1;
-  }
-
-  strcpy(username, getenv("USER"));
-  mpz_t mpz_username;
-  mpz_init_set_str(mpz_username, username,
-                   62); // converting username into mpz for signature
-
-  // making public and private keys
-  rsa_make_pub(p, q, n, e, nbits, iters);
-  rsa_make_priv(d, e, p, q);
-
-  // s stores the signature from rsa_sign
-  mpz_t s;
-  mpz_init(s);
-  rsa_sign(s, mpz_username, d, n);
-
-  rsa_write_pub(n, e, s, username, pb_file);
-  rsa_write_priv(n, d, pv_file);
+  // making public and private keys, s stores the signature from rsa_sign
+  make_keypair(&key, nbits, iters, fixed_e, mpz_username);
+  write_keypair(&key, username, pb_file, pv_file, binary);
 
   if (verbose == 1) { // if verbose is on
     fprintf(stderr, "username: %s\n", username);
     gmp_fprintf(stderr, "user signature (%zu bits): %Zd\n",
-                mpz_sizeinbase(s, 2), s);
-    gmp_fprintf(stderr, "p (%zu bits): %Zd\n", mpz_sizeinbase(p, 2), p);
-    gmp_fprintf(stderr, "q (%zu bits): %Zd\n", mpz_sizeinbase(q, 2), q);
-    gmp_fprintf(stderr, "n - modulus (%zu bits): %Zd\n", mpz_sizeinbase(n, 2),
-                n);
+                mpz_sizeinbase(key.s, 2), key.s);
+    gmp_fprintf(stderr, "p (%zu bits): %Zd\n",
+                mpz_sizeinbase(key.primes[0], 2), key.primes[0]);
+    gmp_fprintf(stderr, "q (%zu bits): %Zd\n",
+                mpz_sizeinbase(key.primes[1], 2), key.primes[1]);
+    for (uint64_t i = 2; i < key.count; i++) {
+      gmp_fprintf(stderr, "r%lu (%zu bits): %Zd\n", i + 1,
+                  mpz_sizeinbase(key.primes[i], 2), key.primes[i]);
+    }
+    gmp_fprintf(stderr, "n - modulus (%zu bits): %Zd\n",
+                mpz_sizeinbase(key.n, 2), key.n);
     gmp_fprintf(stderr, "e - public exponent (%zu bits): %Zd\n",
-                mpz_sizeinbase(e, 2), e);
+                mpz_sizeinbase(key.e, 2), key.e);
     gmp_fprintf(stderr, "d - private exponent(%zu bits): %Zd\n",
-                mpz_sizeinbase(d, 2), d);
+                mpz_sizeinbase(key.d, 2), key.d);
+    print_prime_stats();
   }
 
   // free mpz_variables and other heap memory allocations
 
-  mpz_clear(p);
-  mpz_clear(q);
-  mpz_clear(e);
-  mpz_clear(n);
-  mpz_clear(d);
-  mpz_clear(s);
+  keypair_clear(&key);
   mpz_clear(mpz_username);
 
   fclose(pb_file);
@@ -289,6 +617,7 @@ int main(int argc, char **argv) { // allows compiled file to get command line
 
   free(pb_file_name);
   free(pv_file_name);
+  free(batch_dir);
   free(username);
 
   randstate_clear();
@@ -0,0 +1,102 @@
+// clang-format off
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "mapfile.h"
+// clang-format on
+
+bool map_input(mapped_file *m, FILE *f) {
+  int fd = fileno(f);
+  struct stat st;
+  if ((fd < 0) || (fstat(fd, &st) != 0) || !S_ISREG(st.st_mode)) {
+    return false;
+  }
+
+  off_t start = ftello(f); // where stdio would read next
+  if ((start < 0) || (start >= st.st_size)) {
+    return false;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (base == MAP_FAILED) {
+    return false;
+  }
+  madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+  m->fd = fd;
+  m->base = (uint8_t *)base;
+  m->map_size = st.st_size;
+  m->data = m->base + start;
+  m->length = st.st_size - start;
+  m->start = start;
+  return true;
+}
+
+void unmap_input(mapped_file *m, FILE *f, size_t used) {
+  munmap(m->base, m->map_size);
+  fseeko(f, m->start + used, SEEK_SET);
+}
+
+void release_input(mapped_file *m) { munmap(m->base, m->map_size); }
+
+bool map_output(mapped_file *m, FILE *f, size_t capacity) {
+  int fd = fileno(f);
+  struct stat st;
+  if ((fd < 0) || (capacity == 0) || (fstat(fd, &st) != 0) ||
+      !S_ISREG(st.st_mode)) {
+    return false;
+  }
+
+  int mode = fcntl(fd, F_GETFL);
+  if ((mode < 0) || ((mode & O_ACCMODE) != O_RDWR) || (mode & O_APPEND)) {
+    return false; // a shared writable mapping needs a read-write descriptor
+  }
+
+  fflush(f); // anything stdio still buffers must land before the mapping
+  off_t start = ftello(f);
+  if (start < 0) {
+    return false;
+  }
+
+  size_t size = start + capacity;
+  if ((ftruncate(fd, size) != 0) ||
+      (posix_fallocate(fd, start, capacity) != 0)) {
+    ftruncate(fd, st.st_size);
+    return false;
+  }
+
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED) {
+    ftruncate(fd, st.st_size);
+    return false;
+  }
+
+  m->fd = fd;
+  m->base = (uint8_t *)base;
+  m->map_size = size;
+  m->data = m->base + start;
+  m->length = capacity;
+  m->start = start;
+  return true;
+}
+
+void unmap_output(mapped_file *m, FILE *f, size_t used) {
+  munmap(m->base, m->map_size);
+  ftruncate(m->fd, m->start + used);
+  fseeko(f, m->start + used, SEEK_SET);
+}
+
+bool same_file(FILE *a, FILE *b) {
+  struct stat sa, sb;
+  if ((fstat(fileno(a), &sa) != 0) || (fstat(fileno(b), &sb) != 0)) {
+    return false;
+  }
+  return (sa.st_dev == sb.st_dev) && (sa.st_ino == sb.st_ino);
+}
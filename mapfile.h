@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//
+// Memory-mapped views of regular files opened through stdio.
+// Mapping only succeeds for regular files, so callers can fall back to
+// streaming stdio for pipes and terminals.
+//
+typedef struct {
+  int fd;
+  uint8_t *base;   // the mapping itself, starting at file offset 0
+  size_t map_size; // the size of the mapping
+  uint8_t *data;   // the usable region, starting at the stdio position
+  size_t length;   // the size of the usable region
+  size_t start;    // the file offset of data
+} mapped_file;
+
+//
+// Maps the rest of a regular file for reading, from its current position.
+//
+// m: will describe the mapping.
+// f: the file to map.
+// returns: false if f is not a regular file, has nothing left to read, or
+//          cannot be mapped. The file is untouched in that case.
+//
+bool map_input(mapped_file *m, FILE *f);
+
+//
+// Unmaps an input mapping and moves the stdio position past the bytes that
+// were consumed.
+//
+// m: the mapping from map_input().
+// f: the mapped file.
+// used: the number of bytes of m->data that were consumed.
+//
+void unmap_input(mapped_file *m, FILE *f, size_t used);
+
+//
+// Unmaps an input mapping without touching its file, which may have been
+// closed since it was mapped.
+//
+// m: the mapping from map_input().
+//
+void release_input(mapped_file *m);
+
+//
+// Grows a regular file so capacity bytes fit after its current position,
+// reserves the space on disk and maps that region for writing.
+// The file must have been opened for both reading and writing.
+//
+// m: will describe the mapping.
+// f: the file to map.
+// capacity: the number of bytes to make room for.
+// returns: false if f is not a regular, writable file or the space cannot be
+//          reserved. The file keeps its original size in that case.
+//
+bool map_output(mapped_file *m, FILE *f, size_t capacity);
+
+//
+// Unmaps an output mapping, truncates the file to the bytes actually used
+// and moves the stdio position just past them.
+//
+// m: the mapping from map_output().
+// f: the mapped file.
+// used: the number of bytes written into m->data.
+//
+void unmap_output(mapped_file *m, FILE *f, size_t used);
+
+//
+// Checks whether two open files refer to the same file on disk.
+//
+// a, b: the files to compare.
+//
+bool same_file(FILE *a, FILE *b);
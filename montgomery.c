@@ -0,0 +1,334 @@
+// clang-format off
+#include <assert.h>
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "montgomery.h"
+#include "stats.h"
+// clang-format on
+
+// copies an mpz_t that is already reduced mod n into size zero-padded limbs
+static void limbs_from_mpz(mp_limb_t *r, mp_size_t size, mpz_t a) {
+  mp_size_t used = mpz_size(a);
+  if (used > 0) {
+    memcpy(r, mpz_limbs_read(a), used * sizeof(mp_limb_t));
+  }
+  if (used < size) {
+    memset(r + used, 0, (size - used) * sizeof(mp_limb_t));
+  }
+}
+
+bool mont_supported(mpz_t n) {
+  return mpz_odd_p(n) && (mpz_cmp_ui(n, 1) > 0);
+}
+
+void mont_init(mont_ctx *ctx, mpz_t n) {
+  mp_size_t size = mpz_size(n);
+  ctx->size = size;
+  ctx->borrowed = false;
+  ctx->n = (mp_limb_t *)malloc(size * sizeof(mp_limb_t));
+  ctx->r2 = (mp_limb_t *)malloc(size * sizeof(mp_limb_t));
+  ctx->one = (mp_limb_t *)malloc(size * sizeof(mp_limb_t));
+  limbs_from_mpz(ctx->n, size, n);
+
+  // Newton iteration for n0^-1 mod 2^64, each step doubles the correct bits
+  // (n0 * n0 = 1 mod 8 for odd n0, so we start with 3 correct bits)
+  mp_limb_t n0 = ctx->n[0];
+  mp_limb_t inv = n0;
+  for (int i = 0; i < 6; i++) {
+    inv *= 2 - (n0 * inv);
+  }
+  ctx->ninv = -inv;
+
+  // R mod n and R^2 mod n
+  mpz_t r;
+  mpz_init(r);
+  mpz_setbit(r, size * GMP_NUMB_BITS);
+  mpz_mod(r, r, n);
+  limbs_from_mpz(ctx->one, size, r);
+
+  mpz_set_ui(r, 0);
+  mpz_setbit(r, 2 * size * GMP_NUMB_BITS);
+  mpz_mod(r, r, n);
+  limbs_from_mpz(ctx->r2, size, r);
+  mpz_clear(r);
+}
+
+void mont_clear(mont_ctx *ctx) {
+  if (ctx->borrowed) {
+    return;
+  }
+  free(ctx->n);
+  free(ctx->r2);
+  free(ctx->one);
+  ctx->n = ctx->r2 = ctx->one = NULL;
+}
+
+mp_size_t mont_scratch_size(mont_ctx *ctx) {
+  return 3 * ctx->size; // a double-length product and one row of carries
+}
+
+void mont_redc(mont_ctx *ctx, mp_limb_t *r, mp_limb_t *t,
+               mp_limb_t *scratch) {
+  mp_size_t size = ctx->size;
+  mp_limb_t *carries = scratch;
+
+  // clear one limb of t per row, the carry out of row i belongs at limb
+  // i + size, which no later row reads, so it is added at the end
+  for (mp_size_t i = 0; i < size; i++) {
+    mp_limb_t u = t[i] * ctx->ninv;
+    carries[i] = mpn_addmul_1(t + i, ctx->n, size, u);
+  }
+  mp_limb_t top = mpn_add_n(r, t + size, carries, size);
+
+  // the result is below 2n, one subtraction brings it below n
+  if (top || (mpn_cmp(r, ctx->n, size) >= 0)) {
+    mpn_sub_n(r, r, ctx->n, size);
+  }
+}
+
+void mont_mul(mont_ctx *ctx, mp_limb_t *r, const mp_limb_t *a,
+              const mp_limb_t *b, mp_limb_t *scratch) {
+  mp_limb_t *t = scratch + ctx->size;
+  mpn_mul_n(t, a, b, ctx->size);
+  mont_redc(ctx, r, t, scratch);
+}
+
+void mont_sqr(mont_ctx *ctx, mp_limb_t *r, const mp_limb_t *a,
+              mp_limb_t *scratch) {
+  mp_limb_t *t = scratch + ctx->size;
+  mpn_sqr(t, a, ctx->size);
+  mont_redc(ctx, r, t, scratch);
+}
+
+void mont_to(mont_ctx *ctx, mp_limb_t *r, mpz_t a, mp_limb_t *scratch) {
+  mp_size_t size = ctx->size;
+  mp_size_t used = mpz_size(a);
+
+  if ((mpz_sgn(a) >= 0) && (used < size)) { // already below n
+    limbs_from_mpz(r, size, a);
+  } else if ((mpz_sgn(a) >= 0) && (used <= 2 * size)) {
+    // reduce in place with the quotient in scratch, as for c mod p in CRT
+    mpn_tdiv_qr(scratch, r, 0, mpz_limbs_read(a), used, ctx->n, size);
+  } else { // negative or oversized inputs are rare, allocate for those
+    mpz_t n;
+    mpz_roinit_n(n, ctx->n, size);
+    mpz_t reduced;
+    mpz_init(reduced);
+    mpz_mod(reduced, a, n);
+    limbs_from_mpz(r, size, reduced);
+    mpz_clear(reduced);
+  }
+
+  mont_mul(ctx, r, r, ctx->r2, scratch); // a * R^2 * R^-1 = a * R
+}
+
+void mont_from(mont_ctx *ctx, mpz_t o, const mp_limb_t *a,
+               mp_limb_t *scratch) {
+  mp_size_t size = ctx->size;
+  mp_limb_t *t = scratch + size;
+  memcpy(t, a, size * sizeof(mp_limb_t));
+  memset(t + size, 0, size * sizeof(mp_limb_t));
+
+  mp_limb_t *r = mpz_limbs_write(o, size);
+  mont_redc(ctx, r, t, scratch);
+  mpz_limbs_finish(o, size);
+}
+
+// window width for an exponent of the given size, balancing the table of
+// 2^(width - 1) odd powers against the multiplies saved
+static uint32_t window_width(size_t bits) {
+  if (bits <= 24) {
+    return 1;
+  } else if (bits <= 80) {
+    return 3;
+  } else if (bits <= 240) {
+    return 4;
+  } else if (bits <= 672) {
+    return 5;
+  }
+  return MONT_MAX_WIDTH;
+}
+
+void mont_sched_init(mont_sched *sched, mpz_t d) {
+  sched->capacity = 0;
+  sched->squarings = NULL;
+  sched->digits = NULL;
+  sched->borrowed = false;
+  mont_sched_set(sched, d);
+}
+
+void mont_sched_set(mont_sched *sched, mpz_t d) {
+  assert(!sched->borrowed);
+  size_t bits = (mpz_sgn(d) == 0) ? 0 : mpz_sizeinbase(d, 2);
+  uint32_t width = window_width(bits);
+  sched->width = width;
+  sched->steps = 0;
+  sched->tail = 0;
+
+  // at most one window per set bit, the arrays only ever grow
+  size_t most = mpz_popcount(d) + 1;
+  if (most > sched->capacity) {
+    sched->squarings =
+        (uint32_t *)realloc(sched->squarings, most * sizeof(uint32_t));
+    sched->digits = (uint32_t *)realloc(sched->digits, most * sizeof(uint32_t));
+    sched->capacity = most;
+  }
+
+  // scan from the top bit down, each window starts at a set bit and ends at
+  // the lowest set bit within width bits of it, so its value is odd
+  size_t zeros = 0;
+  size_t i = bits;
+  while (i > 0) {
+    size_t top = i - 1;
+    if (!mpz_tstbit(d, top)) {
+      zeros += 1;
+      i -= 1;
+      continue;
+    }
+
+    size_t low = (top + 1 >= width) ? (top + 1 - width) : 0;
+    while (!mpz_tstbit(d, low)) {
+      low += 1;
+    }
+
+    uint32_t digit = 0;
+    for (size_t b = top + 1; b-- > low;) {
+      digit = (digit << 1) | (uint32_t)mpz_tstbit(d, b);
+    }
+
+    sched->squarings[sched->steps] = (uint32_t)(zeros + (top - low + 1));
+    sched->digits[sched->steps] = digit;
+    sched->steps += 1;
+    zeros = 0;
+    i = low;
+  }
+  sched->tail = zeros;
+}
+
+void mont_sched_clear(mont_sched *sched) {
+  if (sched->borrowed) {
+    return;
+  }
+  free(sched->squarings);
+  free(sched->digits);
+  sched->squarings = NULL;
+  sched->digits = NULL;
+  sched->capacity = 0;
+}
+
+mp_size_t mont_powm_scratch_size(mont_ctx *ctx) {
+  // the kernel scratch, the largest table of odd powers, a^2 and v
+  size_t entries = (size_t)1 << (MONT_MAX_WIDTH - 1);
+  return mont_scratch_size(ctx) + ((entries + 2) * ctx->size);
+}
+
+void mont_powm_sched(mont_ctx *ctx, mpz_t o, mpz_t a, mont_sched *sched,
+                     mp_limb_t *scratch) {
+  mp_size_t size = ctx->size;
+  size_t entries = (size_t)1 << (sched->width - 1);
+
+  mp_limb_t *owned = NULL;
+  if (scratch == NULL) {
+    owned = (mp_limb_t *)malloc(mont_powm_scratch_size(ctx) *
+                                sizeof(mp_limb_t));
+    scratch = owned;
+  }
+  mp_limb_t *table = scratch + mont_scratch_size(ctx);
+  mp_limb_t *square = table + (entries * size); // a^2, to build the table
+  mp_limb_t *v = square + size;
+
+  if (sched->steps == 0) { // d = 0
+    mont_from(ctx, o, ctx->one, scratch);
+    free(owned);
+    return;
+  }
+
+  // table[i] = a^(2i + 1) in the Montgomery domain
+  mont_to(ctx, table, a, scratch);
+  if (entries > 1) {
+    mont_sqr(ctx, square, table, scratch);
+    for (size_t i = 1; i < entries; i++) {
+      mont_mul(ctx, table + (i * size), table + ((i - 1) * size), square,
+               scratch);
+    }
+  }
+
+  uint64_t squarings = (entries > 1) ? 1 : 0;
+  uint64_t multiplies = entries - 1;
+  memcpy(v, table + ((sched->digits[0] >> 1) * size),
+         size * sizeof(mp_limb_t));
+  for (size_t step = 1; step < sched->steps; step++) {
+    for (uint32_t i = 0; i < sched->squarings[step]; i++) {
+      mont_sqr(ctx, v, v, scratch);
+    }
+    mont_mul(ctx, v, v, table + ((sched->digits[step] >> 1) * size), scratch);
+    squarings += sched->squarings[step];
+    multiplies += 1;
+  }
+  for (size_t i = 0; i < sched->tail; i++) {
+    mont_sqr(ctx, v, v, scratch);
+  }
+  STAT_ADD(STAT_SQUARINGS, squarings + sched->tail);
+  STAT_ADD(STAT_MULTIPLIES, multiplies);
+
+  mont_from(ctx, o, v, scratch);
+  free(owned);
+}
+
+void mont_powm_ui(mont_ctx *ctx, mpz_t o, mpz_t a, unsigned long e,
+                  mp_limb_t *scratch) {
+  mp_size_t size = ctx->size;
+
+  mp_limb_t *owned = NULL;
+  if (scratch == NULL) {
+    owned = (mp_limb_t *)malloc(mont_powm_scratch_size(ctx) *
+                                sizeof(mp_limb_t));
+    scratch = owned;
+  }
+  mp_limb_t *base = scratch + mont_scratch_size(ctx);
+  mp_limb_t *v = base + size;
+
+  mont_to(ctx, base, a, scratch);
+  memcpy(v, ctx->one, size * sizeof(mp_limb_t)); // v = 1 (e = 0 stays 1)
+
+  // left-to-right over the bits of e, skipping the square of the leading 1
+  int bit = (e == 0) ? -1 : (int)(sizeof(unsigned long) * 8) - 1;
+  while ((bit >= 0) && !((e >> bit) & 1)) {
+    bit -= 1;
+  }
+  if (bit >= 0) {
+    memcpy(v, base, size * sizeof(mp_limb_t));
+    bit -= 1;
+  }
+  uint64_t squarings = 0;
+  uint64_t multiplies = 0;
+  for (; bit >= 0; bit--) {
+    mont_sqr(ctx, v, v, scratch);
+    squarings += 1;
+    if ((e >> bit) & 1) {
+      mont_mul(ctx, v, v, base, scratch);
+      multiplies += 1;
+    }
+  }
+  STAT_ADD(STAT_SQUARINGS, squarings);
+  STAT_ADD(STAT_MULTIPLIES, multiplies);
+
+  mont_from(ctx, o, v, scratch);
+  free(owned);
+}
+
+void mont_powm(mont_ctx *ctx, mpz_t o, mpz_t a, mpz_t d) {
+  if (mpz_sizeinbase(d, 2) <= MONT_SMALL_EXPONENT_BITS) {
+    mont_powm_ui(ctx, o, a, mpz_get_ui(d), NULL);
+    return;
+  }
+
+  mont_sched sched;
+  mont_sched_init(&sched, d);
+  mont_powm_sched(ctx, o, a, &sched, NULL);
+  mont_sched_clear(&sched);
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+//
+// Montgomery arithmetic for a fixed odd modulus n.
+// Values in the Montgomery domain are stored as x * R mod n, where
+// R = 2^(GMP_NUMB_BITS * size), in arrays of exactly size limbs.
+// Multiplying two such values and reducing with REDC replaces the division
+// that mpz_mod would otherwise do after every product.
+//
+// A context is read-only once initialized, so several threads can share
+// one context as long as each uses its own scratch space.
+// A borrowed context points into memory it does not own (a mapped binary
+// key file), and mont_clear() leaves that memory alone.
+//
+typedef struct {
+  mp_size_t size; // number of limbs in n
+  mp_limb_t *n;   // the modulus, size limbs
+  mp_limb_t ninv; // -n^-1 mod 2^GMP_NUMB_BITS
+  mp_limb_t *r2;  // R^2 mod n, size limbs
+  mp_limb_t *one; // R mod n (1 in the Montgomery domain), size limbs
+  bool borrowed;  // n, r2 and one belong to someone else
+} mont_ctx;
+
+//
+// Checks whether a modulus can be used with Montgomery arithmetic.
+//
+// n: the modulus.
+// returns: true if n is odd and greater than 1.
+//
+bool mont_supported(mpz_t n);
+
+//
+// Initializes a context for the modulus n.
+// n must satisfy mont_supported().
+//
+// ctx: the context to initialize.
+// n: the modulus.
+//
+void mont_init(mont_ctx *ctx, mpz_t n);
+
+//
+// Frees the memory used by a context.
+//
+// ctx: the context to clear.
+//
+void mont_clear(mont_ctx *ctx);
+
+//
+// Returns the number of scratch limbs the kernels below need.
+//
+// ctx: the context.
+//
+mp_size_t mont_scratch_size(mont_ctx *ctx);
+
+//
+// Reduces a double-length value: r = t * R^-1 mod n.
+// t must be less than n * R.
+//
+// ctx: the context.
+// r: will store the result, size limbs.
+// t: the value to reduce, 2 * size limbs. It is destroyed.
+// scratch: at least mont_scratch_size() limbs.
+//
+void mont_redc(mont_ctx *ctx, mp_limb_t *r, mp_limb_t *t, mp_limb_t *scratch);
+
+//
+// Montgomery multiplication: r = a * b * R^-1 mod n.
+// r may alias a or b.
+//
+// ctx: the context.
+// r: will store the result, size limbs.
+// a, b: the factors, size limbs each, both less than n.
+// scratch: at least mont_scratch_size() limbs.
+//
+void mont_mul(mont_ctx *ctx, mp_limb_t *r, const mp_limb_t *a,
+              const mp_limb_t *b, mp_limb_t *scratch);
+
+//
+// Montgomery squaring: r = a * a * R^-1 mod n.
+// r may alias a.
+//
+// ctx: the context.
+// r: will store the result, size limbs.
+// a: the value to square, size limbs, less than n.
+// scratch: at least mont_scratch_size() limbs.
+//
+void mont_sqr(mont_ctx *ctx, mp_limb_t *r, const mp_limb_t *a,
+              mp_limb_t *scratch);
+
+//
+// Converts a value into the Montgomery domain: r = (a mod n) * R mod n.
+// Allocates nothing for non-negative values of up to 2 * size limbs.
+//
+// ctx: the context.
+// r: will store the result, size limbs.
+// a: the value to convert (any sign or size).
+// scratch: at least mont_scratch_size() limbs.
+//
+void mont_to(mont_ctx *ctx, mp_limb_t *r, mpz_t a, mp_limb_t *scratch);
+
+//
+// Converts a value out of the Montgomery domain: o = a * R^-1 mod n.
+//
+// ctx: the context.
+// o: will store the result.
+// a: the Montgomery-domain value, size limbs.
+// scratch: at least mont_scratch_size() limbs.
+//
+void mont_from(mont_ctx *ctx, mpz_t o, const mp_limb_t *a, mp_limb_t *scratch);
+
+//
+// A sliding-window recoding of an exponent.
+// The exponent is split into odd windows of at most width bits separated by
+// runs of zero bits. Exponentiation then needs one table lookup and multiply
+// per window instead of one multiply per set bit, and reads no exponent bits
+// at all. A schedule depends only on the exponent, so it can be computed once
+// per key and reused for every block, or stored with the key. Like a
+// context, a borrowed schedule is never freed or recomputed.
+//
+#define MONT_MAX_WIDTH 6
+
+typedef struct {
+  uint32_t width;      // window width in bits, at most MONT_MAX_WIDTH
+  size_t steps;        // number of windows
+  uint32_t *squarings; // squarings before window i (ignored for window 0)
+  uint32_t *digits;    // odd value of window i, below 2^width
+  size_t tail;         // squarings after the last window
+  size_t capacity;     // allocated entries of squarings and digits
+  bool borrowed;       // squarings and digits belong to someone else
+} mont_sched;
+
+//
+// Computes the sliding-window schedule of an exponent.
+// The window width is picked from the size of the exponent.
+//
+// sched: the schedule to initialize.
+// d: the exponent, not negative.
+//
+void mont_sched_init(mont_sched *sched, mpz_t d);
+
+//
+// Recomputes a schedule for a new exponent, reusing its storage. Only
+// allocates when d has more set bits than any exponent before it.
+// The schedule must not be borrowed.
+//
+// sched: an initialized schedule.
+// d: the exponent, not negative.
+//
+void mont_sched_set(mont_sched *sched, mpz_t d);
+
+//
+// Frees the memory used by a schedule.
+//
+// sched: the schedule to clear.
+//
+void mont_sched_clear(mont_sched *sched);
+
+//
+// Returns the number of scratch limbs mont_powm_sched() and mont_powm_ui()
+// need, enough for the largest window table.
+//
+// ctx: the context.
+//
+mp_size_t mont_powm_scratch_size(mont_ctx *ctx);
+
+//
+// Modular exponentiation with a precomputed schedule: o = a^d mod n, where
+// sched was computed from d.
+// Allocates nothing when given scratch space and o already has room for
+// the size limbs of the result.
+// All mpz_t arguments are expected to be initialized. o may alias a.
+//
+// ctx: the context for n.
+// o: will store the result.
+// a: the base.
+// sched: the schedule of the exponent.
+// scratch: mont_powm_scratch_size() limbs, or NULL to allocate them.
+//
+void mont_powm_sched(mont_ctx *ctx, mpz_t o, mpz_t a, mont_sched *sched,
+                     mp_limb_t *scratch);
+
+//
+// The largest exponent mont_powm_ui() is meant for. Below this a plain
+// square-and-multiply chain beats building a window table.
+//
+#define MONT_SMALL_EXPONENT_BITS 32
+
+//
+// Modular exponentiation with a small exponent such as 65537: o = a^e mod n.
+// Runs a plain left-to-right square-and-multiply chain with no table and no
+// schedule, which is the cheapest path for public exponents.
+// All mpz_t arguments are expected to be initialized. o may alias a.
+//
+// ctx: the context for n.
+// o: will store the result.
+// a: the base.
+// e: the exponent.
+// scratch: mont_powm_scratch_size() limbs, or NULL to allocate them.
+//
+void mont_powm_ui(mont_ctx *ctx, mpz_t o, mpz_t a, unsigned long e,
+                  mp_limb_t *scratch);
+
+//
+// Modular exponentiation: o = a^d mod n, with every step reduced in the
+// Montgomery domain. Uses mont_powm_ui() for small exponents, otherwise
+// computes a schedule for d and calls mont_powm_sched().
+// d must not be negative.
+// All mpz_t arguments are expected to be initialized. o may alias a or d.
+//
+// ctx: the context for n.
+// o: will store the result.
+// a: the base.
+// d: the exponent.
+//
+void mont_powm(mont_ctx *ctx, mpz_t o, mpz_t a, mpz_t d);
@@ -2,408 +2,1031 @@
 #include <stdio.h>
 #include <assert.h>
 #include <gmp.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "montgomery.h"
+#include "numtheory.h"
+#include "primetable.h"
 #include "randstate.h"
+#include "stats.h"
 // clang-format on
 
+// is_prime() outcome counters, shared by every thread
+static atomic_uint_fast64_t stats_tested;
+static atomic_uint_fast64_t stats_sieved;
+static atomic_uint_fast64_t stats_rejected;
+static atomic_uint_fast64_t stats_passed;
+
+void prime_stats_get(prime_stats *stats) {
+  stats->tested = atomic_load(&stats_tested);
+  stats->sieved = atomic_load(&stats_sieved);
+  stats->rejected = atomic_load(&stats_rejected);
+  stats->passed = atomic_load(&stats_passed);
+}
 
-void gcd(mpz_t d, mpz_t a, mpz_t b) {
-  mpz_t temp; // declaring variables
-  mpz_init(temp);
+void prime_stats_reset(void) {
+  atomic_store(&stats_tested, 0);
+  atomic_store(&stats_sieved, 0);
+  atomic_store(&stats_rejected, 0);
+  atomic_store(&stats_passed, 0);
+}
 
-  // saving original variable values (as we will change them)
-  mpz_t og_a;
-  mpz_init_set(og_a, a);
+static void stats_count(atomic_uint_fast64_t *counter) {
+  atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
 
-  mpz_t og_b;
-  mpz_init_set(og_b, b);
+// counts a candidate rejected by trial division or Miller-Rabin
+static void stats_composite(atomic_uint_fast64_t *counter) {
+  stats_count(counter);
+  STAT_INC(STAT_COMPOSITE);
+}
 
-  if (mpz_cmp(a, b) == 0) // if a and b are the same
-  {
-    mpz_set(
-        d,
-        a); // greatest common factor of the same numbers is the number itself
-    mpz_clear(og_a);
-    mpz_clear(og_b);
-    mpz_clear(temp);
-    return;
+typedef enum { SIEVE_COMPOSITE, SIEVE_PRIME, SIEVE_UNKNOWN } sieve_result;
+
+// trial division of an odd n > 3 by the small prime table, one multi-limb
+// remainder per group of primes and single-limb remainders inside it
+static sieve_result sieve(mpz_t n) {
+  for (uint64_t g = 0; g < small_prime_groups_count; g++) {
+    const prime_group *group = &small_prime_groups[g];
+    unsigned long r = mpz_fdiv_ui(n, group->product);
+    for (uint32_t i = group->first; i < group->first + group->count; i++) {
+      if (r % small_primes[i] == 0) {
+        return (mpz_cmp_ui(n, small_primes[i]) == 0) ? SIEVE_PRIME
+                                                     : SIEVE_COMPOSITE;
+      }
+    }
   }
 
-  while (mpz_cmp_ui(b, 0)) // while b is not zero
-  {
-    mpz_set(temp, b);
-    mpz_mod(b, a, b);
-    mpz_set(a, temp);
+  // no factor up to the largest table prime settles anything below its square
+  unsigned long largest = small_primes[small_primes_count - 1];
+  if (mpz_cmp_ui(n, largest * largest) < 0) {
+    return SIEVE_PRIME;
   }
+  return SIEVE_UNKNOWN;
+}
 
-  // set d to the gcd and clear mpz variables
-  mpz_clear(temp);
-  mpz_set(d, a);
-
-  // set a amd b back to their original values
-  mpz_set(a, og_a);
-  mpz_set(b, og_b);
+void numtheory_ctx_init(numtheory_ctx *ctx, uint64_t bits) {
+  // products of two numbers are twice as long, so size for those
+  for (int i = 0; i < NUMTHEORY_TEMPS; i++) {
+    mpz_init2(ctx->t[i], 2 * bits + GMP_NUMB_BITS);
+  }
+  mpz_init2(ctx->modulus, bits);
+  ctx->has_mont = false;
+  mpz_t zero;
+  mpz_init(zero);
+  mont_sched_init(&ctx->sched, zero);
+  mpz_clear(zero);
+  ctx->scratch = NULL;
+  ctx->scratch_limbs = 0;
+  ctx->residues = NULL;
+  ctx->marks = NULL;
+}
 
-  mpz_clear(og_a);
-  mpz_clear(og_b);
-  return;
+void numtheory_ctx_clear(numtheory_ctx *ctx) {
+  for (int i = 0; i < NUMTHEORY_TEMPS; i++) {
+    mpz_clear(ctx->t[i]);
+  }
+  mpz_clear(ctx->modulus);
+  if (ctx->has_mont) {
+    mont_clear(&ctx->mont);
+  }
+  mont_sched_clear(&ctx->sched);
+  free(ctx->scratch);
+  free(ctx->residues);
+  free(ctx->marks);
 }
 
-void pow_mod(mpz_t o, mpz_t a, mpz_t d, mpz_t n) {
+mp_limb_t *numtheory_ctx_scratch(numtheory_ctx *ctx, mp_size_t limbs) {
+  if (limbs > ctx->scratch_limbs) {
+    ctx->scratch =
+        (mp_limb_t *)realloc(ctx->scratch, limbs * sizeof(mp_limb_t));
+    ctx->scratch_limbs = limbs;
+  }
+  return ctx->scratch;
+}
 
-  // saving original variable values (as we may change them)
-  mpz_t og_a;
-  mpz_init_set(og_a, a);
-  mpz_t og_d;
-  mpz_init_set(og_d, d);
-  mpz_t og_n;
-  mpz_init_set(og_n, n);
+// the bits a context should be sized for to handle these numbers
+static uint64_t ctx_bits(mpz_t a, mpz_t b) {
+  uint64_t abits = mpz_sizeinbase(a, 2);
+  uint64_t bbits = mpz_sizeinbase(b, 2);
+  return (abits > bbits) ? abits : bbits;
+}
 
-  if (mpz_cmp_ui(n, 0) == 0) // stop the program if the n is 0
-  {
-    printf("you cannot divide by zero (n is zero)");
-    assert(0);
-    return;
+// returns the Montgomery context for n, rebuilding it only when n changes
+static mont_ctx *ctx_mont(numtheory_ctx *ctx, mpz_t n) {
+  if (!ctx->has_mont || (mpz_cmp(ctx->modulus, n) != 0)) {
+    if (ctx->has_mont) {
+      mont_clear(&ctx->mont);
+    }
+    mont_init(&ctx->mont, n);
+    mpz_set(ctx->modulus, n);
+    ctx->has_mont = true;
   }
+  return &ctx->mont;
+}
 
-  // declare v and p (as in the given pseudocode)
+// the reference backend: the original Euclid, extended Euclid and square and
+// multiply
 
-  // v=1
-  mpz_t v;
-  mpz_init_set_ui(v, 1);
+static void reference_gcd(numtheory_ctx *ctx, mpz_t d, mpz_t a, mpz_t b) {
+  // work on copies so a and b are never modified
+  mpz_ptr x = ctx->t[0];
+  mpz_ptr y = ctx->t[1];
+  mpz_ptr temp = ctx->t[2];
+  mpz_set(x, a);
+  mpz_set(y, b);
 
-  // p=a
-  mpz_t p;
-  mpz_init_set(p, a);
+  while (mpz_cmp_ui(y, 0)) // while b is not zero
+  {
+    mpz_mod(temp, x, y);
+    mpz_swap(x, y);
+    mpz_swap(y, temp);
+  }
 
-  while (mpz_cmp_ui(d, 0) > 0) {
+  mpz_set(d, x); // set d to the gcd
+}
 
-    if (mpz_odd_p(d) > 0) { // if d is odd then the cmp will return 1
-      mpz_t vxpmodn;
-      mpz_init_set(vxpmodn, v); // start with v
+// the original square and multiply with a full division per step, still used
+// for even moduli, which Montgomery reduction cannot handle
+static void reference_pow_mod(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t d,
+                              mpz_t n) {
 
-      mpz_mul(vxpmodn, vxpmodn, p); // v x p
-      mpz_mod(vxpmodn, vxpmodn, n); // (v x p) mod n
+  if (mpz_cmp_ui(n, 0) == 0) // stop the program if the n is 0
+  {
+    printf("you cannot divide by zero (n is zero)");
+    assert(0);
+    return;
+  }
 
-      mpz_set(v, vxpmodn); // set v to the result
-      mpz_clear(vxpmodn);  // free vxpmodn
+  mpz_ptr v = ctx->t[0]; // v=1
+  mpz_set_ui(v, 1);
+  mpz_ptr p = ctx->t[1]; // p=a
+  mpz_set(p, a);
+  mpz_ptr temp = ctx->t[2];
+
+  // walk the bits of d from the bottom, reading them in place
+  size_t bits = mpz_sizeinbase(d, 2);
+  uint64_t squarings = 0;
+  uint64_t multiplies = 0;
+  for (size_t bit = 0; (bit < bits) && (mpz_sgn(d) > 0); bit++) {
+
+    if (mpz_tstbit(d, bit)) { // v = (v x p) mod n
+      mpz_mul(temp, v, p);
+      mpz_mod(v, temp, n);
+      multiplies += 1;
     }
 
-    mpz_t pxpmodn;                      // pxpmodn = (p * p) mod n
-    mpz_init_set(pxpmodn, p);           // start with p
-    mpz_mul(pxpmodn, pxpmodn, pxpmodn); // p x p
-    mpz_mod(pxpmodn, pxpmodn, n);       // (p x p) mod n
-
-    mpz_set(p, pxpmodn); // set p to the result
-    mpz_clear(pxpmodn);  // free pxpmodn
-
-    mpz_t dfdiv2;
-    mpz_init_set(dfdiv2, d);          // start with d
-    mpz_fdiv_q_ui(dfdiv2, dfdiv2, 2); // floor div d by 2
-
-    mpz_set(d, dfdiv2);
-    mpz_clear(dfdiv2); // free dfdiv2
+    mpz_mul(temp, p, p); // p = (p x p) mod n
+    mpz_mod(p, temp, n);
+    squarings += 1;
   }
+  STAT_ADD(STAT_SQUARINGS, squarings);
+  STAT_ADD(STAT_MULTIPLIES, multiplies);
 
   mpz_set(o, v); // set dest pointer as v (as we return v in psuedo code)
+}
 
-  // setting variables back to their original values in case they have been
-  // changed
-  mpz_set(a, og_a);
-  mpz_set(d, og_d);
-  mpz_set(n, og_n);
+// the fast backend: Montgomery exponentiation on a cached context
+static void fast_pow_mod(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t d,
+                         mpz_t n) {
+  if (!mont_supported(n)) {
+    reference_pow_mod(ctx, o, a, d, n);
+    return;
+  }
 
-  mpz_clear(p);
-  mpz_clear(v);
-  mpz_clear(og_a);
-  mpz_clear(og_d);
-  mpz_clear(og_n);
+  mont_ctx *mont = ctx_mont(ctx, n);
+  mp_limb_t *scratch = numtheory_ctx_scratch(ctx, mont_powm_scratch_size(mont));
+  if (mpz_sizeinbase(d, 2) <= MONT_SMALL_EXPONENT_BITS) {
+    mont_powm_ui(mont, o, a, mpz_get_ui(d), scratch);
+  } else {
+    mont_sched_set(&ctx->sched, d);
+    mont_powm_sched(mont, o, a, &ctx->sched, scratch);
+  }
 }
 
-void mod_inverse(mpz_t o, mpz_t a, mpz_t n) {
+static void reference_mod_inverse(numtheory_ctx *ctx, mpz_t o, mpz_t a,
+                                  mpz_t n) {
   // declare variables r, r', t, t'
-  mpz_t r;
-  mpz_init_set(r, n);
-  mpz_t rprime;
-  mpz_init_set(rprime, a);
-
-  mpz_t t;
-  mpz_init_set_ui(t, 0);
-  mpz_t tprime;
-  mpz_init_set_ui(tprime, 1);
+  mpz_ptr r = ctx->t[0];
+  mpz_ptr rprime = ctx->t[1];
+  mpz_ptr t = ctx->t[2];
+  mpz_ptr tprime = ctx->t[3];
+  mpz_ptr q = ctx->t[4];
+  mpz_ptr temp = ctx->t[5];
+  mpz_set(r, n);
+  mpz_set(rprime, a);
+  mpz_set_ui(t, 0);
+  mpz_set_ui(tprime, 1);
 
   while (mpz_cmp_ui(rprime, 0) != 0) {
 
     // q = r/r'
-    mpz_t rfdivrp;
-    mpz_init_set(rfdivrp, r);             // set rfdiv as r which is the divided
-    mpz_fdiv_q(rfdivrp, rfdivrp, rprime); // floor div r by r' (prime)
-    mpz_t q;                              // creating q
-    mpz_init_set(q, rfdivrp);             // setting q to quotient
-    mpz_clear(rfdivrp);
+    mpz_fdiv_q(q, r, rprime);
 
     //(r,r') = (r', r - (q x r'))
-    // creating a temp for r
-    mpz_t prev_r;
-    mpz_init_set(prev_r, r);
+    mpz_mul(temp, q, rprime);
+    mpz_sub(temp, r, temp);
+    mpz_swap(r, rprime);
+    mpz_swap(rprime, temp);
 
-    // r = r'
-    mpz_set(r, rprime);
+    //(t,t') = (t', t - (q x t'))
+    mpz_mul(temp, q, tprime);
+    mpz_sub(temp, t, temp);
+    mpz_swap(t, tprime);
+    mpz_swap(tprime, temp);
+  }
 
-    // r' = r - (q x r')
-    mpz_t qxrprime;
-    mpz_init_set(qxrprime, q);
-    mpz_mul(qxrprime, qxrprime, rprime);
+  if (mpz_cmp_ui(r, 1) > 0) {
+    mpz_set_ui(o, 0); // if no modular inverse is found, set o to 0
+    return;
+  }
 
-    mpz_t rminus_qxrprime;
-    mpz_init_set(rminus_qxrprime, prev_r);
-    mpz_sub(rminus_qxrprime, rminus_qxrprime, qxrprime);
+  if (mpz_cmp_ui(t, 0) < 0) { // t = t + n
+    mpz_add(t, t, n);
+  }
 
-    mpz_set(rprime, rminus_qxrprime); // r' = r - (q x r')
+  mpz_set(o, t);
+}
 
-    mpz_clear(prev_r);
-    mpz_clear(rminus_qxrprime);
-    mpz_clear(qxrprime);
+// the fast backend: binary (Stein) gcd and binary extended gcd, which trade
+// the division of every Euclid step for shifts and subtractions; negative
+// inputs and moduli below 2 take the reference code, so every input gives
+// the same result
 
-    //(t,t') = (t', t - (q x t'))
-    // creating a temp for t
-    mpz_t prev_t;
-    mpz_init_set(prev_t, t);
+static void fast_gcd(numtheory_ctx *ctx, mpz_t d, mpz_t a, mpz_t b) {
+  if ((mpz_sgn(a) <= 0) || (mpz_sgn(b) <= 0)) {
+    reference_gcd(ctx, d, a, b);
+    return;
+  }
+  mpz_ptr x = ctx->t[0];
+  mpz_ptr y = ctx->t[1];
+  mpz_set(x, a);
+  mpz_set(y, b);
+
+  // the common factors of 2, then x stays odd
+  mp_bitcnt_t xz = mpz_scan1(x, 0);
+  mp_bitcnt_t yz = mpz_scan1(y, 0);
+  mp_bitcnt_t shift = (xz < yz) ? xz : yz;
+  mpz_tdiv_q_2exp(x, x, xz);
+  while (mpz_sgn(y) != 0) {
+    mpz_tdiv_q_2exp(y, y, mpz_scan1(y, 0));
+    if (mpz_cmp(x, y) > 0) {
+      mpz_swap(x, y);
+    }
+    mpz_sub(y, y, x); // even, or zero once y = x = the odd part of the gcd
+  }
+  mpz_mul_2exp(d, x, shift);
+}
 
-    // t = t'
-    mpz_set(t, tprime);
+// the most halvings fast_halve() folds into one step, so that t fits an
+// unsigned long
+#define FAST_HALVE_BITS 31
+
+// halves u until it is odd, and its coefficient c mod the odd modulus m as
+// often: k halvings at once add t * m, with t = -c / m mod 2^k, which makes
+// the low k bits zero and leaves (c + t * m) / 2^k below m
+// minv: m^-1 mod 2^FAST_HALVE_BITS.
+static void fast_halve(mpz_t u, mpz_t c, mpz_t m, unsigned long minv) {
+  mp_bitcnt_t zeros = mpz_scan1(u, 0);
+  mpz_tdiv_q_2exp(u, u, zeros);
+  while (zeros > 0) {
+    mp_bitcnt_t k = (zeros < FAST_HALVE_BITS) ? zeros : FAST_HALVE_BITS;
+    unsigned long t = (0 - mpz_get_ui(c) * minv) & ((1UL << k) - 1);
+    mpz_addmul_ui(c, m, t);
+    mpz_tdiv_q_2exp(c, c, k);
+    zeros -= k;
+  }
+}
 
-    // t' = t - (q x t')
-    mpz_t qxtprime;
-    mpz_init_set(qxtprime, q);
-    mpz_mul(qxtprime, qxtprime, tprime);
+// the binary inverse of 0 < x < m for an odd modulus m, keeping c1 * x = u
+// and c2 * x = v mod m while u and v run down to 0 and gcd(x, m)
+// returns: false if gcd(x, m) is not 1
+static bool fast_inverse_odd(numtheory_ctx *ctx, mpz_t o, mpz_t x, mpz_t m) {
+  mpz_ptr u = ctx->t[2];
+  mpz_ptr v = ctx->t[3];
+  mpz_ptr c1 = ctx->t[4];
+  mpz_ptr c2 = ctx->t[5];
+  mpz_set(u, x);
+  mpz_set(v, m);
+  mpz_set_ui(c1, 1);
+  mpz_set_ui(c2, 0);
+
+  // Newton's iteration doubles the correct low bits of m^-1, from 3
+  unsigned long m0 = mpz_get_ui(m);
+  unsigned long minv = m0;
+  for (int i = 0; i < 4; i++) {
+    minv *= 2 - m0 * minv;
+  }
 
-    mpz_t tminus_qxtprime;
-    mpz_init_set(tminus_qxtprime, prev_t);
-    mpz_sub(tminus_qxtprime, tminus_qxtprime, qxtprime);
+  while (mpz_sgn(u) != 0) {
+    fast_halve(u, c1, m, minv); // v is odd here, and after every subtraction
+    if (mpz_cmp(u, v) >= 0) {
+      mpz_sub(u, u, v);
+      mpz_sub(c1, c1, c2);
+      if (mpz_sgn(c1) < 0) {
+        mpz_add(c1, c1, m);
+      }
+    } else {
+      mpz_sub(v, v, u);
+      mpz_sub(c2, c2, c1);
+      if (mpz_sgn(c2) < 0) {
+        mpz_add(c2, c2, m);
+      }
+      mpz_swap(u, v); // keep v odd: v - u was even, u was odd
+      mpz_swap(c1, c2);
+    }
+  }
+  if (mpz_cmp_ui(v, 1) != 0) {
+    return false;
+  }
+  mpz_set(o, c2);
+  return true;
+}
+
+static void fast_mod_inverse(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t n) {
+  if ((mpz_sgn(a) < 0) || (mpz_cmp_ui(n, 1) <= 0)) {
+    reference_mod_inverse(ctx, o, a, n);
+    return;
+  }
+  mpz_ptr x = ctx->t[0];
+  mpz_ptr y = ctx->t[1];
+  mpz_mod(x, a, n);
+  if (mpz_sgn(x) == 0) {
+    mpz_set_ui(o, 0); // if no modular inverse is found, set o to 0
+    return;
+  }
+  if (mpz_odd_p(n)) {
+    if (!fast_inverse_odd(ctx, o, x, n)) {
+      mpz_set_ui(o, 0);
+    }
+    return;
+  }
+
+  // an even n needs x odd, then with y = n^-1 mod x, x * (1 - n * y) / x
+  // is 1 mod n, and (1 - n * y) / x is in (-n, 0]
+  if (mpz_even_p(x)) {
+    mpz_set_ui(o, 0);
+    return;
+  }
+  if (mpz_cmp_ui(x, 1) == 0) {
+    mpz_set_ui(o, 1);
+    return;
+  }
+  mpz_ptr r = ctx->t[6];
+  mpz_mod(r, n, x);
+  if (!fast_inverse_odd(ctx, y, r, x)) {
+    mpz_set_ui(o, 0);
+    return;
+  }
+  mpz_mul(r, n, y);
+  mpz_ui_sub(r, 1, r);
+  mpz_divexact(r, r, x);
+  mpz_add(o, r, n);
+}
 
-    mpz_set(tprime, tminus_qxtprime); // t' = t - (q x t')
+// the gmp backend: GMP's own (subquadratic) algorithms
 
-    mpz_clear(prev_t);
-    mpz_clear(tminus_qxtprime);
-    mpz_clear(qxtprime);
+static void gmp_gcd(numtheory_ctx *ctx, mpz_t d, mpz_t a, mpz_t b) {
+  (void)ctx;
+  mpz_gcd(d, a, b);
+}
 
-    mpz_clear(q);
+static void gmp_mod_inverse(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t n) {
+  (void)ctx;
+  if (mpz_invert(o, a, n) == 0) {
+    mpz_set_ui(o, 0); // no inverse, as in the reference backend
   }
+}
 
-  if (mpz_cmp_ui(r, 1) > 0) {
-    mpz_set_ui(o, 0); // if no modular inverse is found, set o to 0
+static void gmp_pow_mod(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t d,
+                        mpz_t n) {
+  (void)ctx;
+  mpz_powm(o, a, d, n);
+}
 
-    mpz_clear(r);
-    mpz_clear(rprime);
+static const numtheory_backend backends[] = {
+    {"reference", reference_gcd, reference_mod_inverse, reference_pow_mod},
+    {"gmp", gmp_gcd, gmp_mod_inverse, gmp_pow_mod},
+    {"fast", fast_gcd, fast_mod_inverse, fast_pow_mod},
+};
 
-    mpz_clear(t);
-    mpz_clear(tprime);
+#define BACKEND_COUNT (sizeof(backends) / sizeof(backends[0]))
 
+// the backend in use, and the one it is cross-checked against (or NULL)
+static const numtheory_backend *backend = &backends[2];
+static const numtheory_backend *check_backend = NULL;
+static pthread_once_t backend_once = PTHREAD_ONCE_INIT;
+
+static const numtheory_backend *find_backend(const char *name, size_t length) {
+  for (size_t i = 0; i < BACKEND_COUNT; i++) {
+    if ((strlen(backends[i].name) == length) &&
+        (strncmp(backends[i].name, name, length) == 0)) {
+      return &backends[i];
+    }
+  }
+  return NULL;
+}
+
+// parses "<name>", "<name>,<name>" or "check" into a pair of backends
+static bool parse_backend(const char *spec, const numtheory_backend **primary,
+                          const numtheory_backend **check) {
+  if (strcmp(spec, "check") == 0) {
+    spec = "fast,reference";
+  }
+  const char *comma = strchr(spec, ',');
+  size_t length = (comma != NULL) ? (size_t)(comma - spec) : strlen(spec);
+  *primary = find_backend(spec, length);
+  *check = NULL;
+  if (comma != NULL) {
+    *check = find_backend(comma + 1, strlen(comma + 1));
+    if (*check == NULL) {
+      return false;
+    }
+  }
+  return *primary != NULL;
+}
+
+// the first use of a backend picks up NUMTHEORY_BACKEND from the environment
+static void backend_from_env(void) {
+  const char *spec = getenv("NUMTHEORY_BACKEND");
+  if ((spec == NULL) || (spec[0] == '\0')) {
+    return;
+  }
+  const numtheory_backend *primary, *check;
+  if (!parse_backend(spec, &primary, &check)) {
+    fprintf(stderr, "numtheory: unknown backend %s in NUMTHEORY_BACKEND, "
+                    "using %s.\n",
+            spec, backend->name);
     return;
   }
+  backend = primary;
+  check_backend = check;
+}
+
+bool numtheory_set_backend(const char *spec) {
+  pthread_once(&backend_once, backend_from_env);
+  const numtheory_backend *primary, *check;
+  if (!parse_backend(spec, &primary, &check)) {
+    return false;
+  }
+  backend = primary;
+  check_backend = check;
+  return true;
+}
 
-  if (mpz_cmp_ui(t, 0) < 0) {
-    // t = t + n
-    mpz_t tplusn;
+const char *numtheory_backend_name(void) {
+  pthread_once(&backend_once, backend_from_env);
+  return backend->name;
+}
 
-    mpz_init(tplusn);
-    mpz_set(tplusn, t);
-    mpz_add(tplusn, tplusn, n);
+const char *numtheory_check_backend_name(void) {
+  pthread_once(&backend_once, backend_from_env);
+  return (check_backend != NULL) ? check_backend->name : NULL;
+}
 
-    mpz_set(t, tplusn);
-    mpz_clear(tplusn);
+// reports two backends disagreeing on the same inputs and stops, a wrong
+// result must never reach a key or a ciphertext
+static void backend_mismatch(const char *name, const char *op, mpz_t x,
+                             mpz_t y, mpz_t z) {
+  fprintf(stderr, "numtheory: the %s and %s backends disagree on %s.\n",
+          name, check_backend->name, op);
+  gmp_fprintf(stderr, "  inputs: %Zx %Zx", x, y);
+  if (z != NULL) {
+    gmp_fprintf(stderr, " %Zx", z);
   }
+  fprintf(stderr, "\n");
+  abort();
+}
 
-  mpz_set(o, t);
+void gcd_ctx(numtheory_ctx *ctx, mpz_t d, mpz_t a, mpz_t b) {
+  STAT_TIMER_START(start);
+  pthread_once(&backend_once, backend_from_env);
+  if (check_backend == NULL) {
+    backend->gcd(ctx, d, a, b);
+    STAT_TIMER_STOP(TIMER_GCD, start);
+    return;
+  }
+  mpz_t x, y; // the outputs may alias the inputs
+  mpz_inits(x, y, NULL);
+  backend->gcd(ctx, x, a, b);
+  check_backend->gcd(ctx, y, a, b);
+  if (mpz_cmp(x, y) != 0) {
+    backend_mismatch(backend->name, "gcd", a, b, NULL);
+  }
+  mpz_set(d, x);
+  mpz_clears(x, y, NULL);
+  STAT_TIMER_STOP(TIMER_GCD, start);
+}
 
-  mpz_clear(r);
-  mpz_clear(rprime);
+void mod_inverse_ctx(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t n) {
+  STAT_TIMER_START(start);
+  pthread_once(&backend_once, backend_from_env);
+  if (check_backend == NULL) {
+    backend->mod_inverse(ctx, o, a, n);
+    STAT_TIMER_STOP(TIMER_MOD_INVERSE, start);
+    return;
+  }
+  mpz_t x, y;
+  mpz_inits(x, y, NULL);
+  backend->mod_inverse(ctx, x, a, n);
+  check_backend->mod_inverse(ctx, y, a, n);
+  if (mpz_cmp(x, y) != 0) {
+    backend_mismatch(backend->name, "mod_inverse", a, n, NULL);
+  }
+  mpz_set(o, x);
+  mpz_clears(x, y, NULL);
+  STAT_TIMER_STOP(TIMER_MOD_INVERSE, start);
+}
 
-  mpz_clear(t);
-  mpz_clear(tprime);
+void pow_mod_ctx(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t d, mpz_t n) {
+  STAT_TIMER_START(start);
+  STAT_INC(STAT_POW_MOD);
+  pthread_once(&backend_once, backend_from_env);
+  if (check_backend == NULL) {
+    backend->pow_mod(ctx, o, a, d, n);
+    STAT_TIMER_STOP(TIMER_POW_MOD, start);
+    return;
+  }
+  mpz_t x, y;
+  mpz_inits(x, y, NULL);
+  backend->pow_mod(ctx, x, a, d, n);
+  check_backend->pow_mod(ctx, y, a, d, n);
+  if (mpz_cmp(x, y) != 0) {
+    backend_mismatch(backend->name, "pow_mod", a, d, n);
+  }
+  mpz_set(o, x);
+  mpz_clears(x, y, NULL);
+  STAT_TIMER_STOP(TIMER_POW_MOD, start);
+}
 
-  return;
+void pow_mod_check(mpz_t o, mpz_t a, mpz_t d, mpz_t n) {
+  pthread_once(&backend_once, backend_from_env);
+  if (check_backend == NULL) {
+    return;
+  }
+  // a context of its own, the caller's may hold a, d or n in its temporaries
+  numtheory_ctx ctx;
+  numtheory_ctx_init(&ctx, mpz_sizeinbase(n, 2));
+  mpz_ptr y = ctx.t[NUMTHEORY_TEMPS - 1];
+  check_backend->pow_mod(&ctx, y, a, d, n);
+  if (mpz_cmp(o, y) != 0) {
+    backend_mismatch("montgomery", "pow_mod", a, d, n);
+  }
+  numtheory_ctx_clear(&ctx);
 }
 
-bool is_prime(mpz_t n, uint64_t iters) {
+static bool miller_rabin(numtheory_ctx *ctx, mpz_t n, uint64_t iters,
+                         gmp_randstate_t rand);
+
+// is_prime_ctx without its timer
+static bool prime_test(numtheory_ctx *ctx, mpz_t n, uint64_t iters) {
 
   // is_prime does not work for numbers [0~3] so i will hardcode them
   // does this matter though? not really, with a min bit size of 50 for p and q
   // (in keygen), these numbers will likely not be tested
 
   if ((mpz_cmp_ui(n, 0) == 0) || (mpz_cmp_ui(n, 1) == 0)) {
-    // printf("hardcode 0-1\n");
     return false;
   } else if (mpz_cmp_ui(n, 3) <= 0) {
-    // printf("hardcode 2-3\n");
     return true;
   }
 
+  stats_count(&stats_tested);
   if (mpz_even_p(n) >
       0) { // if n is even we return false (optimization power move)
+    stats_composite(&stats_sieved);
+    return false;
+  }
+
+  // most random candidates have a small factor, find those before paying
+  // for any modular exponentiation
+  switch (sieve(n)) {
+  case SIEVE_COMPOSITE:
+    stats_composite(&stats_sieved);
     return false;
+  case SIEVE_PRIME:
+    stats_count(&stats_passed);
+    return true;
+  case SIEVE_UNKNOWN:
+    break;
   }
+  return miller_rabin(ctx, n, iters, state);
+}
 
-  mpz_t n_1; // defining n - 1
-  mpz_init(n_1);
+bool is_prime_ctx(numtheory_ctx *ctx, mpz_t n, uint64_t iters) {
+  STAT_TIMER_START(start);
+  bool prime = prime_test(ctx, n, iters);
+  STAT_TIMER_STOP(TIMER_IS_PRIME, start);
+  return prime;
+}
 
+// the Miller-Rabin rounds of is_prime_ctx for an odd n > 3, drawing the
+// witnesses from rand
+static bool miller_rabin(numtheory_ctx *ctx, mpz_t n, uint64_t iters,
+                         gmp_randstate_t rand) {
+  // pow_mod_ctx uses t[0..2] at most, so t[3..7] are free here
+  mpz_ptr n_1 = ctx->t[3]; // n - 1
+  mpz_ptr n_2 = ctx->t[4]; // n - 2
+  mpz_ptr r = ctx->t[5];
+  mpz_ptr a = ctx->t[6];
+  mpz_ptr y = ctx->t[7];
   mpz_sub_ui(n_1, n, 1);
+  mpz_sub_ui(n_2, n, 2);
+
+  // n - 1 = 2^s * r with r odd
+  // credit to TA Zack Jorequera for psuedocode (refer to README for more info)
+  uint64_t s = mpz_scan1(n_1, 0);
+  mpz_fdiv_q_2exp(r, n_1, s);
+
+  // n is odd from here on, so with the fast backend every witness runs in
+  // the Montgomery domain; the others (and cross-checks) go through
+  // pow_mod_ctx, which uses t[0..2] at most
+  pthread_once(&backend_once, backend_from_env);
+  bool mont_path =
+      (backend->pow_mod == fast_pow_mod) && (check_backend == NULL);
+  mont_ctx *mont = NULL;
+  mp_limb_t *scratch = NULL;
+  if (mont_path) {
+    mont = ctx_mont(ctx, n);
+    scratch = numtheory_ctx_scratch(ctx, mont_powm_scratch_size(mont));
+    mont_sched_set(&ctx->sched, r); // the same exponent for every witness
+  }
 
-  // defining s and r for miller rabin algorithim
+  for (uint64_t i = 1; i < iters; i++) {
+    // making sure we pick a number in range [2,n-2]
+    mpz_urandomm(a, rand, n);
+    while ((mpz_cmp_ui(a, 2) < 0) || (mpz_cmp(a, n_2) > 0)) {
+      mpz_urandomm(a, rand, n);
+    }
+    STAT_INC(STAT_MR_ROUNDS);
 
-  mpz_t s;
-  mpz_init_set_ui(s, 0);
+    if (mont_path) {
+      STAT_INC(STAT_POW_MOD);
+      mont_powm_sched(mont, y, a, &ctx->sched, scratch); // y = pow_mod(a,r,n)
+    } else {
+      pow_mod_ctx(ctx, y, a, r, n);
+    }
 
-  mpz_t r;
-  mpz_init_set(r, n_1);
+    if ((mpz_cmp_ui(y, 1) != 0) && (mpz_cmp(y, n_1) != 0)) {
 
-  mpz_t m; // temp variable for r which will be used for calculating s and r
-           // values
-  mpz_init_set(m, r);
+      for (uint64_t j = 1; (j <= s - 1) && (mpz_cmp(y, n_1) != 0); j++) {
+        if (mont_path) {
+          mont_powm_ui(mont, y, y, 2, scratch); // y = pow_mod(y,2,n)
+        } else {
+          mpz_mul(y, y, y);
+          mpz_mod(y, y, n);
+          STAT_INC(STAT_SQUARINGS);
+        }
 
-  while (mpz_even_p(r) > 0) { // while r is even
-    // credit to TA Zack Jorequera for psuedocode (refer to README for more
-    // info)
-    if (mpz_odd_p(m) > 0) { // if m is odd
-      mpz_set(r, m);
-      break;
-    } else {
-      mpz_t s_1; // s+1
-      mpz_init_set(s_1, s);
-      mpz_add_ui(s_1, s_1, 1);
-      mpz_set(s, s_1);
-      mpz_clear(s_1);
-
-      mpz_t m_div_2; // m/2
-      mpz_init_set(m_div_2, m);
-      mpz_fdiv_q_ui(m_div_2, m_div_2, 2);
-      mpz_set(m, m_div_2);
-      mpz_clear(m_div_2);
+        if (mpz_cmp_ui(y, 1) == 0) // if y = 1, return false
+        {
+          stats_composite(&stats_rejected);
+          return false;
+        }
+      }
+
+      if (mpz_cmp(y, n_1) != 0) // if y != n-1, return false
+      {
+        stats_composite(&stats_rejected);
+        return false;
+      }
     }
   }
+  stats_count(&stats_passed);
+  return true;
+}
 
-  mpz_clear(m); // clear the temp variable
+// odd candidates covered by one segment of the sieve in make_prime_ctx
+#define SIEVE_WINDOW 4096
 
-  for (uint64_t i = 1; i < iters; i++) {
-    mpz_t rand_num;
-    mpz_init(rand_num);
-    mpz_urandomm(rand_num, state, n);
+// below this many bits a candidate could itself be a table prime, so
+// make_prime_ctx just draws random numbers
+#define SIEVE_MIN_BITS 32
 
-    mpz_t n_2; // n-2
-    mpz_init(n_2);
-    mpz_sub_ui(n_2, n, 2);
+// sets residues to base mod each table prime
+static void sieve_residues(uint32_t *residues, mpz_t base) {
+  for (uint64_t g = 0; g < small_prime_groups_count; g++) {
+    const prime_group *group = &small_prime_groups[g];
+    unsigned long r = mpz_fdiv_ui(base, group->product);
+    for (uint32_t i = group->first; i < group->first + group->count; i++) {
+      residues[i] = r % small_primes[i];
+    }
+  }
+}
 
-    if ((mpz_cmp_ui(rand_num, 2) < 0) ||
-        (mpz_cmp(rand_num, n_2) >
-         0)) // making sure we print a number in range [2,n-2]
-    {
+// marks the candidates base + 2j of a segment that a table prime divides,
+// then moves residues on to the next segment
+static void sieve_segment(uint8_t *marks, uint32_t *residues) {
+  memset(marks, 0, SIEVE_WINDOW);
+  for (uint64_t i = 0; i < small_primes_count; i++) {
+    uint64_t prime = small_primes[i];
+    // base + 2j = 0 mod prime when j = -base / 2 mod prime
+    uint64_t j = ((prime - residues[i]) % prime) * ((prime + 1) / 2) % prime;
+    for (; j < SIEVE_WINDOW; j += prime) {
+      marks[j] = 1;
+    }
+    residues[i] = (residues[i] + 2 * SIEVE_WINDOW) % prime;
+  }
+}
 
-      bool not_in_range = true;
-      while (not_in_range) {
-        mpz_urandomm(rand_num, state, n);
+// make_prime_ctx without its timer
+static void prime_search_serial(numtheory_ctx *ctx, mpz_t p, uint64_t bits,
+                                uint64_t iters) {
+  // is_prime_ctx uses t[3..7] and the backends' pow_mod t[0..2], so the
+  // candidate lives in t[8]
+  mpz_ptr rand_number = ctx->t[8];
 
-        if ((mpz_cmp_ui(rand_num, 2) >= 0) && (mpz_cmp(rand_num, n_2) <= 0)) {
-          not_in_range = false;
-          break;
-        }
+  if (bits <= SIEVE_MIN_BITS) {
+    while (1) // keep on generating numbers of nbis until they are prime
+    {
+      mpz_urandomb(rand_number, state, bits);
+      // sizeinbase checks if theyre atleast bits long, the cheap check first
+      if (bits != mpz_sizeinbase(rand_number, 2)) {
+        STAT_INC(STAT_SIZE_REJECTED);
+        continue;
+      }
+      if (is_prime_ctx(ctx, rand_number, iters)) {
+        mpz_set(p, rand_number);
+        return;
       }
     }
-    mpz_clear(n_2);
-
-    // setup miller rabin algorithim variables
-    mpz_t a;
-    mpz_init_set(a, rand_num);
-    mpz_clear(rand_num);
-
-    mpz_t y;
-    mpz_init(y);
-    pow_mod(y, a, r, n); // y = pow_mod(a,r,n)
+  }
 
-    if ((mpz_cmp_ui(y, 1) != 0) && (mpz_cmp(y, n_1) != 0)) {
+  if (ctx->marks == NULL) {
+    ctx->marks = (uint8_t *)malloc(SIEVE_WINDOW);
+    ctx->residues = (uint32_t *)malloc(small_primes_count * sizeof(uint32_t));
+  }
+  mpz_ptr base = ctx->t[9]; // the candidate at the start of the segment
+
+  while (1) {
+    // one random odd start with the top bit set, then walk upwards from it
+    mpz_urandomb(base, state, bits);
+    mpz_setbit(base, bits - 1);
+    mpz_setbit(base, 0);
+    sieve_residues(ctx->residues, base);
+
+    while (mpz_sizeinbase(base, 2) == bits) {
+      sieve_segment(ctx->marks, ctx->residues);
+
+      // only the survivors are worth a Miller-Rabin test
+      for (uint64_t j = 0; j < SIEVE_WINDOW; j++) {
+        stats_count(&stats_tested);
+        if (ctx->marks[j]) {
+          stats_composite(&stats_sieved);
+          continue;
+        }
+        mpz_add_ui(rand_number, base, 2 * j);
+        if (mpz_sizeinbase(rand_number, 2) != bits) {
+          STAT_INC(STAT_SIZE_REJECTED);
+          break; // walked past the top of the range, start somewhere else
+        }
+        if (miller_rabin(ctx, rand_number, iters, state)) {
+          mpz_set(p, rand_number);
+          return;
+        }
+      }
+      mpz_add_ui(base, base, 2 * SIEVE_WINDOW);
+    }
+  }
+}
 
-      mpz_t j;
-      mpz_init_set_ui(j, 1); // j =1
+void make_prime_ctx(numtheory_ctx *ctx, mpz_t p, uint64_t bits,
+                    uint64_t iters) {
+  STAT_TIMER_START(start);
+  prime_search_serial(ctx, p, bits, iters);
+  STAT_TIMER_STOP(TIMER_MAKE_PRIME, start);
+}
 
-      mpz_t s_1; // s - 1
-      mpz_init(s_1);
-      mpz_sub_ui(s_1, s, 1);
+// one prime being searched for by make_primes_parallel
+typedef struct {
+  uint64_t bits;
+  mpz_t base;           // the candidate at the start of the current segment
+  uint64_t seed;        // seeds the witness stream of every candidate
+  uint64_t walked;      // candidates walked since the search began
+  uint32_t *residues;   // base mod each table prime
+  uint8_t *marks;       // composites in the current segment
+  atomic_uint_fast64_t best; // lowest passing j in the segment so far
+  bool done;
+} prime_search;
+
+typedef struct {
+  prime_search *searches;
+  uint32_t *task_search; // which search each task belongs to
+  uint32_t *task_j;      // and which candidate of its segment it tests
+  numtheory_ctx *scratch; // one context per worker
+  gmp_randstate_t *rand;  // one witness stream per worker
+  mpz_ptr e;
+  uint64_t iters;
+} prime_batch;
+
+// draws a random odd start with the top bit set for a search
+static void search_restart(prime_search *search) {
+  mpz_urandomb(search->base, state, search->bits);
+  mpz_setbit(search->base, search->bits - 1);
+  mpz_setbit(search->base, 0);
+  sieve_residues(search->residues, search->base);
+}
 
-      while ((mpz_cmp(j, s_1) <= 0) && (mpz_cmp(y, n_1) != 0)) {
-        mpz_t num_2; // literally the number 2 (used as pow_mod does not take in
-                     // unsigned longs)
-        mpz_init_set_ui(num_2, 2);
+static void prime_task(void *arg, uint64_t index, uint64_t worker) {
+  prime_batch *batch = (prime_batch *)arg;
+  prime_search *search = &batch->searches[batch->task_search[index]];
+  uint64_t j = batch->task_j[index];
+  if (j > atomic_load_explicit(&search->best, memory_order_relaxed)) {
+    return; // a lower candidate already passed, this one cannot win
+  }
 
-        mpz_t ypowm;
-        mpz_init(ypowm);
-        pow_mod(ypowm, y, num_2, n);
-        mpz_set(y, ypowm);
+  // miller_rabin uses t[3..7] and gcd_ctx t[0..2]
+  numtheory_ctx *ctx = &batch->scratch[worker];
+  mpz_ptr candidate = ctx->t[8];
+  mpz_add_ui(candidate, search->base, 2 * j);
+  if (mpz_sizeinbase(candidate, 2) != search->bits) {
+    STAT_INC(STAT_SIZE_REJECTED);
+    return; // walked past the top of the range
+  }
+  stats_count(&stats_tested);
+
+  if (batch->e != NULL) { // the caller wants gcd(e, p - 1) = 1 as well
+    mpz_ptr tot = ctx->t[9];
+    mpz_sub_ui(tot, candidate, 1);
+    gcd_ctx(ctx, tot, batch->e, tot);
+    if (mpz_cmp_ui(tot, 1) != 0) {
+      STAT_INC(STAT_E_REJECTED);
+      return;
+    }
+  }
 
-        mpz_clear(ypowm);
-        mpz_clear(num_2);
+  // the witnesses depend only on the candidate, never on the thread, so
+  // the result is the same for any number of threads
+  gmp_randseed_ui(batch->rand[worker], search->seed + search->walked + j);
+  if (!miller_rabin(ctx, candidate, batch->iters, batch->rand[worker])) {
+    return;
+  }
 
-        if (mpz_cmp_ui(y, 1) == 0) // if y = 1, return false
-        {
+  uint_fast64_t best = atomic_load(&search->best);
+  while ((j < best) &&
+         !atomic_compare_exchange_weak(&search->best, &best, j)) {
+  }
+}
 
-          mpz_clear(s);
-          mpz_clear(r);
+void make_primes_parallel(mpz_t *primes, const uint64_t *bits, uint64_t count,
+                          uint64_t iters, mpz_t e, pool_t *pool) {
+  STAT_TIMER_START(start);
+  uint64_t threads = pool_threads(pool);
+  prime_search *searches =
+      (prime_search *)calloc(count, sizeof(prime_search));
+  prime_batch batch = {
+      .searches = searches,
+      .task_search = (uint32_t *)malloc(count * SIEVE_WINDOW * sizeof(uint32_t)),
+      .task_j = (uint32_t *)malloc(count * SIEVE_WINDOW * sizeof(uint32_t)),
+      .scratch = (numtheory_ctx *)calloc(threads, sizeof(numtheory_ctx)),
+      .rand = (gmp_randstate_t *)calloc(threads, sizeof(gmp_randstate_t)),
+      .e = e,
+      .iters = iters,
+  };
+  uint64_t max_bits = 0;
+  for (uint64_t s = 0; s < count; s++) {
+    max_bits = (bits[s] > max_bits) ? bits[s] : max_bits;
+  }
+  for (uint64_t w = 0; w < threads; w++) {
+    numtheory_ctx_init(&batch.scratch[w], max_bits);
+    gmp_randinit_mt(batch.rand[w]);
+  }
 
-          mpz_clear(a);
-          mpz_clear(y);
-          mpz_clear(j);
-          mpz_clear(s_1);
-          mpz_clear(n_1);
+  // every random draw comes from the calling thread, in a fixed order
+  uint64_t active = 0;
+  for (uint64_t s = 0; s < count; s++) {
+    prime_search *search = &searches[s];
+    search->bits = bits[s];
+    search->done = (bits[s] <= SIEVE_MIN_BITS);
+    if (search->done) { // too small to sieve, search the plain way
+      mpz_t tot;
+      mpz_init(tot);
+      do {
+        make_prime(primes[s], bits[s], iters);
+        mpz_sub_ui(tot, primes[s], 1);
+        if (e != NULL) {
+          gcd(tot, e, tot);
+          STAT_ADD(STAT_E_REJECTED, mpz_cmp_ui(tot, 1) != 0);
+        } else {
+          mpz_set_ui(tot, 1);
+        }
+      } while (mpz_cmp_ui(tot, 1) != 0);
+      mpz_clear(tot);
+      continue;
+    }
+    mpz_init2(search->base, bits[s]);
+    search->seed = gmp_urandomb_ui(state, 64);
+    search->residues = (uint32_t *)malloc(small_primes_count * sizeof(uint32_t));
+    search->marks = (uint8_t *)malloc(SIEVE_WINDOW);
+    search_restart(search);
+    active += 1;
+  }
 
-          return false;
+  while (active > 0) {
+    // sieve the next segment of every open search and interleave their
+    // survivors, so the searches advance together
+    uint64_t tasks = 0;
+    for (uint64_t s = 0; s < count; s++) {
+      if (!searches[s].done) {
+        sieve_segment(searches[s].marks, searches[s].residues);
+        atomic_store(&searches[s].best, SIEVE_WINDOW);
+      }
+    }
+    for (uint64_t j = 0; j < SIEVE_WINDOW; j++) {
+      for (uint64_t s = 0; s < count; s++) {
+        if (!searches[s].done && !searches[s].marks[j]) {
+          batch.task_search[tasks] = s;
+          batch.task_j[tasks] = j;
+          tasks += 1;
         }
-        mpz_add_ui(j, j, 1); // j = j +1
       }
+    }
+    pool_run(pool, prime_task, &batch, tasks);
 
-      if (mpz_cmp(y, n_1) != 0) // if y != n-1, return false
-      {
-        mpz_clear(s);
-        mpz_clear(r);
-
-        mpz_clear(a);
-        mpz_clear(y);
-        mpz_clear(j);
-        mpz_clear(s_1);
-        mpz_clear(n_1);
-
-        return false;
+    for (uint64_t s = 0; s < count; s++) {
+      prime_search *search = &searches[s];
+      if (search->done) {
+        continue;
+      }
+      uint64_t best = atomic_load(&search->best);
+      for (uint64_t j = 0; (j < best) && (j < SIEVE_WINDOW); j++) {
+        if (search->marks[j]) {
+          stats_count(&stats_tested);
+          stats_composite(&stats_sieved);
+        }
+      }
+      if (best < SIEVE_WINDOW) {
+        mpz_add_ui(primes[s], search->base, 2 * best);
+        search->done = true;
+        active -= 1;
+        continue;
+      }
+      mpz_add_ui(search->base, search->base, 2 * SIEVE_WINDOW);
+      search->walked += SIEVE_WINDOW;
+      if (mpz_sizeinbase(search->base, 2) != search->bits) {
+        search_restart(search); // ran off the top, start somewhere else
       }
+    }
+  }
 
-      mpz_clear(j);
-      mpz_clear(s_1);
+  for (uint64_t s = 0; s < count; s++) {
+    if (searches[s].residues != NULL) {
+      mpz_clear(searches[s].base);
+      free(searches[s].residues);
+      free(searches[s].marks);
     }
-    mpz_clear(a);
-    mpz_clear(y);
   }
-  mpz_clear(s);
-  mpz_clear(r);
-  mpz_clear(n_1);
-  return true;
+  for (uint64_t w = 0; w < threads; w++) {
+    numtheory_ctx_clear(&batch.scratch[w]);
+    gmp_randclear(batch.rand[w]);
+  }
+  free(searches);
+  free(batch.task_search);
+  free(batch.task_j);
+  free(batch.scratch);
+  free(batch.rand);
+  STAT_TIMER_STOP(TIMER_MAKE_PRIME, start);
+}
+
+// the plain functions run the _ctx variants on a short-lived context
+
+void gcd(mpz_t d, mpz_t a, mpz_t b) {
+  numtheory_ctx ctx;
+  numtheory_ctx_init(&ctx, ctx_bits(a, b));
+  gcd_ctx(&ctx, d, a, b);
+  numtheory_ctx_clear(&ctx);
+}
+
+void pow_mod(mpz_t o, mpz_t a, mpz_t d, mpz_t n) {
+  numtheory_ctx ctx;
+  numtheory_ctx_init(&ctx, mpz_sizeinbase(n, 2));
+  pow_mod_ctx(&ctx, o, a, d, n);
+  numtheory_ctx_clear(&ctx);
+}
+
+void mod_inverse(mpz_t o, mpz_t a, mpz_t n) {
+  numtheory_ctx ctx;
+  numtheory_ctx_init(&ctx, ctx_bits(a, n));
+  mod_inverse_ctx(&ctx, o, a, n);
+  numtheory_ctx_clear(&ctx);
+}
+
+bool is_prime(mpz_t n, uint64_t iters) {
+  numtheory_ctx ctx;
+  numtheory_ctx_init(&ctx, mpz_sizeinbase(n, 2));
+  bool prime = is_prime_ctx(&ctx, n, iters);
+  numtheory_ctx_clear(&ctx);
+  return prime;
 }
 
 void make_prime(mpz_t p, uint64_t bits, uint64_t iters) {
-  bool not_prime = true;
-  while (not_prime) // keep on generating numbers of nbis until they are prime
-  {
-    mpz_t rand_number;
-    mpz_init(rand_number);
-
-    mpz_urandomb(rand_number, state, bits);
-    if (is_prime(rand_number, iters) &&
-        (bits ==
-         mpz_sizeinbase(rand_number,
-                        2))) { // sizeinbase checks if theyre atleast bits long
-      mpz_set(p, rand_number);
-      mpz_clear(rand_number);
-      return;
-    }
-    mpz_clear(rand_number);
-  }
+  numtheory_ctx ctx;
+  numtheory_ctx_init(&ctx, bits);
+  make_prime_ctx(&ctx, p, bits, iters);
+  numtheory_ctx_clear(&ctx);
 }
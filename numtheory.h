@@ -5,6 +5,118 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "montgomery.h"
+#include "pool.h"
+
+//
+// Scratch space for the number theory functions.
+// Holds preallocated temporaries, a cached Montgomery context for the last
+// modulus used, a reusable exponent schedule and limb scratch, so the _ctx
+// variants below allocate nothing once the context has warmed up to the
+// sizes in use. A context must only be used by one thread at a time.
+//
+#define NUMTHEORY_TEMPS 10
+
+typedef struct {
+  mpz_t t[NUMTHEORY_TEMPS]; // general temporaries
+  mpz_t modulus;            // the modulus mont was built for
+  bool has_mont;
+  mont_ctx mont;
+  mont_sched sched;
+  mp_limb_t *scratch; // limb scratch for the Montgomery kernels
+  mp_size_t scratch_limbs;
+  uint32_t *residues; // prime search: segment start mod each table prime
+  uint8_t *marks;     // prime search: composites in the current segment
+} numtheory_ctx;
+
+//
+// Initializes a scratch context sized for numbers of up to bits bits.
+// Larger numbers still work, the context grows on first use.
+//
+// ctx: the context to initialize.
+// bits: the expected size of the moduli in bits.
+//
+void numtheory_ctx_init(numtheory_ctx *ctx, uint64_t bits);
+
+//
+// Frees the memory used by a scratch context.
+//
+// ctx: the context to clear.
+//
+void numtheory_ctx_clear(numtheory_ctx *ctx);
+
+//
+// Returns Montgomery kernel scratch of at least limbs limbs from a context,
+// growing it if needed.
+//
+// ctx: the context.
+// limbs: the number of limbs needed.
+//
+mp_limb_t *numtheory_ctx_scratch(numtheory_ctx *ctx, mp_size_t limbs);
+
+//
+// Counts of is_prime() outcomes since the program started (or the last
+// reset): candidates tested, rejected by trial division (including even
+// numbers), rejected by Miller-Rabin and accepted as prime.
+//
+typedef struct {
+  uint64_t tested;
+  uint64_t sieved;
+  uint64_t rejected;
+  uint64_t passed;
+} prime_stats;
+
+//
+// Copies the current is_prime() outcome counts into stats.
+//
+// stats: where to store the counts.
+//
+void prime_stats_get(prime_stats *stats);
+
+//
+// Resets the is_prime() outcome counts to zero.
+//
+void prime_stats_reset(void);
+
+//
+// An arithmetic backend: the implementations of gcd, mod_inverse and
+// pow_mod (and so of the Miller-Rabin rounds) behind the functions below.
+//   reference: the original Euclid, extended Euclid and square and multiply.
+//   gmp: GMP's mpz_gcd, mpz_invert and mpz_powm.
+//   fast: binary gcd, binary extended gcd and Montgomery exponentiation
+//         with sliding windows. The default.
+// Every backend gives the same results.
+//
+typedef struct {
+  const char *name;
+  void (*gcd)(numtheory_ctx *ctx, mpz_t d, mpz_t a, mpz_t b);
+  void (*mod_inverse)(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t n);
+  void (*pow_mod)(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t d, mpz_t n);
+} numtheory_backend;
+
+//
+// Selects the arithmetic backend for every thread. Until this is called the
+// backend comes from the NUMTHEORY_BACKEND environment variable, or is fast.
+// "<a>,<b>" runs backend a and cross-checks every result against backend b,
+// printing the inputs and aborting on any difference; "check" is short for
+// "fast,reference". Call it before starting any threads.
+//
+// spec: a backend name, "<a>,<b>" or "check".
+// returns: false (leaving the backend unchanged) if a name is unknown.
+//
+bool numtheory_set_backend(const char *spec);
+
+//
+// Returns the name of the backend in use.
+//
+const char *numtheory_backend_name(void);
+
+//
+// Returns the name of the backend results are cross-checked against, or
+// NULL when cross-checking is off.
+//
+const char *numtheory_check_backend_name(void);
+
 void gcd(mpz_t d, mpz_t a, mpz_t b);
 
 void mod_inverse(mpz_t o, mpz_t a, mpz_t n);
@@ -14,3 +126,51 @@ void pow_mod(mpz_t o, mpz_t a, mpz_t d, mpz_t n);
 bool is_prime(mpz_t n, uint64_t iters);
 
 void make_prime(mpz_t p, uint64_t bits, uint64_t iters);
+
+//
+// Variants of the functions above that take their temporaries from a
+// scratch context instead of allocating them. Results are the same.
+// The outputs may alias the inputs.
+//
+void gcd_ctx(numtheory_ctx *ctx, mpz_t d, mpz_t a, mpz_t b);
+
+void mod_inverse_ctx(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t n);
+
+void pow_mod_ctx(numtheory_ctx *ctx, mpz_t o, mpz_t a, mpz_t d, mpz_t n);
+
+//
+// The block loops of rsa.c (encrypt, decrypt and batch verify) run the
+// Montgomery kernels directly rather than a backend, so the backend choice
+// only affects them when cross-checking is on: each of their results is
+// then passed here and recomputed with the check backend, aborting like the
+// backends do on a difference. Does nothing when cross-checking is off.
+//
+// o: the result to check, a^d mod n.
+// a: the base.
+// d: the exponent.
+// n: the modulus.
+//
+void pow_mod_check(mpz_t o, mpz_t a, mpz_t d, mpz_t n);
+
+bool is_prime_ctx(numtheory_ctx *ctx, mpz_t n, uint64_t iters);
+
+void make_prime_ctx(numtheory_ctx *ctx, mpz_t p, uint64_t bits,
+                    uint64_t iters);
+
+//
+// Searches for count primes at once on a pool of threads.
+// Each search walks a sieved interval from its own random start, the
+// candidates are tested in parallel and the lowest passing candidate of a
+// search wins, which cancels the tests above it. The witnesses of every
+// candidate come from a stream seeded for that candidate, so the primes
+// depend on the random state but not on the number of threads.
+//
+// primes: where to store the primes found.
+// bits: the size of each prime in bits.
+// count: the number of primes to search for.
+// iters: the number of Miller-Rabin iterations per candidate.
+// e: if not NULL, every prime p also has gcd(e, p - 1) = 1.
+// pool: the threads to search on.
+//
+void make_primes_parallel(mpz_t *primes, const uint64_t *bits, uint64_t count,
+                          uint64_t iters, mpz_t e, pool_t *pool);
@@ -0,0 +1,173 @@
+// clang-format off
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pipeline.h"
+// clang-format on
+
+// a bounded single-producer single-consumer ring of slot numbers
+// the semaphores count the filled and free entries, so the fast path is one
+// atomic operation per side and a full or empty ring blocks rather than
+// spinning; each index is only touched by its own side
+typedef struct {
+  uint64_t *entries;
+  uint64_t capacity;
+  uint64_t head; // next entry to pop, consumer only
+  uint64_t tail; // next entry to push, producer only
+  sem_t filled;
+  sem_t free;
+} ring;
+
+static void ring_init(ring *r, uint64_t capacity) {
+  r->entries = (uint64_t *)calloc(capacity, sizeof(uint64_t));
+  r->capacity = capacity;
+  r->head = 0;
+  r->tail = 0;
+  sem_init(&r->filled, 0, 0);
+  sem_init(&r->free, 0, (unsigned int)capacity);
+}
+
+static void ring_clear(ring *r) {
+  sem_destroy(&r->filled);
+  sem_destroy(&r->free);
+  free(r->entries);
+}
+
+static void ring_push(ring *r, uint64_t slot) {
+  while (sem_wait(&r->free) != 0) {
+    // interrupted by a signal, wait again
+  }
+  r->entries[r->tail] = slot;
+  r->tail = (r->tail + 1) % r->capacity;
+  sem_post(&r->filled);
+}
+
+static uint64_t ring_pop(ring *r) {
+  while (sem_wait(&r->filled) != 0) {
+    // interrupted by a signal, wait again
+  }
+  uint64_t slot = r->entries[r->head];
+  r->head = (r->head + 1) % r->capacity;
+  sem_post(&r->free);
+  return slot;
+}
+
+typedef struct {
+  pipeline_read_fn read;
+  pipeline_compute_fn compute;
+  pipeline_write_fn write;
+  void *arg;
+
+  ring empty;    // writer -> reader, slots ready to be filled
+  ring filled;   // reader -> compute
+  ring computed; // compute -> writer
+
+  bool *last;  // the slot holds the last batch, set by the reader
+  bool *skip;  // the slot holds no batch because the pipeline stopped
+  atomic_bool stop; // set by the writer to end the pipeline early
+} pipeline;
+
+static void *reader_main(void *varg) {
+  pipeline *p = (pipeline *)varg;
+  bool more = true;
+  while (more) {
+    uint64_t slot = ring_pop(&p->empty);
+    p->skip[slot] = atomic_load(&p->stop);
+    more = !p->skip[slot] && p->read(p->arg, slot);
+    p->last[slot] = !more;
+    ring_push(&p->filled, slot);
+  }
+  return NULL;
+}
+
+static void *writer_main(void *varg) {
+  pipeline *p = (pipeline *)varg;
+  bool more = true;
+  while (more) {
+    uint64_t slot = ring_pop(&p->computed);
+    if (!p->skip[slot] && !atomic_load(&p->stop) &&
+        !p->write(p->arg, slot)) {
+      atomic_store(&p->stop, true);
+    }
+    more = !p->last[slot];
+    ring_push(&p->empty, slot);
+  }
+  return NULL;
+}
+
+// the stages one after another on the calling thread, one slot at a time
+static void run_serial(pipeline_read_fn read, pipeline_compute_fn compute,
+                       pipeline_write_fn write, void *arg) {
+  bool more = true;
+  while (more) {
+    more = read(arg, 0);
+    compute(arg, 0);
+    if (!write(arg, 0)) {
+      return;
+    }
+  }
+}
+
+void pipeline_run(uint64_t slots, pipeline_read_fn read,
+                  pipeline_compute_fn compute, pipeline_write_fn write,
+                  void *arg) {
+  if (slots < 2) {
+    run_serial(read, compute, write, arg);
+    return;
+  }
+
+  pipeline p = {.read = read, .compute = compute, .write = write, .arg = arg};
+  ring_init(&p.empty, slots);
+  ring_init(&p.filled, slots);
+  ring_init(&p.computed, slots);
+  p.last = (bool *)calloc(slots, sizeof(bool));
+  p.skip = (bool *)calloc(slots, sizeof(bool));
+  atomic_init(&p.stop, false);
+  for (uint64_t i = 0; i < slots; i++) {
+    ring_push(&p.empty, i);
+  }
+
+  // the writer starts first, it has no side effects until a slot arrives
+  pthread_t reader, writer;
+  bool started = false;
+  if (pthread_create(&writer, NULL, writer_main, &p) == 0) {
+    if (pthread_create(&reader, NULL, reader_main, &p) == 0) {
+      started = true;
+    } else {
+      // nothing was read, so hand the writer an empty last slot to end it
+      uint64_t slot = ring_pop(&p.empty);
+      p.skip[slot] = true;
+      p.last[slot] = true;
+      ring_push(&p.computed, slot);
+      pthread_join(writer, NULL);
+    }
+  }
+
+  if (started) {
+    bool more = true;
+    while (more) {
+      uint64_t slot = ring_pop(&p.filled);
+      if (!p.skip[slot] && !atomic_load(&p.stop)) {
+        compute(arg, slot);
+      }
+      more = !p.last[slot];
+      ring_push(&p.computed, slot);
+    }
+    pthread_join(reader, NULL);
+    pthread_join(writer, NULL);
+  }
+
+  ring_clear(&p.empty);
+  ring_clear(&p.filled);
+  ring_clear(&p.computed);
+  free(p.last);
+  free(p.skip);
+
+  if (!started) {
+    run_serial(read, compute, write, arg);
+  }
+}
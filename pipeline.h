@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// A three-stage streaming pipeline: a reader thread fills batches, the
+// calling thread computes them, and a writer thread drains them in order.
+// The stages pass batch slots to each other through bounded rings, so a
+// slow stage holds the others back once every slot is in flight and the
+// memory in use never exceeds the slots the caller allocated.
+//
+
+//
+// Fills a slot with the next batch of input. Runs on the reader thread.
+//
+// arg: the argument that was passed to pipeline_run().
+// slot: the slot to fill, in [0, slots).
+// returns: false if this was the last batch (it is still computed and
+//          written), true if more input may follow.
+//
+typedef bool (*pipeline_read_fn)(void *arg, uint64_t slot);
+
+//
+// Processes a filled slot. Runs on the thread that called pipeline_run(),
+// which may hand the work on to a pool.
+//
+// arg: the argument that was passed to pipeline_run().
+// slot: the slot to process.
+//
+typedef void (*pipeline_compute_fn)(void *arg, uint64_t slot);
+
+//
+// Writes out a processed slot. Runs on the writer thread, which sees the
+// slots in the order they were read.
+//
+// arg: the argument that was passed to pipeline_run().
+// slot: the slot to write.
+// returns: false to stop the pipeline early; slots that are already in
+//          flight are then dropped without being computed or written.
+//
+typedef bool (*pipeline_write_fn)(void *arg, uint64_t slot);
+
+//
+// Runs a pipeline over a stream until the reader reports the last batch or
+// the writer stops it. If the reader and writer threads cannot be started,
+// the stages run one after another on the calling thread instead.
+//
+// slots: the number of batch slots, at least 1. Two or more let the stages
+//        overlap, three let all of them run at once.
+// read: the reader stage.
+// compute: the compute stage.
+// write: the writer stage.
+// arg: passed through to every stage.
+//
+void pipeline_run(uint64_t slots, pipeline_read_fn read,
+                  pipeline_compute_fn compute, pipeline_write_fn write,
+                  void *arg);
@@ -0,0 +1,161 @@
+// clang-format off
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "pool.h"
+// clang-format on
+
+struct pool {
+  uint64_t threads;
+  pthread_t *workers; // threads - 1 workers, the caller is worker 0
+
+  pthread_mutex_t lock;
+  pthread_cond_t start; // signalled when a new run begins (or on shutdown)
+  pthread_cond_t done;  // signalled when the last worker finishes a run
+
+  uint64_t generation; // bumped once per pool_run()
+  uint64_t active;     // workers still inside the current run
+  bool shutdown;
+
+  // the current run
+  pool_task_fn fn;
+  void *arg;
+  uint64_t count;
+  atomic_uint_fast64_t next; // next index to hand out
+};
+
+typedef struct {
+  pool_t *pool;
+  uint64_t id;
+} worker_arg;
+
+// claims indices until the current run is exhausted
+static void drain(pool_t *pool, uint64_t worker) {
+  while (1) {
+    uint64_t i = atomic_fetch_add(&pool->next, 1);
+    if (i >= pool->count) {
+      return;
+    }
+    pool->fn(pool->arg, i, worker);
+  }
+}
+
+static void *worker_main(void *varg) {
+  worker_arg *warg = (worker_arg *)varg;
+  pool_t *pool = warg->pool;
+  uint64_t id = warg->id;
+  free(warg);
+
+  uint64_t seen = 0; // last generation this worker ran
+
+  pthread_mutex_lock(&pool->lock);
+  while (1) {
+    while (!pool->shutdown && (pool->generation == seen)) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->shutdown) {
+      break;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    drain(pool, id);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->active -= 1;
+    if (pool->active == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+pool_t *pool_create(uint64_t threads) {
+  pool_t *pool = (pool_t *)calloc(1, sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+
+  pool->threads = (threads < 1) ? 1 : threads;
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  atomic_init(&pool->next, 0);
+
+  pool->workers = (pthread_t *)calloc(pool->threads, sizeof(pthread_t));
+  if (pool->workers == NULL) {
+    free(pool);
+    return NULL;
+  }
+
+  for (uint64_t i = 1; i < pool->threads; i++) {
+    worker_arg *warg = (worker_arg *)malloc(sizeof(worker_arg));
+    if (warg != NULL) {
+      warg->pool = pool;
+      warg->id = i;
+    }
+    if ((warg == NULL) ||
+        (pthread_create(&pool->workers[i], NULL, worker_main, warg) != 0)) {
+      free(warg);
+      pool->threads = i; // keep the workers that did start
+      pool_delete(pool);
+      return NULL;
+    }
+  }
+
+  return pool;
+}
+
+void pool_delete(pool_t *pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (uint64_t i = 1; i < pool->threads; i++) {
+    pthread_join(pool->workers[i], NULL);
+  }
+
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->start);
+  pthread_cond_destroy(&pool->done);
+  free(pool->workers);
+  free(pool);
+}
+
+uint64_t pool_threads(pool_t *pool) { return pool->threads; }
+
+void pool_run(pool_t *pool, pool_task_fn fn, void *arg, uint64_t count) {
+  if (pool->threads == 1) { // nothing to hand off, run inline
+    for (uint64_t i = 0; i < count; i++) {
+      fn(arg, i, 0);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->fn = fn;
+  pool->arg = arg;
+  pool->count = count;
+  atomic_store(&pool->next, 0);
+  pool->active = pool->threads - 1;
+  pool->generation += 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  drain(pool, 0); // the caller works too
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->active > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
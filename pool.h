@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// A fixed-size pool of worker threads that run a task over a range of
+// indices and wait for all of them to finish.
+// The calling thread also takes part in the work, so a pool of one thread
+// starts no extra threads at all.
+//
+typedef struct pool pool_t;
+
+//
+// The task run by a pool for every index in a range.
+//
+// arg: the argument that was passed to pool_run().
+// index: the index of the item to process.
+// worker: the id of the thread running the task, in [0, threads).
+//
+typedef void (*pool_task_fn)(void *arg, uint64_t index, uint64_t worker);
+
+//
+// Creates a pool that runs tasks on the given number of threads.
+//
+// threads: the total number of threads, including the caller (at least 1).
+// returns: the new pool, or NULL if the threads could not be started.
+//
+pool_t *pool_create(uint64_t threads);
+
+//
+// Stops the threads of a pool and frees its memory.
+//
+// pool: the pool to delete.
+//
+void pool_delete(pool_t *pool);
+
+//
+// Returns the total number of threads a pool runs tasks on.
+//
+// pool: the pool to query.
+//
+uint64_t pool_threads(pool_t *pool);
+
+//
+// Runs fn for every index in [0, count) and returns once all are done.
+// Indices are handed out dynamically, so tasks may finish in any order.
+//
+// pool: the pool to run the tasks on.
+// fn: the task to run.
+// arg: passed through to every call of fn.
+// count: the number of indices to run.
+//
+void pool_run(pool_t *pool, pool_task_fn fn, void *arg, uint64_t count);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// Table of the first odd primes, generated at build time by gen_primes
+// (see the primetable.c rule in the Makefile).
+//
+extern const uint32_t small_primes[];
+extern const uint64_t small_primes_count;
+
+//
+// The table above split into consecutive groups whose product fits in an
+// unsigned long, so trial division needs one multi-limb remainder per group
+// and single-limb remainders for the primes inside it.
+//
+typedef struct {
+  unsigned long product; // product of the primes in the group
+  uint32_t first;        // index of the first prime of the group
+  uint32_t count;        // number of primes in the group
+} prime_group;
+
+extern const prime_group small_prime_groups[];
+extern const uint64_t small_prime_groups_count;
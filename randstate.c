@@ -1,20 +1,28 @@
 // clang-format off
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <gmp.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "randstate.h"
 
 // clang-format on
 
-// gmp_randstate_t state;
+_Thread_local gmp_randstate_t state;
+
+// the generator behind srandom() and random(), kept per thread
+static _Thread_local struct random_data random_data;
+static _Thread_local char random_buffer[128]; // the size srandom() uses
 
 void randstate_init(uint64_t seed) {
 
-  // convert the seed into mpz
-  srandom(seed);
+  // seed the random() style generator, same sequence as srandom(seed)
+  memset(&random_data, 0, sizeof(random_data));
+  initstate_r(seed, random_buffer, sizeof(random_buffer), &random_data);
 
+  // convert the seed into mpz
   mpz_t seed_mpz;
   mpz_init_set_ui(seed_mpz, seed);
 
@@ -25,4 +33,10 @@ void randstate_init(uint64_t seed) {
   mpz_clear(seed_mpz);
 }
 
+long randstate_random(void) {
+  int32_t result;
+  random_r(&random_data, &result);
+  return result;
+}
+
 void randstate_clear(void) { gmp_randclear(state); }
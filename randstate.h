@@ -3,7 +3,12 @@
 #include <gmp.h>
 #include <stdint.h>
 
-extern gmp_randstate_t state;
+//
+// The random state used by key generation and the number theory functions.
+// Every thread has its own, initialized by calling randstate_init() on that
+// thread.
+//
+extern _Thread_local gmp_randstate_t state;
 
 //
 // Initializes the random state needed for RSA key generation operations.
@@ -14,6 +19,12 @@ extern gmp_randstate_t state;
 //
 void randstate_init(uint64_t seed);
 
+//
+// Returns the next number in [0, 2^31) from the calling thread's random
+// state, the same sequence random() gives after srandom(seed).
+//
+long randstate_random(void);
+
 //
 // Frees any memory used by the initialized random state.
 // Must be called after all key generation or number theory operations are used.
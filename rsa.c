@@ -6,11 +6,93 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <time.h>
 
+#include "chacha.h"
+#include "container.h"
+#include "hexcodec.h"
+#include "io.h"
+#include "keyfile.h"
+#include "mapfile.h"
+#include "montgomery.h"
 #include "numtheory.h"
+#include "pipeline.h"
+#include "pool.h"
 #include "randstate.h"
+#include "rsa.h"
+#include "stats.h"
 // clang-format on
 
+// number of threads used by the file encryption and decryption loops
+static uint64_t file_threads = 1;
+
+// blocks handed to the pool per thread in every batch
+#define BATCH_PER_THREAD 16
+
+// ciphertext format written by rsa_encrypt_file
+static rsa_format_t file_format = RSA_FORMAT_HEX;
+
+void rsa_set_format(rsa_format_t format) { file_format = format; }
+
+// whether the file loops may memory-map regular files
+static bool file_mmap = true;
+
+void rsa_set_mmap(bool enabled) { file_mmap = enabled; }
+
+// batches in flight between the reader, compute and writer stages
+#define PIPELINE_SLOTS 4
+
+// memory the streaming pipelines may hold, see pipeline_cap()
+static uint64_t file_memory = RSA_DEFAULT_MEMORY;
+
+void rsa_set_memory(uint64_t bytes) { file_memory = bytes; }
+
+void rsa_set_threads(uint64_t threads) {
+  file_threads = (threads < 1) ? 1 : threads;
+}
+
+// number of threads searching for primes, 0 keeps the serial search
+static uint64_t keygen_threads = 0;
+
+void rsa_set_keygen_threads(uint64_t threads) { keygen_threads = threads; }
+
+// starts a pool for the file loops, falling back to the calling thread alone
+// if the workers cannot be created
+static pool_t *start_pool(void) {
+  pool_t *pool = pool_create(file_threads);
+  if (pool == NULL) {
+    pool = pool_create(1);
+  }
+  return pool;
+}
+
+// blocks per batch of a streaming pipeline: as many as the pool can use at
+// once, fewer if PIPELINE_SLOTS batches of block_bytes per block would not
+// fit in half the memory cap
+static uint64_t pipeline_cap(pool_t *pool, uint64_t block_bytes) {
+  uint64_t cap = pool_threads(pool) * BATCH_PER_THREAD;
+  uint64_t fit = (file_memory / 2) / (PIPELINE_SLOTS * block_bytes);
+  if (fit < cap) {
+    cap = (fit < 1) ? 1 : fit;
+  }
+  return cap;
+}
+
+// the smallest chunk of a streaming reader or writer
+#define IO_MIN_CHUNK ((size_t)64 << 10)
+
+// chunk size of the streaming readers and writers: the IO_DEPTH chunks of
+// one reader and one writer take the other half of the memory cap
+static size_t io_chunk_size(void) {
+  uint64_t size = file_memory / (4 * IO_DEPTH);
+  if (size > IO_CHUNK) {
+    size = IO_CHUNK;
+  }
+  return (size < IO_MIN_CHUNK) ? IO_MIN_CHUNK : (size_t)size;
+}
+
 void lambda(mpz_t n, mpz_t p,
             mpz_t q) // helper function for calculating lambda(n)
 {
@@ -46,32 +128,74 @@ void lambda(mpz_t n, mpz_t p,
   mpz_clear(quotient);
 }
 
-void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits,
-                  uint64_t iters) {
-  uint64_t p_upper =
-      (3 * nbits / 4); // credit to TA Sanjana Patil that helped me understand
-                       // how pbits and qbits are derived from nbits
-  uint64_t p_lower = (nbits / 4);
+// lambda(n) for a modulus with any number of primes, lcm(primes[i] - 1)
+static void lambda_primes(mpz_t l, mpz_t *primes, uint64_t count) {
+  mpz_t tot;
+  mpz_init(tot);
+  mpz_t g;
+  mpz_init(g);
+  mpz_set_ui(l, 1);
+  for (uint64_t i = 0; i < count; i++) {
+    mpz_sub_ui(tot, primes[i], 1);
+    gcd(g, l, tot); // lcm(l, tot) = l * tot / gcd(l, tot)
+    mpz_divexact(l, l, g);
+    mpz_mul(l, l, tot);
+  }
+  mpz_clear(tot);
+  mpz_clear(g);
+}
 
-  uint64_t pbits = (random() % (p_upper - p_lower)) +
-                   p_lower; // RNG code based on code from Tutor Ben Grant
-  uint64_t qbits = nbits - pbits;
+// whether no two of count primes are the same
+static bool primes_distinct(mpz_t *primes, uint64_t count) {
+  for (uint64_t i = 1; i < count; i++) {
+    for (uint64_t j = 0; j < i; j++) {
+      if (mpz_cmp(primes[i], primes[j]) == 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
 
-  // making p,q, n (p x q)
-  make_prime(p, pbits, iters);
-  make_prime(q, qbits, iters);
-  mpz_mul(n, p, q);
+// searches for count distinct primes concurrently on a pool, with
+// gcd(e, p - 1) = 1 for each prime p as well unless e is NULL
+static void make_primes_distinct(mpz_t *primes, const uint64_t *bits,
+                                 uint64_t count, uint64_t iters, mpz_t e) {
+  pool_t *pool = pool_create(keygen_threads);
+  if (pool == NULL) {
+    pool = pool_create(1);
+  }
+  do {
+    make_primes_parallel(primes, bits, count, iters, e, pool);
+  } while (!primes_distinct(primes, count));
+  pool_delete(pool);
+}
 
-  mpz_t lambda_n; // carmichael function
-  mpz_init(lambda_n);
-  lambda(lambda_n, p, q);
+// searches for p and q concurrently on a pool, with gcd(e, p - 1) =
+// gcd(e, q - 1) = 1 as well unless e is NULL
+static void make_pq_parallel(mpz_t p, mpz_t q, uint64_t pbits, uint64_t qbits,
+                             uint64_t iters, mpz_t e) {
+  mpz_t primes[2];
+  mpz_init(primes[0]);
+  mpz_init(primes[1]);
+  uint64_t bits[2] = {pbits, qbits};
+  make_primes_distinct(primes, bits, 2, iters, e);
+  mpz_set(p, primes[0]);
+  mpz_set(q, primes[1]);
+  mpz_clear(primes[0]);
+  mpz_clear(primes[1]);
+}
 
+// draws a random public exponent of about nbits bits coprime to lambda(n),
+// giving up (and leaving e as it was) after nbits tries
+static void make_e(mpz_t e, mpz_t lambda_n, uint64_t nbits) {
   uint64_t counter = 0;
   while (counter < nbits) // iterating for "around nbits"
   {
     mpz_t rand_num;
     mpz_init(rand_num);
     mpz_urandomb(rand_num, state, nbits);
+    STAT_INC(STAT_E_TRIED);
 
     mpz_t gcd_rand_lambda_n;
     mpz_init(gcd_rand_lambda_n);
@@ -83,17 +207,149 @@ void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits,
       mpz_set(e, rand_num); // rand_num is the public exponent
       mpz_clear(gcd_rand_lambda_n);
       mpz_clear(rand_num);
-      mpz_clear(lambda_n);
       return;
     }
     mpz_clear(gcd_rand_lambda_n);
     mpz_clear(rand_num);
     counter += 1;
   }
+}
+
+void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits,
+                  uint64_t iters) {
+  STAT_TIMER_START(start);
+  uint64_t p_upper =
+      (3 * nbits / 4); // credit to TA Sanjana Patil that helped me understand
+                       // how pbits and qbits are derived from nbits
+  uint64_t p_lower = (nbits / 4);
+
+  uint64_t pbits = (randstate_random() % (p_upper - p_lower)) +
+                   p_lower; // RNG code based on code from Tutor Ben Grant
+  uint64_t qbits = nbits - pbits;
+
+  // making p,q, n (p x q)
+  if (keygen_threads > 0) {
+    make_pq_parallel(p, q, pbits, qbits, iters, NULL);
+  } else {
+    make_prime(p, pbits, iters);
+    make_prime(q, qbits, iters);
+  }
+  mpz_mul(n, p, q);
+
+  mpz_t lambda_n; // carmichael function
+  mpz_init(lambda_n);
+  lambda(lambda_n, p, q);
+  make_e(e, lambda_n, nbits);
   mpz_clear(lambda_n);
+  STAT_TIMER_STOP(TIMER_MAKE_PUB, start);
   return;
 }
 
+void rsa_make_pub_fixed(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits,
+                        uint64_t iters) {
+  STAT_TIMER_START(start);
+  uint64_t p_upper = (3 * nbits / 4); // same split as rsa_make_pub
+  uint64_t p_lower = (nbits / 4);
+
+  uint64_t pbits = (randstate_random() % (p_upper - p_lower)) + p_lower;
+  uint64_t qbits = nbits - pbits;
+
+  // e is fixed, so instead of searching for e we keep drawing primes until
+  // gcd(e, p - 1) = gcd(e, q - 1) = 1, which is gcd(e, lambda(n)) = 1
+  mpz_t tot;
+  mpz_init(tot);
+  mpz_t g;
+  mpz_init(g);
+
+  if (keygen_threads > 0) {
+    make_pq_parallel(p, q, pbits, qbits, iters, e);
+  } else {
+    do {
+      make_prime(p, pbits, iters);
+      mpz_sub_ui(tot, p, 1);
+      gcd(g, e, tot);
+      STAT_ADD(STAT_E_REJECTED, mpz_cmp_ui(g, 1) != 0);
+    } while (mpz_cmp_ui(g, 1) != 0);
+
+    do {
+      make_prime(q, qbits, iters);
+      mpz_sub_ui(tot, q, 1);
+      gcd(g, e, tot);
+      STAT_ADD(STAT_E_REJECTED, mpz_cmp_ui(g, 1) != 0);
+    } while ((mpz_cmp_ui(g, 1) != 0) || (mpz_cmp(p, q) == 0));
+  }
+
+  mpz_mul(n, p, q);
+
+  mpz_clear(tot);
+  mpz_clear(g);
+  STAT_TIMER_STOP(TIMER_MAKE_PUB, start);
+}
+
+// draws count distinct primes for a multi-prime key, splitting nbits as
+// evenly as possible between them, with gcd(e, p - 1) = 1 for each prime p
+// as well unless e is NULL
+static void make_balanced_primes(mpz_t *primes, uint64_t count,
+                                 uint64_t nbits, uint64_t iters, mpz_t e) {
+  uint64_t bits[RSA_MAX_PRIMES];
+  for (uint64_t i = 0; i < count; i++) {
+    bits[i] = (nbits / count) + ((i < (nbits % count)) ? 1 : 0);
+  }
+  if (keygen_threads > 0) {
+    make_primes_distinct(primes, bits, count, iters, e);
+    return;
+  }
+
+  mpz_t tot;
+  mpz_init(tot);
+  mpz_t g;
+  mpz_init(g);
+  for (uint64_t i = 0; i < count; i++) {
+    bool usable;
+    do {
+      make_prime(primes[i], bits[i], iters);
+      usable = primes_distinct(primes, i + 1);
+      if (usable && (e != NULL)) {
+        mpz_sub_ui(tot, primes[i], 1);
+        gcd(g, e, tot);
+        usable = (mpz_cmp_ui(g, 1) == 0);
+        STAT_ADD(STAT_E_REJECTED, !usable);
+      }
+    } while (!usable);
+  }
+  mpz_clear(tot);
+  mpz_clear(g);
+}
+
+void rsa_make_pub_primes(mpz_t *primes, uint64_t count, mpz_t n, mpz_t e,
+                         uint64_t nbits, uint64_t iters) {
+  STAT_TIMER_START(start);
+  make_balanced_primes(primes, count, nbits, iters, NULL);
+  mpz_set(n, primes[0]);
+  for (uint64_t i = 1; i < count; i++) {
+    mpz_mul(n, n, primes[i]);
+  }
+
+  mpz_t lambda_n;
+  mpz_init(lambda_n);
+  lambda_primes(lambda_n, primes, count);
+  make_e(e, lambda_n, nbits);
+  mpz_clear(lambda_n);
+  STAT_TIMER_STOP(TIMER_MAKE_PUB, start);
+}
+
+void rsa_make_pub_primes_fixed(mpz_t *primes, uint64_t count, mpz_t n,
+                               mpz_t e, uint64_t nbits, uint64_t iters) {
+  STAT_TIMER_START(start);
+  // as in rsa_make_pub_fixed, primes are redrawn until gcd(e, lambda(n)) = 1
+  make_balanced_primes(primes, count, nbits, iters, e);
+  mpz_set(n, primes[0]);
+  for (uint64_t i = 1; i < count; i++) {
+    mpz_mul(n, n, primes[i]);
+  }
+  STAT_TIMER_STOP(TIMER_MAKE_PUB, start);
+}
+
 void rsa_write_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile) {
   // writing to pbfile, setting file stream to pbfile file pointer
   gmp_fprintf(pbfile, "%Zx\n", n);
@@ -102,22 +358,43 @@ void rsa_write_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile) {
   gmp_fprintf(pbfile, "%s\n", username);
 }
 
-void rsa_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile) {
+bool rsa_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile) {
+  if (keyfile_detect(pbfile)) { // written by keygen -B
+    return keyfile_read_pub(n, e, s, username, pbfile);
+  }
+
   // reading and storing variables from pbfile, setting file stream to pbfile
   // file pointer
-  gmp_fscanf(pbfile, "%Zx\n", n);
-  gmp_fscanf(pbfile, "%Zx\n", e);
-  gmp_fscanf(pbfile, "%Zx\n", s);
-  gmp_fscanf(pbfile, "%s\n", username);
+  return (gmp_fscanf(pbfile, "%Zx\n", n) == 1) &&
+         (gmp_fscanf(pbfile, "%Zx\n", e) == 1) &&
+         (gmp_fscanf(pbfile, "%Zx\n", s) == 1) &&
+         (gmp_fscanf(pbfile, "%s\n", username) == 1);
 }
 
 void rsa_make_priv(mpz_t d, mpz_t e, mpz_t p, mpz_t q) {
   // private key is the inverse of (e mod lambda(n))
+  STAT_TIMER_START(start);
   mpz_t lambda_n;
   mpz_init(lambda_n);
   lambda(lambda_n, p, q);
   mod_inverse(d, e, lambda_n);
   mpz_clear(lambda_n);
+  STAT_TIMER_STOP(TIMER_MAKE_PRIV, start);
+}
+
+void rsa_make_crt(mpz_t dp, mpz_t dq, mpz_t qinv, mpz_t d, mpz_t p,
+                  mpz_t q) {
+  // dp = d mod (p - 1), dq = d mod (q - 1)
+  mpz_t tot;
+  mpz_init(tot);
+  mpz_sub_ui(tot, p, 1);
+  mpz_mod(dp, d, tot);
+  mpz_sub_ui(tot, q, 1);
+  mpz_mod(dq, d, tot);
+  mpz_clear(tot);
+
+  // qinv = q^-1 mod p, used to recombine the two halves
+  mod_inverse(qinv, q, p);
 }
 
 void rsa_write_priv(mpz_t n, mpz_t d, FILE *pvfile) {
@@ -126,51 +403,570 @@ void rsa_write_priv(mpz_t n, mpz_t d, FILE *pvfile) {
   gmp_fprintf(pvfile, "%Zx\n", d);
 }
 
-void rsa_read_priv(mpz_t n, mpz_t d, FILE *pvfile) {
+bool rsa_read_priv(mpz_t n, mpz_t d, FILE *pvfile) {
+  if (keyfile_detect(pvfile)) { // written by keygen -B
+    return keyfile_read_priv(n, d, NULL, NULL, NULL, NULL, pvfile);
+  }
+
   // reading and storing variables from pvfile, setting file stream to pvfile
   // file pointer
-  gmp_fscanf(pvfile, "%Zx\n", n);
-  gmp_fscanf(pvfile, "%Zx\n", d);
+  return (gmp_fscanf(pvfile, "%Zx\n", n) == 1) &&
+         (gmp_fscanf(pvfile, "%Zx\n", d) == 1);
+}
+
+void rsa_write_priv_crt(mpz_t n, mpz_t d, mpz_t p, mpz_t q, mpz_t dp,
+                        mpz_t dq, mpz_t qinv, FILE *pvfile) {
+  // n and d come first so older readers can still use the file
+  rsa_write_priv(n, d, pvfile);
+  gmp_fprintf(pvfile, "%Zx\n", p);
+  gmp_fprintf(pvfile, "%Zx\n", q);
+  gmp_fprintf(pvfile, "%Zx\n", dp);
+  gmp_fprintf(pvfile, "%Zx\n", dq);
+  gmp_fprintf(pvfile, "%Zx\n", qinv);
+}
+
+bool rsa_read_priv_crt(mpz_t n, mpz_t d, mpz_t p, mpz_t q, mpz_t dp, mpz_t dq,
+                       mpz_t qinv, FILE *pvfile) {
+  mpz_t primes[RSA_MAX_PRIMES], exps[RSA_MAX_PRIMES], coeffs[RSA_MAX_PRIMES];
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_inits(primes[i], exps[i], coeffs[i], NULL);
+  }
+  bool crt = (rsa_read_priv_primes(n, d, primes, exps, coeffs, pvfile) == 2);
+  if (crt) {
+    mpz_set(p, primes[0]);
+    mpz_set(q, primes[1]);
+    mpz_set(dp, exps[0]);
+    mpz_set(dq, exps[1]);
+    mpz_set(qinv, coeffs[0]);
+  }
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_clears(primes[i], exps[i], coeffs[i], NULL);
+  }
+  return crt;
+}
+
+void rsa_make_priv_primes(mpz_t d, mpz_t e, mpz_t *primes, uint64_t count) {
+  // the same as rsa_make_priv, with lambda(n) over every prime
+  STAT_TIMER_START(start);
+  mpz_t lambda_n;
+  mpz_init(lambda_n);
+  lambda_primes(lambda_n, primes, count);
+  mod_inverse(d, e, lambda_n);
+  mpz_clear(lambda_n);
+  STAT_TIMER_STOP(TIMER_MAKE_PRIV, start);
+}
+
+void rsa_make_crt_primes(mpz_t *exps, mpz_t *coeffs, mpz_t d, mpz_t *primes,
+                         uint64_t count) {
+  rsa_make_crt(exps[0], exps[1], coeffs[0], d, primes[0], primes[1]);
+  mpz_set_ui(coeffs[1], 0);
+
+  // every further prime r gets d mod (r - 1) and the inverse of the product
+  // of the primes before it mod r
+  mpz_t product;
+  mpz_init(product);
+  mpz_mul(product, primes[0], primes[1]);
+  mpz_t t;
+  mpz_init(t);
+  for (uint64_t i = 2; i < count; i++) {
+    mpz_sub_ui(t, primes[i], 1);
+    mpz_mod(exps[i], d, t);
+    mpz_mod(t, product, primes[i]);
+    mod_inverse(coeffs[i], t, primes[i]);
+    mpz_mul(product, product, primes[i]);
+  }
+  mpz_clear(product);
+  mpz_clear(t);
+}
+
+void rsa_write_priv_primes(mpz_t n, mpz_t d, mpz_t *primes, mpz_t *exps,
+                           mpz_t *coeffs, uint64_t count, FILE *pvfile) {
+  rsa_write_priv_crt(n, d, primes[0], primes[1], exps[0], exps[1], coeffs[0],
+                     pvfile);
+  for (uint64_t i = 2; i < count; i++) {
+    gmp_fprintf(pvfile, "%Zx\n", primes[i]);
+    gmp_fprintf(pvfile, "%Zx\n", exps[i]);
+    gmp_fprintf(pvfile, "%Zx\n", coeffs[i]);
+  }
+}
+
+uint64_t rsa_read_priv_primes(mpz_t n, mpz_t d, mpz_t *primes, mpz_t *exps,
+                              mpz_t *coeffs, FILE *pvfile) {
+  uint64_t count = 0;
+  if (keyfile_detect(pvfile)) { // written by keygen -B, always with CRT
+    if (!keyfile_read_priv(n, d, primes, exps, coeffs, &count, pvfile)) {
+      return 0;
+    }
+  } else {
+    rsa_read_priv(n, d, pvfile);
+
+    // old private key files stop after d
+    if ((gmp_fscanf(pvfile, "%Zx\n", primes[0]) != 1) ||
+        (gmp_fscanf(pvfile, "%Zx\n", primes[1]) != 1) ||
+        (gmp_fscanf(pvfile, "%Zx\n", exps[0]) != 1) ||
+        (gmp_fscanf(pvfile, "%Zx\n", exps[1]) != 1) ||
+        (gmp_fscanf(pvfile, "%Zx\n", coeffs[0]) != 1)) {
+      return 0;
+    }
+    mpz_set_ui(coeffs[1], 0);
+
+    // and two-prime ones after qinv
+    count = 2;
+    while ((count < RSA_MAX_PRIMES) &&
+           (gmp_fscanf(pvfile, "%Zx\n", primes[count]) == 1) &&
+           (gmp_fscanf(pvfile, "%Zx\n", exps[count]) == 1) &&
+           (gmp_fscanf(pvfile, "%Zx\n", coeffs[count]) == 1)) {
+      count += 1;
+    }
+  }
+  if (count < 2) {
+    return 0;
+  }
+
+  // only trust the CRT components if the primes actually factor n
+  mpz_t product;
+  mpz_init_set(product, primes[0]);
+  for (uint64_t i = 1; i < count; i++) {
+    mpz_mul(product, product, primes[i]);
+  }
+  bool consistent = (mpz_cmp(product, n) == 0);
+  mpz_clear(product);
+  return consistent ? count : 0;
 }
 
 void rsa_encrypt(mpz_t c, mpz_t m, mpz_t e, mpz_t n) { pow_mod(c, m, e, n); }
 
-void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
-  uint64_t k = (mpz_sizeinbase(n, 2) - 1) /
-               8; // finding the size of each block (must be less than n)
-  uint8_t *kblock = (uint8_t *)calloc(
-      k, sizeof(uint8_t)); // creating an empty array of size k
+// sets up the Montgomery context of a key modulus, borrowing the constants
+// stored in a binary key file when one was read
+static void key_mont_init(mont_ctx *ctx, mpz_t n) {
+  if (!keyfile_mont(ctx, n)) {
+    mont_init(ctx, n);
+  }
+}
+
+// the same for the window schedule of a key exponent
+static void key_sched_init(mont_sched *sched, mpz_t d) {
+  if (!keyfile_sched(sched, d)) {
+    mont_sched_init(sched, d);
+  }
+}
+
+// clears what key_mont_init() set up, handing borrowed constants back
+static void key_mont_clear(mont_ctx *ctx) {
+  keyfile_release_mont(ctx);
+  mont_clear(ctx);
+}
+
+// the same for key_sched_init()
+static void key_sched_clear(mont_sched *sched) {
+  keyfile_release_sched(sched);
+  mont_sched_clear(sched);
+}
+
+typedef struct {
+  mpz_ptr n, e;
+  uint64_t k;       // block size, each block carries k - 1 bytes of input
+  const uint8_t *input; // the bytes read for this batch
+  size_t length;    // number of bytes in input
+  uint8_t *kblocks; // one k-byte scratch block per worker
+  numtheory_ctx *scratch; // one scratch context per worker, holds its message
+  mpz_t *out;
+  uint64_t base;    // index in out of the first block of the batch
+  mont_ctx mont;    // shared by every worker, set up once per file
+  mont_sched sched; // window schedule of e, also shared
+  bool small_e;     // e fits in MONT_SMALL_EXPONENT_BITS
+} encrypt_batch;
+
+static void encrypt_task(void *arg, uint64_t index, uint64_t worker) {
+  STAT_TIMER_START(start);
+  encrypt_batch *batch = (encrypt_batch *)arg;
+  uint64_t k = batch->k;
+  uint8_t *kblock = batch->kblocks + (worker * k);
+
+  // the last block of the file may be shorter than k - 1 bytes (even empty)
+  size_t offset = index * (k - 1);
+  size_t j = batch->length - offset;
+  if (j > (k - 1)) {
+    j = k - 1;
+  }
 
   kblock[0] = 0xFF; // setting the first index of kblock to 0xFF to avoid
                     // encrypting issues
+  memcpy(kblock + 1, batch->input + offset, j);
+  numtheory_ctx *ctx = &batch->scratch[worker];
+  mpz_ptr message = ctx->t[0];
+  mpz_import(message, j + 1, 1, sizeof(uint8_t), 1, 0,
+             kblock); // we do j+1 because we want to include the 0xFF byte
 
-  while (1) // while true (we will break out manually)
-  {
+  // the same as rsa_encrypt(), small exponents such as 65537 take the short
+  // square-and-multiply chain
+  mp_limb_t *limbs =
+      numtheory_ctx_scratch(ctx, mont_powm_scratch_size(&batch->mont));
+  if (batch->small_e) {
+    mont_powm_ui(&batch->mont, batch->out[batch->base + index], message,
+                 mpz_get_ui(batch->e), limbs);
+  } else {
+    mont_powm_sched(&batch->mont, batch->out[batch->base + index], message,
+                    &batch->sched, limbs);
+  }
+  pow_mod_check(batch->out[batch->base + index], message, batch->e, batch->n);
+  STAT_TIMER_STOP(TIMER_ENCRYPT_BLOCK, start);
+}
+
+static void encrypt_batch_init(encrypt_batch *batch, mpz_t n, mpz_t e,
+                               uint64_t threads, uint64_t cap) {
+  batch->n = n;
+  batch->e = e;
+  batch->k = (mpz_sizeinbase(n, 2) - 1) /
+             8; // finding the size of each block (must be less than n)
+  key_mont_init(&batch->mont, n);
+  key_sched_init(&batch->sched, e);
+  batch->small_e = (mpz_sizeinbase(e, 2) <= MONT_SMALL_EXPONENT_BITS);
+  batch->kblocks = (uint8_t *)calloc(threads * batch->k, sizeof(uint8_t));
+  batch->scratch = (numtheory_ctx *)calloc(threads, sizeof(numtheory_ctx));
+  batch->out = (mpz_t *)calloc(cap, sizeof(mpz_t));
+  batch->base = 0;
+  uint64_t bits = mpz_sizeinbase(n, 2);
+  for (uint64_t i = 0; i < threads; i++) {
+    numtheory_ctx_init(&batch->scratch[i], bits);
+  }
+  for (uint64_t i = 0; i < cap; i++) {
+    mpz_init2(batch->out[i], bits); // sized up front, never reallocated
+  }
+}
+
+static void encrypt_batch_clear(encrypt_batch *batch, uint64_t threads,
+                                uint64_t cap) {
+  for (uint64_t i = 0; i < threads; i++) {
+    numtheory_ctx_clear(&batch->scratch[i]);
+  }
+  for (uint64_t i = 0; i < cap; i++) {
+    mpz_clear(batch->out[i]);
+  }
+  key_mont_clear(&batch->mont);
+  key_sched_clear(&batch->sched);
+  free(batch->kblocks);
+  free(batch->scratch);
+  free(batch->out);
+}
+
+// the most bytes format_block() can write for one block
+static uint64_t max_block_bytes(rsa_format_t format,
+                                container_header *header) {
+  if (format == RSA_FORMAT_BINARY) {
+    return header->record_size;
+  }
+  return (2 * header->record_size) + 1; // hex digits and a newline
+}
 
-    // j = numbers of bytes read (fread returns bytes read)
-    size_t j = fread(kblock + 1, sizeof(uint8_t), k - 1, infile);
-    mpz_t message;
-    mpz_init(message);
-    mpz_import(message, j + 1, 1, sizeof(uint8_t), 1, 0,
-               kblock); // we do j+1 because we want to
+// writes one ciphertext block in the given format, returns its length
+static size_t format_block(rsa_format_t format, uint8_t *dst, mpz_t c,
+                           container_header *header) {
+  if (format == RSA_FORMAT_BINARY) {
+    container_export(dst, header->record_size, c);
+    return header->record_size;
+  }
+  size_t length = hex_encode_mpz(dst, c); // same digits as "%Zx"
+  dst[length] = '\n';
+  return length + 1;
+}
 
-    mpz_t cipher;
-    mpz_init(cipher);
+// encrypts a mapped regular file into a mapped regular file, returns false
+// (having written nothing) if either side cannot be mapped
+static bool encrypt_mapped(FILE *infile, FILE *outfile, mpz_t n, mpz_t e,
+                           pool_t *pool) {
+  mapped_file in;
+  if (same_file(infile, outfile) || !map_input(&in, infile)) {
+    return false;
+  }
 
-    rsa_encrypt(cipher, message, e, n);
+  uint64_t threads = pool_threads(pool);
+  uint64_t cap = threads * BATCH_PER_THREAD;
+  encrypt_batch batch;
+  encrypt_batch_init(&batch, n, e, threads, cap);
+  uint64_t k = batch.k;
 
-    gmp_fprintf(outfile, "%Zx\n", cipher);
+  // every k - 1 bytes make a block, plus the final short (maybe empty) one
+  uint64_t blocks = (in.length / (k - 1)) + 1;
 
-    mpz_clear(message);
-    mpz_clear(cipher);
-    if (j < (k - 1)) // if j is less than k-1, than it means that we read the
-                     // finaly block of the file
-    {
-      break;
+  container_header header;
+  container_init(&header, n);
+  header.block_count = blocks;
+  uint64_t prefix =
+      (file_format == RSA_FORMAT_BINARY) ? CONTAINER_HEADER_SIZE : 0;
+
+  mapped_file out;
+  if (!map_output(&out, outfile,
+                  prefix +
+                      (blocks * max_block_bytes(file_format, &header)))) {
+    encrypt_batch_clear(&batch, threads, cap);
+    unmap_input(&in, infile, 0);
+    return false;
+  }
+
+  if (file_format == RSA_FORMAT_BINARY) {
+    container_encode(out.data, &header);
+  }
+
+  size_t used = prefix;
+  for (uint64_t base = 0; base < blocks; base += cap) {
+    batch.input = in.data + (base * (k - 1));
+    batch.length = in.length - (base * (k - 1));
+    uint64_t count = ((blocks - base) < cap) ? (blocks - base) : cap;
+
+    pool_run(pool, encrypt_task, &batch, count);
+
+    for (uint64_t i = 0; i < count; i++) {
+      used +=
+          format_block(file_format, out.data + used, batch.out[i], &header);
     }
   }
 
-  free(kblock);
+  unmap_output(&out, outfile, used);
+  unmap_input(&in, infile, in.length);
+  encrypt_batch_clear(&batch, threads, cap);
+  return true;
+}
+
+// the streaming pipeline of rsa_encrypt_file(), slot i owns the input bytes
+// and out entries from i * cap
+typedef struct {
+  io_reader_t *reader;
+  io_writer_t *writer;
+  pool_t *pool;
+  encrypt_batch *batch;
+  uint64_t cap;     // blocks per slot
+  uint8_t *input;   // cap * (k - 1) bytes per slot
+  size_t *lengths;  // bytes read into each slot
+  uint64_t *counts; // blocks in each slot
+  container_header *header;
+  uint8_t *output; // the writer's formatted blocks
+  uint64_t total;  // number of blocks written
+} encrypt_stream;
+
+static bool encrypt_read(void *arg, uint64_t slot) {
+  encrypt_stream *stream = (encrypt_stream *)arg;
+  uint64_t bytes = stream->cap * (stream->batch->k - 1);
+
+  // length = numbers of bytes read, short only at the end of the input
+  size_t length =
+      io_read(stream->reader, stream->input + (slot * bytes), bytes);
+  stream->lengths[slot] = length;
+  stream->counts[slot] = stream->cap;
+  if (length < bytes) {
+    // if fewer bytes than a full batch were read, we reached the end of the
+    // file and the final (possibly empty) block is the short one
+    stream->counts[slot] = (length / (stream->batch->k - 1)) + 1;
+    return false;
+  }
+  return true;
+}
+
+static void encrypt_compute(void *arg, uint64_t slot) {
+  encrypt_stream *stream = (encrypt_stream *)arg;
+  encrypt_batch *batch = stream->batch;
+  batch->input = stream->input + (slot * stream->cap * (batch->k - 1));
+  batch->length = stream->lengths[slot];
+  batch->base = slot * stream->cap;
+  pool_run(stream->pool, encrypt_task, batch, stream->counts[slot]);
+}
+
+static bool encrypt_write(void *arg, uint64_t slot) {
+  encrypt_stream *stream = (encrypt_stream *)arg;
+  mpz_t *out = stream->batch->out + (slot * stream->cap);
+  size_t used = 0;
+  for (uint64_t i = 0; i < stream->counts[slot]; i++) {
+    used += format_block(file_format, stream->output + used, out[i],
+                         stream->header);
+  }
+  stream->total += stream->counts[slot];
+  return io_write(stream->writer, stream->output, used);
+}
+
+bool rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
+  pool_t *pool = start_pool();
+
+  // regular files go straight through memory mappings
+  if (file_mmap && encrypt_mapped(infile, outfile, n, e, pool)) {
+    pool_delete(pool);
+    return true;
+  }
+
+  // binary output starts with a header and uses fixed-width records
+  container_header header;
+  container_init(&header, n);
+
+  // a reader thread fills batches of whole blocks, the pool encrypts them,
+  // and a writer thread emits them in order, so the output does not depend
+  // on the number of threads and the input may be a pipe
+  uint64_t k = (mpz_sizeinbase(n, 2) - 1) / 8;
+  uint64_t cap = pipeline_cap(pool, (k - 1) + (2 * header.record_size));
+  uint64_t threads = pool_threads(pool);
+  encrypt_batch batch;
+  encrypt_batch_init(&batch, n, e, threads, PIPELINE_SLOTS * cap);
+
+  encrypt_stream stream = {
+      .pool = pool,
+      .batch = &batch,
+      .cap = cap,
+      .header = &header,
+      .total = 0,
+  };
+  stream.input = (uint8_t *)malloc(PIPELINE_SLOTS * cap * (k - 1));
+  stream.lengths = (size_t *)calloc(PIPELINE_SLOTS, sizeof(size_t));
+  stream.counts = (uint64_t *)calloc(PIPELINE_SLOTS, sizeof(uint64_t));
+  stream.output =
+      (uint8_t *)malloc(cap * max_block_bytes(file_format, &header));
+
+  if (file_format == RSA_FORMAT_BINARY) {
+    container_write_header(&header, outfile);
+  }
+  stream.reader = io_reader_open(infile, io_chunk_size(), IO_DEPTH);
+  stream.writer = io_writer_open(outfile, io_chunk_size(), IO_DEPTH);
+  pipeline_run(PIPELINE_SLOTS, encrypt_read, encrypt_compute, encrypt_write,
+               &stream);
+  bool read_ok = io_reader_close(stream.reader);
+  bool write_ok = io_writer_close(stream.writer);
+  if (file_format == RSA_FORMAT_BINARY) {
+    container_patch_count(outfile, stream.total);
+  }
+
+  encrypt_batch_clear(&batch, threads, PIPELINE_SLOTS * cap);
+  free(stream.input);
+  free(stream.lengths);
+  free(stream.counts);
+  free(stream.output);
+  pool_delete(pool);
+  return read_ok && write_ok;
+}
+
+// the blocks of every recipient of rsa_encrypt_file_multi in one pool run
+typedef struct {
+  encrypt_batch *batches;
+  uint64_t *first; // index of the first task of each recipient, plus the end
+  uint64_t count;  // number of recipients
+} multi_batch;
+
+static void multi_task(void *arg, uint64_t index, uint64_t worker) {
+  multi_batch *multi = (multi_batch *)arg;
+  uint64_t r = 0;
+  while (index >= multi->first[r + 1]) {
+    r += 1;
+  }
+  encrypt_task(&multi->batches[r], index - multi->first[r], worker);
+}
+
+bool rsa_encrypt_file_multi(FILE *infile, FILE **outfiles, mpz_t *n, mpz_t *e,
+                            uint64_t count) {
+  pool_t *pool = start_pool();
+  uint64_t threads = pool_threads(pool);
+
+  // the input is read once in chunks of about a batch of the largest
+  // blocks, every recipient cuts its own blocks from it and carries the
+  // bytes of a partial block over to the next chunk
+  uint64_t kmax = 0;
+  for (uint64_t r = 0; r < count; r++) {
+    uint64_t k = (mpz_sizeinbase(n[r], 2) - 1) / 8;
+    kmax = (k > kmax) ? k : kmax;
+  }
+  uint64_t chunk_size = threads * BATCH_PER_THREAD * (kmax - 1);
+  uint8_t *chunk = (uint8_t *)malloc(chunk_size);
+
+  multi_batch multi = {
+      .batches = (encrypt_batch *)calloc(count, sizeof(encrypt_batch)),
+      .first = (uint64_t *)calloc(count + 1, sizeof(uint64_t)),
+      .count = count,
+  };
+  uint8_t **input = (uint8_t **)calloc(count, sizeof(uint8_t *));
+  uint8_t **output = (uint8_t **)calloc(count, sizeof(uint8_t *));
+  uint64_t *caps = (uint64_t *)calloc(count, sizeof(uint64_t));
+  uint64_t *carry = (uint64_t *)calloc(count, sizeof(uint64_t));
+  uint64_t *totals = (uint64_t *)calloc(count, sizeof(uint64_t));
+  container_header *headers =
+      (container_header *)calloc(count, sizeof(container_header));
+  io_writer_t **writers = (io_writer_t **)calloc(count, sizeof(io_writer_t *));
+
+  // the writers share the space of one
+  size_t writer_chunk = io_chunk_size() / count;
+  if (writer_chunk < IO_MIN_CHUNK) {
+    writer_chunk = IO_MIN_CHUNK;
+  }
+
+  for (uint64_t r = 0; r < count; r++) {
+    uint64_t k = (mpz_sizeinbase(n[r], 2) - 1) / 8;
+    caps[r] = (chunk_size / (k - 1)) + 2; // blocks in a carry and a chunk
+    encrypt_batch_init(&multi.batches[r], n[r], e[r], threads, caps[r]);
+    input[r] = (uint8_t *)malloc(chunk_size + k);
+    multi.batches[r].input = input[r];
+    container_init(&headers[r], n[r]);
+    output[r] = (uint8_t *)malloc(caps[r] *
+                                  max_block_bytes(file_format, &headers[r]));
+    if (file_format == RSA_FORMAT_BINARY) {
+      container_write_header(&headers[r], outfiles[r]);
+    }
+    writers[r] = io_writer_open(outfiles[r], writer_chunk, IO_DEPTH);
+  }
+  io_reader_t *reader = io_reader_open(infile, io_chunk_size(), IO_DEPTH);
+
+  bool done = false;
+  while (!done) {
+    size_t length = io_read(reader, chunk, chunk_size);
+    done = (length < chunk_size);
+
+    // every recipient takes its whole blocks, plus the final short (maybe
+    // empty) one at the end of the input, exactly as rsa_encrypt_file does
+    for (uint64_t r = 0; r < count; r++) {
+      encrypt_batch *batch = &multi.batches[r];
+      memcpy(input[r] + carry[r], chunk, length);
+      batch->length = carry[r] + length;
+      uint64_t blocks = batch->length / (batch->k - 1);
+      if (done) {
+        blocks += 1;
+      }
+      multi.first[r + 1] = multi.first[r] + blocks;
+    }
+    pool_run(pool, multi_task, &multi, multi.first[count]);
+
+    for (uint64_t r = 0; r < count; r++) {
+      encrypt_batch *batch = &multi.batches[r];
+      uint64_t blocks = multi.first[r + 1] - multi.first[r];
+      size_t used = 0;
+      for (uint64_t i = 0; i < blocks; i++) {
+        used += format_block(file_format, output[r] + used, batch->out[i],
+                             &headers[r]);
+      }
+      io_write(writers[r], output[r], used); // failures show at the close
+      totals[r] += blocks;
+
+      // keep the bytes of the partial block for the next chunk
+      uint64_t consumed = blocks * (batch->k - 1);
+      carry[r] = (consumed < batch->length) ? batch->length - consumed : 0;
+      memmove(input[r], input[r] + consumed, carry[r]);
+    }
+  }
+
+  bool ok = io_reader_close(reader);
+  for (uint64_t r = 0; r < count; r++) {
+    ok = io_writer_close(writers[r]) && ok;
+    if (file_format == RSA_FORMAT_BINARY) {
+      container_patch_count(outfiles[r], totals[r]);
+    }
+    encrypt_batch_clear(&multi.batches[r], threads, caps[r]);
+    free(input[r]);
+    free(output[r]);
+  }
+  free(multi.batches);
+  free(multi.first);
+  free(input);
+  free(output);
+  free(caps);
+  free(carry);
+  free(totals);
+  free(headers);
+  free(writers);
+  free(chunk);
+  pool_delete(pool);
+  return ok;
 }
 
 void rsa_decrypt(
@@ -180,60 +976,1159 @@ void rsa_decrypt(
   pow_mod(m, c, d, n);
 }
 
-void rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
-
-  uint64_t k = (mpz_sizeinbase(n, 2) - 1) / 8; // same thing as encrypt_file
-  uint8_t *kblock = (uint8_t *)calloc(
-      k, sizeof(uint8_t)); // creating an empty array of size k
+// Garner recombination: h = qinv * (m1 - m2) mod p, m = m2 + h * q
+// h is a caller supplied temporary
+static void crt_combine(mpz_t m, mpz_t m1, mpz_t m2, mpz_t p, mpz_t q,
+                        mpz_t qinv, mpz_t h) {
+  mpz_sub(h, m1, m2);
+  mpz_mul(h, h, qinv);
+  mpz_mod(h, h, p);
+  mpz_mul(h, h, q);
+  mpz_add(m, m2, h);
+}
 
-  while (1) // while true (we will break out manually)
-  {
+void rsa_decrypt_crt(mpz_t m, mpz_t c, mpz_t p, mpz_t q, mpz_t dp, mpz_t dq,
+                     mpz_t qinv) {
+  // m1 = c^dp mod p and m2 = c^dq mod q, each on a half-size modulus
+  mpz_t cmod;
+  mpz_init(cmod);
 
-    mpz_t cipher;
-    mpz_init(cipher);
+  mpz_t m1;
+  mpz_init(m1);
+  mpz_mod(cmod, c, p);
+  pow_mod(m1, cmod, dp, p);
 
-    // scan in a block of text and store into cipher (mpz)
-    gmp_fscanf(infile, "%Zx\n", cipher);
+  mpz_t m2;
+  mpz_init(m2);
+  mpz_mod(cmod, c, q);
+  pow_mod(m2, cmod, dq, q);
 
-    size_t bytes_read; // used to read how many bytes were read in mpz_export
+  crt_combine(m, m1, m2, p, q, qinv, cmod);
 
-    mpz_t deciphered_m;
-    mpz_init(deciphered_m);
-    rsa_decrypt(deciphered_m, cipher, d,
-                n); // decrypt cipher and store into deciphered_m
+  mpz_clear(cmod);
+  mpz_clear(m1);
+  mpz_clear(m2);
+}
 
-    mpz_export(kblock, &bytes_read, 1, sizeof(uint8_t), 1, 0,
-               deciphered_m); // bytes_read should be k-1 unless last block
+// Garner recombination of the primes after p and q, as in PKCS #1: with r
+// the product of the primes before primes[i], h = (m_i - m) * coeffs[i] mod
+// primes[i] and m = m + h * r
+// h and r are caller supplied temporaries
+static void crt_combine_more(mpz_t m, mpz_ptr *residues, mpz_ptr *primes,
+                             mpz_ptr *coeffs, uint64_t count, mpz_t h,
+                             mpz_t r) {
+  if (count < 3) {
+    return;
+  }
+  mpz_mul(r, primes[0], primes[1]);
+  for (uint64_t i = 2; i < count; i++) {
+    mpz_sub(h, residues[i], m);
+    mpz_mul(h, h, coeffs[i]);
+    mpz_mod(h, h, primes[i]);
+    mpz_mul(h, h, r);
+    mpz_add(m, m, h);
+    if ((i + 1) < count) {
+      mpz_mul(r, r, primes[i]);
+    }
+  }
+}
 
-    if (bytes_read < (k - 1)) { // if the amount of bytes read are less than k,
-                                // then we reached the last byte of the file
+// the private key material needed to decrypt a block, plain or CRT, with a
+// Montgomery context per modulus and a window schedule per exponent that are
+// set up once for the whole file
+typedef struct {
+  mpz_ptr n, d;
+  uint64_t primes; // 0 for plain decryption, else the number of primes
+  mpz_ptr prime[RSA_MAX_PRIMES], exp[RSA_MAX_PRIMES], coeff[RSA_MAX_PRIMES];
+  mont_ctx mont_n, mont[RSA_MAX_PRIMES];
+  mont_sched sched_d, sched[RSA_MAX_PRIMES];
+} priv_parts;
 
-      fwrite(kblock + 1, sizeof(uint8_t), bytes_read - 1, outfile);
+// the key of a two-prime private key, laid out like rsa_make_crt_primes()
+static priv_parts priv_parts_crt(mpz_t n, mpz_t p, mpz_t q, mpz_t dp,
+                                 mpz_t dq, mpz_t qinv) {
+  return (priv_parts){.n = n,
+                      .primes = 2,
+                      .prime = {p, q},
+                      .exp = {dp, dq},
+                      .coeff = {qinv, NULL}};
+}
 
-      mpz_clear(cipher);
-      mpz_clear(deciphered_m);
-      break;
-    }
+// the same for any number of primes
+static priv_parts priv_parts_primes(mpz_t n, mpz_t *primes, mpz_t *exps,
+                                    mpz_t *coeffs, uint64_t count) {
+  priv_parts key = {.n = n, .primes = count};
+  for (uint64_t i = 0; i < count; i++) {
+    key.prime[i] = primes[i];
+    key.exp[i] = exps[i];
+    key.coeff[i] = coeffs[i];
+  }
+  return key;
+}
 
-    fwrite(kblock + 1, sizeof(uint8_t), bytes_read - 1,
-           outfile); // help from TA Zack Jorquera
+static void priv_parts_init(priv_parts *key) {
+  if (key->primes == 0) {
+    key_mont_init(&key->mont_n, key->n);
+    key_sched_init(&key->sched_d, key->d);
+  }
+  for (uint64_t i = 0; i < key->primes; i++) {
+    key_mont_init(&key->mont[i], key->prime[i]);
+    key_sched_init(&key->sched[i], key->exp[i]);
+  }
+}
 
-    mpz_clear(cipher);
-    mpz_clear(deciphered_m);
+static void priv_parts_clear(priv_parts *key) {
+  if (key->primes == 0) {
+    key_mont_clear(&key->mont_n);
+    key_sched_clear(&key->sched_d);
   }
+  for (uint64_t i = 0; i < key->primes; i++) {
+    key_mont_clear(&key->mont[i]);
+    key_sched_clear(&key->sched[i]);
+  }
+}
 
-  free(kblock);
+// decrypts a block with pow_mod(), for the few blocks of a wrapped session
+// key that do not justify Montgomery contexts and schedules
+static void decrypt_one(mpz_t m, mpz_t c, priv_parts *key) {
+  if (key->primes == 0) {
+    rsa_decrypt(m, c, key->d, key->n);
+    return;
+  }
+  mpz_t t[RSA_MAX_PRIMES + 2];
+  mpz_ptr residues[RSA_MAX_PRIMES];
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES + 2; i++) {
+    mpz_init(t[i]);
+  }
+  mpz_ptr h = t[RSA_MAX_PRIMES];
+  for (uint64_t i = 0; i < key->primes; i++) {
+    residues[i] = t[i];
+    mpz_mod(h, c, key->prime[i]);
+    pow_mod(residues[i], h, key->exp[i], key->prime[i]);
+  }
+  crt_combine(m, residues[0], residues[1], key->prime[0], key->prime[1],
+              key->coeff[0], h);
+  crt_combine_more(m, residues, key->prime, key->coeff, key->primes, h,
+                   t[RSA_MAX_PRIMES + 1]);
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES + 2; i++) {
+    mpz_clear(t[i]);
+  }
 }
 
-void rsa_sign(mpz_t s, mpz_t m, mpz_t d, mpz_t n) {
-  mpz_powm(s, m, d, n);
-  pow_mod(s, m, d, n);
+// all temporaries come from ctx, so a warmed up context allocates nothing
+static void decrypt_block(mpz_t m, mpz_t c, priv_parts *key,
+                          numtheory_ctx *ctx) {
+  STAT_TIMER_START(start);
+  if (key->primes == 0) {
+    mont_powm_sched(
+        &key->mont_n, m, c, &key->sched_d,
+        numtheory_ctx_scratch(ctx, mont_powm_scratch_size(&key->mont_n)));
+    pow_mod_check(m, c, key->d, key->n);
+    STAT_TIMER_STOP(TIMER_DECRYPT_BLOCK, start);
+    return;
+  }
+
+  // m_i = c^d_i mod r_i for each prime r_i, in t[0] to t[primes - 1]
+  // the kernel reduces c mod r_i on the way in, unless r_i is so much
+  // smaller than n that c has over twice its limbs; those are reduced here
+  // instead, in a temporary that is already large enough
+  mpz_ptr residues[RSA_MAX_PRIMES];
+  mpz_ptr h = ctx->t[RSA_MAX_PRIMES];
+  for (uint64_t i = 0; i < key->primes; i++) {
+    residues[i] = ctx->t[i];
+    mpz_ptr ci = c;
+    if (mpz_size(c) > 2 * (size_t)key->mont[i].size) {
+      mpz_mod(h, c, key->prime[i]);
+      ci = h;
+    }
+    mont_powm_sched(
+        &key->mont[i], residues[i], ci, &key->sched[i],
+        numtheory_ctx_scratch(ctx, mont_powm_scratch_size(&key->mont[i])));
+    pow_mod_check(residues[i], ci, key->exp[i], key->prime[i]);
+  }
+
+  crt_combine(m, residues[0], residues[1], key->prime[0], key->prime[1],
+              key->coeff[0], h);
+  crt_combine_more(m, residues, key->prime, key->coeff, key->primes, h,
+                   ctx->t[RSA_MAX_PRIMES + 1]);
+  STAT_TIMER_STOP(TIMER_DECRYPT_BLOCK, start);
 }
 
-bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n) {
-  mpz_t t;
-  mpz_init(t);
-  pow_mod(t, s, e, n); // decrypt signature with public exponent and n (p x q)
+typedef struct {
+  priv_parts *key;
+  numtheory_ctx *scratch; // one scratch context per worker
+  mpz_t *in;
+  mpz_t *out;
+  uint64_t base; // index in in and out of the first block of the batch
+} decrypt_batch;
+
+static void decrypt_task(void *arg, uint64_t index, uint64_t worker) {
+  decrypt_batch *batch = (decrypt_batch *)arg;
+  uint64_t i = batch->base + index;
+  decrypt_block(batch->out[i], batch->in[i], batch->key,
+                &batch->scratch[worker]);
+}
+
+static void decrypt_batch_init(decrypt_batch *batch, priv_parts *key,
+                               uint64_t threads, uint64_t cap) {
+  batch->key = key;
+  batch->scratch = (numtheory_ctx *)calloc(threads, sizeof(numtheory_ctx));
+  batch->in = (mpz_t *)calloc(cap, sizeof(mpz_t));
+  batch->out = (mpz_t *)calloc(cap, sizeof(mpz_t));
+  batch->base = 0;
+  uint64_t bits = mpz_sizeinbase(key->n, 2);
+  for (uint64_t i = 0; i < threads; i++) {
+    numtheory_ctx_init(&batch->scratch[i], bits);
+  }
+  for (uint64_t i = 0; i < cap; i++) {
+    mpz_init2(batch->in[i], bits); // sized up front, never reallocated
+    mpz_init2(batch->out[i], bits);
+  }
+}
+
+static void decrypt_batch_clear(decrypt_batch *batch, uint64_t threads,
+                                uint64_t cap) {
+  for (uint64_t i = 0; i < threads; i++) {
+    numtheory_ctx_clear(&batch->scratch[i]);
+  }
+  for (uint64_t i = 0; i < cap; i++) {
+    mpz_clear(batch->in[i]);
+    mpz_clear(batch->out[i]);
+  }
+  free(batch->scratch);
+  free(batch->in);
+  free(batch->out);
+}
+
+// writes the plaintext of one decrypted block, at most k - 1 bytes, adds
+// its length to used and sets last if this was the short block that ends
+// the file
+// returns false (having written nothing) if the block is wider than k bytes,
+// which only a wrong key or a damaged ciphertext can give
+static bool emit_block(uint8_t *dst, size_t *used, mpz_t m, uint8_t *kblock,
+                       uint64_t k, bool *last) {
+  if ((mpz_sizeinbase(m, 2) + 7) / 8 > k) {
+    return false;
+  }
+  size_t bytes_read; // used to read how many bytes were read in mpz_export
+  mpz_export(kblock, &bytes_read, 1, sizeof(uint8_t), 1, 0,
+             m); // bytes_read should be k unless last block
+
+  *last = (bytes_read < k); // a short block means we reached the end
+  if (bytes_read > 0) {
+    memcpy(dst, kblock + 1, bytes_read - 1); // skip the 0xFF marker byte
+    *used += bytes_read - 1;
+  }
+  return true;
+}
+
+// parses the next hex block in src[*pos..length), skipping whatever isn't a
+// hex digit before it, returns false if there is none
+static bool parse_hex_block(mpz_t c, const uint8_t *src, size_t length,
+                            size_t *pos, size_t max_digits) {
+  size_t i = *pos;
+  while ((i < length) && (hex_span(src + i, 1) == 0)) { // skip blank space
+    i += 1;
+  }
+  size_t count = hex_span(src + i, length - i);
+  if (count > max_digits) {
+    count = max_digits;
+  }
+  *pos = i + count;
+  return (count > 0) && hex_decode_mpz(c, src + i, count);
+}
+
+// reads up to cap hex ciphertext lines, returns how many were read
+static uint64_t read_hex_blocks(io_reader_t *reader, mpz_t *in, uint64_t cap,
+                                char **line, size_t *line_size,
+                                size_t max_digits) {
+  uint64_t count = 0;
+  ssize_t length;
+  while ((count < cap) &&
+         ((length = io_getline(reader, line, line_size)) >= 0)) {
+    size_t pos = 0;
+    if (parse_hex_block(in[count], (uint8_t *)*line, length, &pos,
+                        max_digits)) {
+      count += 1;
+    }
+  }
+  return count;
+}
+
+// reads up to cap fixed-width records, returns how many were read
+static uint64_t read_binary_blocks(io_reader_t *reader, mpz_t *in,
+                                   uint64_t cap, uint8_t *records,
+                                   uint64_t width) {
+  uint64_t count = io_read(reader, records, cap * width) / width;
+  for (uint64_t i = 0; i < count; i++) {
+    container_import(in[i], records + (i * width), width);
+  }
+  return count;
+}
+
+// decrypts a mapped regular file into a mapped regular file
+// returns false (having written nothing) if either side cannot be mapped,
+// otherwise sets ok to whether the ciphertext header and every block were
+// valid
+static bool decrypt_mapped(FILE *infile, FILE *outfile, priv_parts *key,
+                           pool_t *pool, bool *ok) {
+  mapped_file in;
+  if (same_file(infile, outfile) || !map_input(&in, infile)) {
+    return false;
+  }
+
+  uint64_t k = (mpz_sizeinbase(key->n, 2) - 1) / 8; // same as encrypt_file
+
+  container_header header;
+  container_init(&header, key->n);
+  bool binary = (in.data[0] == (uint8_t)CONTAINER_MAGIC[0]);
+  uint64_t blocks = 0;
+  size_t pos = 0;
+  if (binary) {
+    if ((in.length < CONTAINER_HEADER_SIZE) ||
+        !container_decode(&header, in.data) ||
+        !container_check(&header, key->n) ||
+        !container_check_count(&header, (in.length - CONTAINER_HEADER_SIZE) /
+                                            header.record_size)) {
+      unmap_input(&in, infile, 0);
+      *ok = false;
+      return true;
+    }
+    blocks = (in.length - CONTAINER_HEADER_SIZE) / header.record_size;
+  } else {
+    // one block per line, the last line may lack its newline
+    const uint8_t *nl = in.data;
+    const uint8_t *end = in.data + in.length;
+    while ((nl = memchr(nl, '\n', end - nl)) != NULL) {
+      blocks += 1;
+      nl += 1;
+    }
+    blocks += 1;
+  }
+
+  mapped_file out;
+  if (!map_output(&out, outfile, blocks * (k - 1))) {
+    unmap_input(&in, infile, 0);
+    return false;
+  }
+
+  uint64_t cap = pool_threads(pool) * BATCH_PER_THREAD;
+  decrypt_batch batch;
+  decrypt_batch_init(&batch, key, pool_threads(pool), cap);
+  uint8_t *kblock = (uint8_t *)calloc(k + 1, sizeof(uint8_t));
+  size_t max_digits = 2 * header.record_size;
+
+  // hex lines may hold more than one block, which must still fit
+  uint64_t emitted = 0;
+  size_t used = 0;
+  bool done = false;
+  *ok = true;
+  while (!done) {
+
+    // read in a batch of blocks straight from the mapping
+    uint64_t count = 0;
+    if (binary) {
+      while ((count < cap) && (emitted + count < blocks)) {
+        container_import(batch.in[count],
+                         in.data + container_offset(&header, emitted + count),
+                         header.record_size);
+        count += 1;
+      }
+    } else {
+      while ((count < cap) && parse_hex_block(batch.in[count], in.data,
+                                              in.length, &pos, max_digits)) {
+        count += 1;
+      }
+    }
+    if (count < cap) { // ran out of blocks
+      done = true;
+    }
+
+    pool_run(pool, decrypt_task, &batch, count);
+
+    for (uint64_t i = 0; i < count; i++) {
+      bool last;
+      if ((emitted == blocks) ||
+          !emit_block(out.data + used, &used, batch.out[i], kblock, k,
+                      &last)) {
+        *ok = false;
+        last = true;
+      }
+      emitted += 1;
+      if (last) {
+        done = true;
+        break;
+      }
+    }
+  }
+
+  unmap_output(&out, outfile, used);
+  unmap_input(&in, infile, in.length);
+  decrypt_batch_clear(&batch, pool_threads(pool), cap);
+  free(kblock);
+  return true;
+}
+
+// the streaming pipeline of decrypt_file(), slot i owns the in and out
+// entries from i * cap
+typedef struct {
+  io_reader_t *reader;
+  io_writer_t *writer;
+  pool_t *pool;
+  decrypt_batch *batch;
+  uint64_t cap;     // blocks per slot
+  uint64_t *counts; // blocks read into each slot
+  bool binary;
+  container_header header;
+  uint8_t *records; // the reader's raw binary records
+  char *line;       // the reader's hex line
+  size_t line_size;
+  uint64_t k;
+  uint8_t *kblock; // the writer's scratch block
+  uint8_t *output; // the writer's plaintext, cap * k bytes
+  uint64_t total;  // blocks the writer has emitted
+  bool damaged;    // set by the writer on a block wider than k bytes
+} decrypt_stream;
+
+static bool decrypt_read(void *arg, uint64_t slot) {
+  decrypt_stream *stream = (decrypt_stream *)arg;
+  mpz_t *in = stream->batch->in + (slot * stream->cap);
+
+  // read in a batch of blocks and store them into in (mpz)
+  uint64_t count =
+      stream->binary
+          ? read_binary_blocks(stream->reader, in, stream->cap,
+                               stream->records, stream->header.record_size)
+          : read_hex_blocks(stream->reader, in, stream->cap, &stream->line,
+                            &stream->line_size,
+                            2 * stream->header.record_size);
+  stream->counts[slot] = count;
+  return count == stream->cap; // fewer means we ran out of blocks
+}
+
+static void decrypt_compute(void *arg, uint64_t slot) {
+  decrypt_stream *stream = (decrypt_stream *)arg;
+  stream->batch->base = slot * stream->cap;
+  pool_run(stream->pool, decrypt_task, stream->batch, stream->counts[slot]);
+}
+
+static bool decrypt_write(void *arg, uint64_t slot) {
+  decrypt_stream *stream = (decrypt_stream *)arg;
+  mpz_t *out = stream->batch->out + (slot * stream->cap);
+  bool last = false;
+  size_t used = 0;
+  for (uint64_t i = 0; (i < stream->counts[slot]) && !last; i++) {
+    if (!emit_block(stream->output + used, &used, out[i], stream->kblock,
+                    stream->k, &last)) {
+      stream->damaged = true;
+      last = true;
+    }
+    stream->total += 1;
+  }
+  bool ok = io_write(stream->writer, stream->output,
+                     used); // help from TA Zack Jorquera
+  return ok && !last;
+}
+
+static bool decrypt_file(FILE *infile, FILE *outfile, priv_parts *key) {
+  pool_t *pool = start_pool();
+  priv_parts_init(key);
+
+  // regular files go straight through memory mappings
+  bool ok;
+  if (file_mmap && decrypt_mapped(infile, outfile, key, pool, &ok)) {
+    priv_parts_clear(key);
+    pool_delete(pool);
+    return ok;
+  }
+
+  // binary containers start with a magic number that is never a hex digit
+  decrypt_stream stream = {
+      .pool = pool, .binary = false, .total = 0, .damaged = false};
+  container_init(&stream.header, key->n); // bounds the digits of hex lines
+  stream.reader = io_reader_open(infile, io_chunk_size(), IO_DEPTH);
+  if (io_peek(stream.reader) == CONTAINER_MAGIC[0]) {
+    uint8_t buf[CONTAINER_HEADER_SIZE];
+    if ((io_read(stream.reader, buf, CONTAINER_HEADER_SIZE) !=
+         CONTAINER_HEADER_SIZE) ||
+        !container_decode(&stream.header, buf) ||
+        !container_check(&stream.header, key->n)) {
+      io_reader_close(stream.reader);
+      priv_parts_clear(key);
+      pool_delete(pool);
+      return false;
+    }
+    stream.binary = true;
+  }
+  stream.writer = io_writer_open(outfile, io_chunk_size(), IO_DEPTH);
+
+  uint64_t k = (mpz_sizeinbase(key->n, 2) - 1) / 8; // same as encrypt_file
+  stream.k = k;
+  stream.kblock = (uint8_t *)calloc(
+      k + 1, sizeof(uint8_t)); // a decrypted block is at most k + 1 bytes
+
+  // a reader thread fills batches of blocks, the pool decrypts them, and a
+  // writer thread emits them in their original order
+  uint64_t cap = pipeline_cap(pool, (4 * k) + 8);
+  uint64_t threads = pool_threads(pool);
+  decrypt_batch batch;
+  decrypt_batch_init(&batch, key, threads, PIPELINE_SLOTS * cap);
+  stream.batch = &batch;
+  stream.cap = cap;
+  stream.counts = (uint64_t *)calloc(PIPELINE_SLOTS, sizeof(uint64_t));
+  stream.output = (uint8_t *)malloc(cap * k);
+  stream.records = NULL;
+  if (stream.binary) {
+    stream.records = (uint8_t *)malloc(cap * stream.header.record_size);
+  }
+
+  pipeline_run(PIPELINE_SLOTS, decrypt_read, decrypt_compute, decrypt_write,
+               &stream);
+  bool read_ok = io_reader_close(stream.reader);
+  bool write_ok = io_writer_close(stream.writer);
+
+  decrypt_batch_clear(&batch, threads, PIPELINE_SLOTS * cap);
+  free(stream.counts);
+  free(stream.output);
+  free(stream.records);
+  free(stream.line);
+  free(stream.kblock);
+  priv_parts_clear(key);
+  pool_delete(pool);
+  // the records up to the final short block, which a truncated container
+  // never reaches
+  bool complete =
+      !stream.binary || container_check_count(&stream.header, stream.total);
+  return read_ok && write_ok && !stream.damaged && complete;
+}
+
+bool rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
+  priv_parts key = {.n = n, .d = d, .primes = 0};
+  return decrypt_file(infile, outfile, &key);
+}
+
+bool rsa_decrypt_file_crt(FILE *infile, FILE *outfile, mpz_t n, mpz_t p,
+                          mpz_t q, mpz_t dp, mpz_t dq, mpz_t qinv) {
+  priv_parts key = priv_parts_crt(n, p, q, dp, dq, qinv);
+  return decrypt_file(infile, outfile, &key);
+}
+
+bool rsa_decrypt_file_primes(FILE *infile, FILE *outfile, mpz_t n,
+                             mpz_t *primes, mpz_t *exps, mpz_t *coeffs,
+                             uint64_t count) {
+  priv_parts key = priv_parts_primes(n, primes, exps, coeffs, count);
+  return decrypt_file(infile, outfile, &key);
+}
+
+struct rsa_ctx {
+  mpz_t n, e, d; // the context's own copy of the key
+  mpz_t prime[RSA_MAX_PRIMES], exp[RSA_MAX_PRIMES], coeff[RSA_MAX_PRIMES];
+  bool pub;  // n and e are set, it can encrypt
+  bool priv; // it can decrypt
+  rsa_format_t format;
+  container_header header;
+  uint64_t k;
+  encrypt_batch enc; // a batch of one block on one worker
+  priv_parts key;
+  decrypt_batch dec; // the same for decryption
+  uint8_t *kblock;   // emit_block() scratch, k + 1 bytes
+};
+
+// allocates a context for modulus n, or returns NULL if n is too small to
+// carry a byte per block
+static rsa_ctx *ctx_create(mpz_t n) {
+  if ((mpz_sgn(n) <= 0) || (((mpz_sizeinbase(n, 2) - 1) / 8) < 2)) {
+    return NULL;
+  }
+  rsa_ctx *ctx = (rsa_ctx *)calloc(1, sizeof(rsa_ctx));
+  mpz_init_set(ctx->n, n);
+  mpz_inits(ctx->e, ctx->d, NULL);
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_inits(ctx->prime[i], ctx->exp[i], ctx->coeff[i], NULL);
+  }
+  ctx->format = RSA_FORMAT_HEX;
+  container_init(&ctx->header, ctx->n);
+  ctx->k = (mpz_sizeinbase(n, 2) - 1) / 8; // same as encrypt_file
+  ctx->kblock = (uint8_t *)calloc(ctx->k + 1, sizeof(uint8_t));
+  return ctx;
+}
+
+// sets up decryption once d and the first count primes with their CRT
+// components are in place, with plain decryption unless they factor n
+static rsa_ctx *ctx_priv(rsa_ctx *ctx, uint64_t count) {
+  // the same check as rsa_read_priv_primes(), the primes must factor n
+  if (count >= 2) {
+    mpz_set(ctx->e, ctx->prime[0]); // e is unused in a private context
+    for (uint64_t i = 1; i < count; i++) {
+      mpz_mul(ctx->e, ctx->e, ctx->prime[i]);
+    }
+    if (mpz_cmp(ctx->e, ctx->n) != 0) {
+      count = 0;
+    }
+    mpz_set_ui(ctx->e, 0);
+  }
+
+  ctx->key = priv_parts_primes(ctx->n, ctx->prime, ctx->exp, ctx->coeff,
+                               (count >= 2) ? count : 0);
+  ctx->key.d = ctx->d;
+  priv_parts_init(&ctx->key);
+  decrypt_batch_init(&ctx->dec, &ctx->key, 1, 1);
+
+  // size the kernel scratch now, so decrypting never allocates
+  numtheory_ctx *scratch = &ctx->dec.scratch[0];
+  if (ctx->key.primes == 0) {
+    numtheory_ctx_scratch(scratch, mont_powm_scratch_size(&ctx->key.mont_n));
+  }
+  for (uint64_t i = 0; i < ctx->key.primes; i++) {
+    numtheory_ctx_scratch(scratch,
+                          mont_powm_scratch_size(&ctx->key.mont[i]));
+  }
+  ctx->priv = true;
+  return ctx;
+}
+
+rsa_ctx *rsa_ctx_create_pub(mpz_t n, mpz_t e) {
+  rsa_ctx *ctx = (mpz_sgn(e) > 0) ? ctx_create(n) : NULL;
+  if (ctx == NULL) {
+    return NULL;
+  }
+  mpz_set(ctx->e, e);
+  encrypt_batch_init(&ctx->enc, ctx->n, ctx->e, 1, 1);
+  numtheory_ctx_scratch(&ctx->enc.scratch[0],
+                        mont_powm_scratch_size(&ctx->enc.mont));
+  ctx->pub = true;
+  return ctx;
+}
+
+rsa_ctx *rsa_ctx_create_priv(mpz_t n, mpz_t d) {
+  rsa_ctx *ctx = (mpz_sgn(d) > 0) ? ctx_create(n) : NULL;
+  if (ctx == NULL) {
+    return NULL;
+  }
+  mpz_set(ctx->d, d);
+  return ctx_priv(ctx, 0);
+}
+
+rsa_ctx *rsa_ctx_create_priv_crt(mpz_t n, mpz_t d, mpz_t p, mpz_t q,
+                                 mpz_t dp, mpz_t dq, mpz_t qinv) {
+  rsa_ctx *ctx = (mpz_sgn(d) > 0) ? ctx_create(n) : NULL;
+  if (ctx == NULL) {
+    return NULL;
+  }
+  mpz_set(ctx->d, d);
+  mpz_set(ctx->prime[0], p);
+  mpz_set(ctx->prime[1], q);
+  mpz_set(ctx->exp[0], dp);
+  mpz_set(ctx->exp[1], dq);
+  mpz_set(ctx->coeff[0], qinv);
+  return ctx_priv(ctx, 2);
+}
+
+rsa_ctx *rsa_ctx_create_priv_primes(mpz_t n, mpz_t d, mpz_t *primes,
+                                    mpz_t *exps, mpz_t *coeffs,
+                                    uint64_t count) {
+  rsa_ctx *ctx = ((mpz_sgn(d) > 0) && (count <= RSA_MAX_PRIMES))
+                     ? ctx_create(n)
+                     : NULL;
+  if (ctx == NULL) {
+    return NULL;
+  }
+  mpz_set(ctx->d, d);
+  for (uint64_t i = 0; i < count; i++) {
+    mpz_set(ctx->prime[i], primes[i]);
+    mpz_set(ctx->exp[i], exps[i]);
+    mpz_set(ctx->coeff[i], coeffs[i]);
+  }
+  return ctx_priv(ctx, count);
+}
+
+rsa_ctx *rsa_ctx_read_pub(FILE *pbfile) {
+  mpz_t n, e, s;
+  mpz_inits(n, e, s, NULL);
+  char *username = (char *)calloc(KEYFILE_USERNAME_MAX, sizeof(char));
+  rsa_ctx *ctx = NULL;
+  if (rsa_read_pub(n, e, s, username, pbfile)) {
+    ctx = rsa_ctx_create_pub(n, e);
+    keyfile_unregister(n); // the context holds what it borrowed
+  }
+  free(username);
+  mpz_clears(n, e, s, NULL);
+  return ctx;
+}
+
+rsa_ctx *rsa_ctx_read_priv(FILE *pvfile) {
+  mpz_t n, d;
+  mpz_inits(n, d, NULL);
+  mpz_t primes[RSA_MAX_PRIMES], exps[RSA_MAX_PRIMES], coeffs[RSA_MAX_PRIMES];
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_inits(primes[i], exps[i], coeffs[i], NULL);
+  }
+  uint64_t count = rsa_read_priv_primes(n, d, primes, exps, coeffs, pvfile);
+  rsa_ctx *ctx = rsa_ctx_create_priv_primes(n, d, primes, exps, coeffs, count);
+  keyfile_unregister(n); // the context holds what it borrowed
+  mpz_clears(n, d, NULL);
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_clears(primes[i], exps[i], coeffs[i], NULL);
+  }
+  return ctx;
+}
+
+void rsa_ctx_delete(rsa_ctx *ctx) {
+  if (ctx == NULL) {
+    return;
+  }
+  if (ctx->pub) {
+    encrypt_batch_clear(&ctx->enc, 1, 1);
+  }
+  if (ctx->priv) {
+    decrypt_batch_clear(&ctx->dec, 1, 1);
+    priv_parts_clear(&ctx->key);
+  }
+  mpz_clears(ctx->n, ctx->e, ctx->d, NULL);
+  for (uint64_t i = 0; i < RSA_MAX_PRIMES; i++) {
+    mpz_clears(ctx->prime[i], ctx->exp[i], ctx->coeff[i], NULL);
+  }
+  free(ctx->kblock);
+  free(ctx);
+}
+
+void rsa_ctx_set_format(rsa_ctx *ctx, rsa_format_t format) {
+  ctx->format = format;
+}
+
+size_t rsa_encrypt_size(rsa_ctx *ctx, size_t length) {
+  uint64_t blocks = (length / (ctx->k - 1)) + 1; // plus the short one
+  uint64_t prefix =
+      (ctx->format == RSA_FORMAT_BINARY) ? CONTAINER_HEADER_SIZE : 0;
+  return prefix + (blocks * max_block_bytes(ctx->format, &ctx->header));
+}
+
+bool rsa_encrypt_buffer(rsa_ctx *ctx, uint8_t *out, size_t out_size,
+                        const uint8_t *in, size_t length, size_t *written) {
+  if (!ctx->pub || (out_size < rsa_encrypt_size(ctx, length))) {
+    return false;
+  }
+
+  // the same blocks as rsa_encrypt_file(), one at a time on this thread
+  uint64_t k = ctx->k;
+  uint64_t blocks = (length / (k - 1)) + 1;
+  size_t used = 0;
+  if (ctx->format == RSA_FORMAT_BINARY) {
+    ctx->header.block_count = blocks;
+    container_encode(out, &ctx->header);
+    used = CONTAINER_HEADER_SIZE;
+  }
+  encrypt_batch *batch = &ctx->enc;
+  for (uint64_t i = 0; i < blocks; i++) {
+    batch->input = in + (i * (k - 1));
+    batch->length = length - (i * (k - 1));
+    encrypt_task(batch, 0, 0);
+    used += format_block(ctx->format, out + used, batch->out[0], &ctx->header);
+  }
+  *written = used;
+  return true;
+}
+
+bool rsa_decrypt_buffer(rsa_ctx *ctx, uint8_t *out, size_t out_size,
+                        const uint8_t *in, size_t length, size_t *written) {
+  if (!ctx->priv) {
+    return false;
+  }
+
+  container_header header = ctx->header;
+  bool binary = (length > 0) && (in[0] == (uint8_t)CONTAINER_MAGIC[0]);
+  size_t pos = 0;
+  if (binary) {
+    // checked against the header the context built, since container_check()
+    // would hash n again for every call
+    if ((length < CONTAINER_HEADER_SIZE) || !container_decode(&header, in) ||
+        (header.version != ctx->header.version) ||
+        (header.record_size != ctx->header.record_size) ||
+        (header.block_size != ctx->header.block_size) ||
+        (header.fingerprint != ctx->header.fingerprint) ||
+        !container_check_count(&header, (length - CONTAINER_HEADER_SIZE) /
+                                            header.record_size)) {
+      return false;
+    }
+    pos = CONTAINER_HEADER_SIZE;
+  }
+
+  mpz_ptr c = ctx->dec.in[0];
+  mpz_ptr m = ctx->dec.out[0];
+  size_t used = 0;
+  bool last = false;
+  while (!last) {
+    if (binary) {
+      if (pos + header.record_size > length) {
+        break;
+      }
+      container_import(c, in + pos, header.record_size);
+      pos += header.record_size;
+    } else if (!parse_hex_block(c, in, length, &pos,
+                                2 * header.record_size)) {
+      break;
+    }
+    decrypt_block(m, c, &ctx->key, &ctx->dec.scratch[0]);
+
+    // a block holds its bytes after the 0xFF marker
+    size_t bytes = (mpz_sizeinbase(m, 2) + 7) / 8;
+    if ((bytes > 0) && (used + bytes - 1 > out_size)) {
+      return false;
+    }
+    if (!emit_block(out + used, &used, m, ctx->kblock, ctx->k, &last)) {
+      return false;
+    }
+  }
+  *written = used;
+  return true;
+}
+
+// chunks of a hybrid file handed to the pool per thread in every batch
+#define HYBRID_CHUNKS_PER_THREAD 4
+
+// the chunks of a hybrid file sealed or opened in one pool run
+typedef struct {
+  uint8_t key[CHACHA_KEY_SIZE];
+  uint8_t aad[HYBRID_HEADER_SIZE]; // the encoded header
+  uint64_t chunk_size;
+  uint64_t first;    // index of the first chunk of the batch in the file
+  uint64_t final;    // index in the batch of the final chunk, or the count
+  uint8_t *data;     // chunk_size bytes per chunk, sealed in place
+  uint8_t *tags;     // POLY1305_TAG_SIZE bytes per chunk
+  uint64_t *lengths; // bytes in each chunk
+  bool *ok;          // whether each chunk opened
+} hybrid_batch;
+
+static void hybrid_batch_init(hybrid_batch *batch, uint64_t chunk_size,
+                              uint64_t cap) {
+  batch->chunk_size = chunk_size;
+  batch->first = 0;
+  batch->data = (uint8_t *)malloc(cap * chunk_size);
+  batch->tags = (uint8_t *)malloc(cap * POLY1305_TAG_SIZE);
+  batch->lengths = (uint64_t *)calloc(cap, sizeof(uint64_t));
+  batch->ok = (bool *)calloc(cap, sizeof(bool));
+}
+
+static void hybrid_batch_clear(hybrid_batch *batch) {
+  memset(batch->key, 0, sizeof(batch->key));
+  free(batch->data);
+  free(batch->tags);
+  free(batch->lengths);
+  free(batch->ok);
+}
+
+// the nonce of chunk i: a flag marking the final chunk, then i big-endian,
+// so chunks can be neither reordered nor dropped from the end
+static void hybrid_nonce(uint8_t nonce[CHACHA_NONCE_SIZE], uint64_t i,
+                         bool final) {
+  memset(nonce, 0, CHACHA_NONCE_SIZE);
+  nonce[0] = final ? 1 : 0;
+  for (int b = 11; b >= 4; b--) {
+    nonce[b] = (uint8_t)(i & 0xFF);
+    i >>= 8;
+  }
+}
+
+static void seal_task(void *arg, uint64_t index, uint64_t worker) {
+  (void)worker;
+  hybrid_batch *batch = (hybrid_batch *)arg;
+  uint8_t nonce[CHACHA_NONCE_SIZE];
+  hybrid_nonce(nonce, batch->first + index, index == batch->final);
+  uint8_t *chunk = batch->data + (index * batch->chunk_size);
+  aead_seal(chunk, batch->tags + (index * POLY1305_TAG_SIZE), chunk,
+            batch->lengths[index], batch->aad, HYBRID_HEADER_SIZE, batch->key,
+            nonce);
+}
+
+static void open_task(void *arg, uint64_t index, uint64_t worker) {
+  (void)worker;
+  hybrid_batch *batch = (hybrid_batch *)arg;
+  uint8_t nonce[CHACHA_NONCE_SIZE];
+  hybrid_nonce(nonce, batch->first + index, index == batch->final);
+  uint8_t *chunk = batch->data + (index * batch->chunk_size);
+  batch->ok[index] = aead_open(
+      chunk, chunk, batch->lengths[index],
+      batch->tags + (index * POLY1305_TAG_SIZE), batch->aad,
+      HYBRID_HEADER_SIZE, batch->key, nonce);
+}
+
+static void put_length(uint8_t buf[4], uint64_t length) {
+  for (int i = 3; i >= 0; i--) {
+    buf[i] = (uint8_t)(length & 0xFF);
+    length >>= 8;
+  }
+}
+
+static uint64_t get_length(const uint8_t buf[4]) {
+  uint64_t length = 0;
+  for (int i = 0; i < 4; i++) {
+    length = (length << 8) | buf[i];
+  }
+  return length;
+}
+
+// fills a buffer from the kernel random source
+static bool random_bytes(uint8_t *buf, size_t len) {
+  while (len > 0) {
+    ssize_t got = getrandom(buf, len, 0);
+    if (got <= 0) {
+      return false;
+    }
+    buf += got;
+    len -= (size_t)got;
+  }
+  return true;
+}
+
+// writes len bytes to a file, returns false if any of them failed
+static bool write_bytes(const uint8_t *buf, size_t len, FILE *outfile) {
+  return fwrite(buf, sizeof(uint8_t), len, outfile) == len;
+}
+
+bool rsa_encrypt_file_hybrid(FILE *infile, FILE *outfile, mpz_t n, mpz_t e) {
+  hybrid_header header;
+  hybrid_init(&header, n, CHACHA_KEY_SIZE);
+  uint64_t k = (mpz_sizeinbase(n, 2) - 1) / 8; // same as encrypt_file
+
+  // the secret is wrap_count blocks of k - 1 random bytes, each wrapped like
+  // an ordinary block behind a 0xFF byte, and the key is its first bytes
+  uint64_t secret_size = header.wrap_count * (k - 1);
+  uint8_t *secret = (uint8_t *)malloc(secret_size);
+  if (!random_bytes(secret, secret_size)) {
+    free(secret);
+    return false;
+  }
+
+  hybrid_batch batch;
+  pool_t *pool = start_pool();
+  uint64_t cap = pool_threads(pool) * HYBRID_CHUNKS_PER_THREAD;
+  hybrid_batch_init(&batch, header.chunk_size, cap);
+  memcpy(batch.key, secret, CHACHA_KEY_SIZE);
+  hybrid_encode(batch.aad, &header);
+  bool ok = write_bytes(batch.aad, HYBRID_HEADER_SIZE, outfile);
+
+  uint8_t *kblock = (uint8_t *)malloc(k);
+  uint8_t *record = (uint8_t *)malloc(header.record_size);
+  mpz_t m, c;
+  mpz_init(m);
+  mpz_init(c);
+  for (uint64_t w = 0; w < header.wrap_count; w++) {
+    kblock[0] = 0xFF;
+    memcpy(kblock + 1, secret + (w * (k - 1)), k - 1);
+    mpz_import(m, k, 1, sizeof(uint8_t), 1, 0, kblock);
+    rsa_encrypt(c, m, e, n);
+    container_export(record, header.record_size, c);
+    ok = ok && write_bytes(record, header.record_size, outfile);
+  }
+  memset(secret, 0, secret_size);
+  memset(kblock, 0, k);
+  mpz_set_ui(m, 0);
+
+  // the reader fills a batch of whole chunks, the pool seals them all, then
+  // the writer emits them in order; the final chunk is the short one, so a
+  // read error must not end the input like its end would
+  bool done = !ok;
+  while (!done) {
+    size_t length =
+        fread(batch.data, sizeof(uint8_t), cap * batch.chunk_size, infile);
+    if (ferror(infile)) {
+      ok = false;
+      break;
+    }
+    uint64_t count = cap;
+    batch.final = cap;
+    if (length < (cap * batch.chunk_size)) {
+      count = (length / batch.chunk_size) + 1;
+      batch.final = count - 1;
+      done = true;
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      uint64_t start = i * batch.chunk_size;
+      batch.lengths[i] = (length - start < batch.chunk_size)
+                             ? length - start
+                             : batch.chunk_size;
+    }
+
+    pool_run(pool, seal_task, &batch, count);
+
+    for (uint64_t i = 0; ok && (i < count); i++) {
+      uint8_t prefix[4];
+      put_length(prefix, batch.lengths[i]);
+      ok = write_bytes(prefix, 4, outfile) &&
+           write_bytes(batch.data + (i * batch.chunk_size), batch.lengths[i],
+                       outfile) &&
+           write_bytes(batch.tags + (i * POLY1305_TAG_SIZE),
+                       POLY1305_TAG_SIZE, outfile);
+    }
+    batch.first += count;
+    if (!ok) {
+      done = true;
+    }
+  }
+  ok = ok && (fflush(outfile) == 0); // stdio may still hold a failing write
+
+  mpz_clear(m);
+  mpz_clear(c);
+  free(secret);
+  free(kblock);
+  free(record);
+  hybrid_batch_clear(&batch);
+  pool_delete(pool);
+  return ok;
+}
+
+// reads the next chunk of a hybrid file into slot i of the batch, returns
+// false if the file ends early or the length is out of range
+static bool read_chunk(FILE *infile, hybrid_batch *batch, uint64_t i) {
+  uint8_t prefix[4];
+  if (fread(prefix, sizeof(uint8_t), 4, infile) != 4) {
+    return false;
+  }
+  uint64_t length = get_length(prefix);
+  if (length > batch->chunk_size) {
+    return false;
+  }
+  batch->lengths[i] = length;
+  return (fread(batch->data + (i * batch->chunk_size), sizeof(uint8_t), length,
+                infile) == length) &&
+         (fread(batch->tags + (i * POLY1305_TAG_SIZE), sizeof(uint8_t),
+                POLY1305_TAG_SIZE, infile) == POLY1305_TAG_SIZE);
+}
+
+// unwraps the session key from the records after the header
+static bool unwrap_key(FILE *infile, hybrid_header *header, priv_parts *key,
+                       uint8_t out[CHACHA_KEY_SIZE]) {
+  uint64_t k = (mpz_sizeinbase(key->n, 2) - 1) / 8;
+  uint64_t secret_size = header->wrap_count * (k - 1);
+  uint8_t *secret = (uint8_t *)malloc(secret_size);
+  uint8_t *kblock = (uint8_t *)malloc(k);
+  uint8_t *record = (uint8_t *)malloc(header->record_size);
+  mpz_t m, c;
+  mpz_init(m);
+  mpz_init(c);
+
+  bool ok = true;
+  for (uint64_t w = 0; ok && (w < header->wrap_count); w++) {
+    if (fread(record, sizeof(uint8_t), header->record_size, infile) !=
+        header->record_size) {
+      ok = false;
+      break;
+    }
+    container_import(c, record, header->record_size);
+    decrypt_one(m, c, key);
+    // a good block is exactly k bytes behind its 0xFF marker
+    if (mpz_sizeinbase(m, 2) != (8 * k)) {
+      ok = false;
+      break;
+    }
+    container_export(kblock, k, m);
+    if (kblock[0] != 0xFF) {
+      ok = false;
+      break;
+    }
+    memcpy(secret + (w * (k - 1)), kblock + 1, k - 1);
+  }
+  if (ok) {
+    memcpy(out, secret, CHACHA_KEY_SIZE);
+  }
+
+  memset(secret, 0, secret_size);
+  memset(kblock, 0, k);
+  mpz_set_ui(m, 0);
+  mpz_clear(m);
+  mpz_clear(c);
+  free(secret);
+  free(kblock);
+  free(record);
+  return ok;
+}
+
+static bool decrypt_file_hybrid(FILE *infile, FILE *outfile, priv_parts *key) {
+  uint8_t aad[HYBRID_HEADER_SIZE];
+  hybrid_header header;
+  if ((fread(aad, sizeof(uint8_t), HYBRID_HEADER_SIZE, infile) !=
+       HYBRID_HEADER_SIZE) ||
+      !hybrid_decode(&header, aad) ||
+      !hybrid_check(&header, key->n, CHACHA_KEY_SIZE)) {
+    return false;
+  }
+
+  hybrid_batch batch;
+  pool_t *pool = start_pool();
+  uint64_t cap = pool_threads(pool) * HYBRID_CHUNKS_PER_THREAD;
+  hybrid_batch_init(&batch, header.chunk_size, cap);
+  memcpy(batch.aad, aad, HYBRID_HEADER_SIZE);
+  bool ok = unwrap_key(infile, &header, key, batch.key);
+
+  // the reader fills a batch of chunks up to the final (short) one, the pool
+  // opens them all, then the writer emits them in order up to the first
+  // chunk that fails to authenticate
+  bool done = !ok;
+  while (!done) {
+    uint64_t count = 0;
+    batch.final = cap;
+    while ((count < cap) && (batch.final == cap)) {
+      if (!read_chunk(infile, &batch, count)) {
+        ok = false; // truncated, or no final chunk
+        break;
+      }
+      if (batch.lengths[count] < batch.chunk_size) {
+        batch.final = count;
+        done = true;
+      }
+      count += 1;
+    }
+    if (done && (getc(infile) != EOF)) {
+      ok = false; // trailing data after the final chunk
+    }
+
+    pool_run(pool, open_task, &batch, count);
+
+    for (uint64_t i = 0; i < count; i++) {
+      if (!batch.ok[i] ||
+          !write_bytes(batch.data + (i * batch.chunk_size), batch.lengths[i],
+                       outfile)) {
+        ok = false;
+        break;
+      }
+    }
+    batch.first += count;
+    if (!ok) {
+      done = true;
+    }
+  }
+  ok = (fflush(outfile) == 0) && ok;
+
+  hybrid_batch_clear(&batch);
+  pool_delete(pool);
+  return ok;
+}
+
+bool rsa_decrypt_file_hybrid(FILE *infile, FILE *outfile, mpz_t n, mpz_t d) {
+  priv_parts key = {.n = n, .d = d, .primes = 0};
+  return decrypt_file_hybrid(infile, outfile, &key);
+}
+
+bool rsa_decrypt_file_hybrid_crt(FILE *infile, FILE *outfile, mpz_t n,
+                                 mpz_t p, mpz_t q, mpz_t dp, mpz_t dq,
+                                 mpz_t qinv) {
+  priv_parts key = priv_parts_crt(n, p, q, dp, dq, qinv);
+  return decrypt_file_hybrid(infile, outfile, &key);
+}
+
+bool rsa_decrypt_file_hybrid_primes(FILE *infile, FILE *outfile, mpz_t n,
+                                    mpz_t *primes, mpz_t *exps,
+                                    mpz_t *coeffs, uint64_t count) {
+  priv_parts key = priv_parts_primes(n, primes, exps, coeffs, count);
+  return decrypt_file_hybrid(infile, outfile, &key);
+}
+
+void rsa_sign(mpz_t s, mpz_t m, mpz_t d, mpz_t n) { pow_mod(s, m, d, n); }
+
+bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n) {
+  mpz_t t;
+  mpz_init(t);
+  pow_mod(t, s, e, n); // decrypt signature with public exponent and n (p x q)
 
   if (mpz_cmp(t, m) == 0) { // if the decrypted signature and username line up,
                             // then we can confirm the verification
@@ -244,3 +2139,222 @@ bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n) {
     return false;
   }
 }
+
+// bits of the random exponents in the screening test, a batch holding a bad
+// signature passes with probability about 2^-VERIFY_SCREEN_BITS
+#define VERIFY_SCREEN_BITS 64
+
+// signatures screened together by one pool task
+#define VERIFY_CHUNK 64
+
+// a failed batch this small is checked one signature at a time
+#define VERIFY_LEAF 4
+
+typedef struct {
+  mpz_t *m, *s;
+  mpz_ptr n, e;
+  bool *valid;
+  uint64_t count;
+  uint64_t *r;      // random exponent of each signature
+  bool screening;   // false when screening cannot pay off or cannot tell
+                    // s from n - s, see rsa_verify_batch()
+  mont_ctx mont;
+  mont_sched sched; // window schedule of e
+} verify_batch;
+
+// the per-task limbs of verify_task
+typedef struct {
+  uint64_t *index;    // the screenable signatures of the chunk
+  mp_limb_t *sm, *mm; // and their signatures and messages, Montgomery form
+  mp_limb_t *acc_s, *acc_m;
+  mp_limb_t *scratch;
+  mpz_t t, u;
+} verify_scratch;
+
+// checks one signature on its own, exactly like rsa_verify()
+static bool verify_one(verify_batch *batch, uint64_t i, verify_scratch *vs) {
+  if ((mpz_sgn(batch->m[i]) < 0) || (mpz_cmp(batch->m[i], batch->n) >= 0)) {
+    return false; // no signature maps to a message outside [0, n)
+  }
+  mont_powm_sched(&batch->mont, vs->t, batch->s[i], &batch->sched,
+                  vs->scratch);
+  pow_mod_check(vs->t, batch->s[i], batch->e, batch->n);
+  return mpz_cmp(vs->t, batch->m[i]) == 0;
+}
+
+// the screening test for the screenable signatures [lo, hi) of a chunk:
+// (prod s_i^r_i)^2e = (prod m_i^r_i)^2 mod n, with both products built in
+// one pass over the bits of the r_i so the squarings are shared
+// squaring both sides removes every factor of order 2, such as the -1 of a
+// signature replaced by n - s, which could otherwise cancel in pairs; those
+// are caught by the Jacobi symbols in verify_task() instead
+static bool verify_screen(verify_batch *batch, uint64_t lo, uint64_t hi,
+                          verify_scratch *vs) {
+  mont_ctx *mont = &batch->mont;
+  mp_size_t size = mont->size;
+  mpn_copyi(vs->acc_s, mont->one, size);
+  mpn_copyi(vs->acc_m, mont->one, size);
+  for (int bit = VERIFY_SCREEN_BITS - 1; bit >= 0; bit--) {
+    mont_sqr(mont, vs->acc_s, vs->acc_s, vs->scratch);
+    mont_sqr(mont, vs->acc_m, vs->acc_m, vs->scratch);
+    for (uint64_t j = lo; j < hi; j++) {
+      if ((batch->r[vs->index[j]] >> bit) & 1) {
+        mont_mul(mont, vs->acc_s, vs->acc_s, vs->sm + (j * size),
+                 vs->scratch);
+        mont_mul(mont, vs->acc_m, vs->acc_m, vs->mm + (j * size),
+                 vs->scratch);
+      }
+    }
+  }
+  mont_sqr(mont, vs->acc_s, vs->acc_s, vs->scratch);
+  mont_sqr(mont, vs->acc_m, vs->acc_m, vs->scratch);
+  mont_from(mont, vs->u, vs->acc_s, vs->scratch);
+  mont_powm_sched(mont, vs->t, vs->u, &batch->sched, vs->scratch);
+  pow_mod_check(vs->t, vs->u, batch->e, batch->n);
+  mont_from(mont, vs->u, vs->acc_m, vs->scratch);
+  return mpz_cmp(vs->t, vs->u) == 0;
+}
+
+// screens [lo, hi) as a whole and splits it in half whenever it fails, so
+// only the halves holding bad signatures are checked one at a time
+static void verify_range(verify_batch *batch, uint64_t lo, uint64_t hi,
+                         verify_scratch *vs) {
+  if ((hi - lo) <= VERIFY_LEAF) {
+    for (uint64_t j = lo; j < hi; j++) {
+      batch->valid[vs->index[j]] = verify_one(batch, vs->index[j], vs);
+    }
+    return;
+  }
+  if (verify_screen(batch, lo, hi, vs)) {
+    for (uint64_t j = lo; j < hi; j++) {
+      batch->valid[vs->index[j]] = true;
+    }
+    return;
+  }
+  uint64_t mid = lo + ((hi - lo) / 2);
+  verify_range(batch, lo, mid, vs);
+  verify_range(batch, mid, hi, vs);
+}
+
+static void verify_task(void *arg, uint64_t index, uint64_t worker) {
+  (void)worker;
+  verify_batch *batch = (verify_batch *)arg;
+  uint64_t lo = index * VERIFY_CHUNK;
+  uint64_t hi = lo + VERIFY_CHUNK;
+  if (hi > batch->count) {
+    hi = batch->count;
+  }
+
+  mp_size_t size = batch->mont.size;
+  verify_scratch vs;
+  vs.index = (uint64_t *)malloc(VERIFY_CHUNK * sizeof(uint64_t));
+  vs.sm = (mp_limb_t *)malloc(VERIFY_CHUNK * size * sizeof(mp_limb_t));
+  vs.mm = (mp_limb_t *)malloc(VERIFY_CHUNK * size * sizeof(mp_limb_t));
+  vs.acc_s = (mp_limb_t *)malloc(size * sizeof(mp_limb_t));
+  vs.acc_m = (mp_limb_t *)malloc(size * sizeof(mp_limb_t));
+  vs.scratch = (mp_limb_t *)malloc(mont_powm_scratch_size(&batch->mont) *
+                                   sizeof(mp_limb_t));
+  mpz_init(vs.t);
+  mpz_init(vs.u);
+
+  // a zero factor would hide every other one, and a message outside [0, n)
+  // can never verify, so those are checked on their own, as are signatures
+  // outside [1, n - 1]
+  uint64_t kept = 0;
+  for (uint64_t i = lo; i < hi; i++) {
+    bool screenable = batch->screening && (mpz_sgn(batch->m[i]) > 0) &&
+                      (mpz_cmp(batch->m[i], batch->n) < 0) &&
+                      (mpz_sgn(batch->s[i]) > 0) &&
+                      (mpz_cmp(batch->s[i], batch->n) < 0);
+    if (!screenable) {
+      batch->valid[i] = verify_one(batch, i, &vs);
+      continue;
+    }
+    // e is odd, so s^e = m needs (s/n) = (m/n); with n = 3 mod 4,
+    // (-1/n) = -1 and n - s always fails this where s passes
+    if (mpz_jacobi(batch->s[i], batch->n) !=
+        mpz_jacobi(batch->m[i], batch->n)) {
+      batch->valid[i] = false;
+      continue;
+    }
+    vs.index[kept] = i;
+    mont_to(&batch->mont, vs.sm + (kept * size), batch->s[i], vs.scratch);
+    mont_to(&batch->mont, vs.mm + (kept * size), batch->m[i], vs.scratch);
+    kept += 1;
+  }
+  verify_range(batch, 0, kept, &vs);
+
+  mpz_clear(vs.t);
+  mpz_clear(vs.u);
+  free(vs.index);
+  free(vs.sm);
+  free(vs.mm);
+  free(vs.acc_s);
+  free(vs.acc_m);
+  free(vs.scratch);
+}
+
+uint64_t rsa_verify_batch(mpz_t *m, mpz_t *s, uint64_t count, mpz_t e,
+                          mpz_t n, bool *valid) {
+  if (count == 0) {
+    return 0;
+  }
+  if (!mont_supported(n)) { // not an RSA modulus, check them one by one
+    uint64_t passed = 0;
+    for (uint64_t i = 0; i < count; i++) {
+      valid[i] = rsa_verify(m[i], s[i], e, n);
+      passed += valid[i];
+    }
+    return passed;
+  }
+
+  verify_batch batch = {
+      .m = m,
+      .s = s,
+      .n = n,
+      .e = e,
+      .valid = valid,
+      .count = count,
+      .r = (uint64_t *)malloc(count * sizeof(uint64_t)),
+      // a full check costs about bits(e) squarings, screening about
+      // VERIFY_SCREEN_BITS of them per signature; the sign of s^e is only
+      // seen by the Jacobi symbol when n = 3 mod 4, and e must be odd
+      .screening = (mpz_sizeinbase(e, 2) > VERIFY_SCREEN_BITS) &&
+                   mpz_odd_p(e) && (mpz_fdiv_ui(n, 4) == 3),
+  };
+  key_mont_init(&batch.mont, n);
+  key_sched_init(&batch.sched, e);
+
+  // the exponents must be unpredictable to whoever made the signatures, so
+  // they come from the system rather than the seeded random state
+  gmp_randstate_t rand;
+  gmp_randinit_mt(rand);
+  unsigned long seed[4] = {0};
+  if (getrandom(seed, sizeof(seed), 0) != (ssize_t)sizeof(seed)) {
+    seed[0] = (unsigned long)time(NULL) ^ (unsigned long)clock();
+  }
+  mpz_t seed_mpz;
+  mpz_init(seed_mpz);
+  mpz_import(seed_mpz, 4, 1, sizeof(seed[0]), 0, 0, seed);
+  gmp_randseed(rand, seed_mpz);
+  mpz_clear(seed_mpz);
+  for (uint64_t i = 0; i < count; i++) {
+    batch.r[i] = ((uint64_t)gmp_urandomb_ui(rand, 32) << 32) |
+                 gmp_urandomb_ui(rand, 32);
+  }
+  gmp_randclear(rand);
+
+  pool_t *pool = start_pool();
+  pool_run(pool, verify_task, &batch, (count + VERIFY_CHUNK - 1) / VERIFY_CHUNK);
+  pool_delete(pool);
+
+  key_mont_clear(&batch.mont);
+  key_sched_clear(&batch.sched);
+  free(batch.r);
+
+  uint64_t passed = 0;
+  for (uint64_t i = 0; i < count; i++) {
+    passed += valid[i];
+  }
+  return passed;
+}
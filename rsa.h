@@ -21,6 +21,21 @@
 void rsa_make_pub(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits,
                   uint64_t iters);
 
+//
+// Generates the components for a new public RSA key with a fixed public
+// exponent, such as 65537. Primes are redrawn until e is coprime to
+// lambda(n), so the key has a small e and encryption and verification
+// are cheap.
+// All mpz_t arguments are expected to be initialized.
+//
+// p: will store the first large prime.
+// q: will store the second large prime.
+// n: will store the product of p and q.
+// e: the public exponent to use, odd and at least 3.
+//
+void rsa_make_pub_fixed(mpz_t p, mpz_t q, mpz_t n, mpz_t e, uint64_t nbits,
+                        uint64_t iters);
+
 //
 // Writes a public RSA key to a file.
 // Public key contents: n, e, signature, username.
@@ -36,15 +51,17 @@ void rsa_write_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile);
 //
 // Reads a public RSA key from a file.
 // Public key contents: n, e, signature, username.
+// Binary key files (keygen -B) are recognized and read with keyfile.h.
 // All mpz_t arguments are expected to be initialized.
 //
 // n: will store the public modulus.
 // e: will store the public exponent.
 // s: will store the signature.
-// username: an allocated array to hold the username.
+// username: an allocated array to hold the username (KEYFILE_USERNAME_MAX).
 // pbfile: the file containing the public key
+// returns: false if the file is not a valid public key.
 //
-void rsa_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile);
+bool rsa_read_pub(mpz_t n, mpz_t e, mpz_t s, char username[], FILE *pbfile);
 
 //
 // Generates the components for a new private RSA key.
@@ -72,11 +89,222 @@ void rsa_write_priv(mpz_t n, mpz_t d, FILE *pvfile);
 //
 // Reads a private RSA key from a file.
 // Private key contents: n, d.
+// Binary key files (keygen -B) are recognized and read with keyfile.h.
+// All mpz_t arguments are expected to be initialized.
+//
+// n: will store the public modulus.
+// d: will store the private key.
+// returns: false if the file is not a valid private key.
+bool rsa_read_priv(mpz_t n, mpz_t d, FILE *pvfile);
+
+//
+// Generates the Chinese Remainder Theorem components of a private key.
+// These let decryption run as two half-size exponentiations instead of one
+// full-size exponentiation.
+// All mpz_t arguments are expected to be initialized.
+//
+// dp: will store d mod (p - 1).
+// dq: will store d mod (q - 1).
+// qinv: will store the inverse of q mod p.
+// d: the private key.
+// p: the first large prime from the public key generation.
+// q: the second large prime from the public key generation.
+//
+void rsa_make_crt(mpz_t dp, mpz_t dq, mpz_t qinv, mpz_t d, mpz_t p, mpz_t q);
+
+//
+// Writes an extended private RSA key to a file.
+// Private key contents: n, d, p, q, dp, dq, qinv.
+// The first two lines are the same as a plain private key file.
+// All mpz_t arguments are expected to be initialized.
+//
+// n: the public modulus.
+// d: the private key.
+// p, q: the primes of n.
+// dp, dq, qinv: the CRT components from rsa_make_crt().
+// pvfile: the file to write the private key to.
+//
+void rsa_write_priv_crt(mpz_t n, mpz_t d, mpz_t p, mpz_t q, mpz_t dp,
+                        mpz_t dq, mpz_t qinv, FILE *pvfile);
+
+//
+// Reads a private RSA key from a file, including the CRT components if the
+// file has them. Plain two-field private key files are still accepted, and
+// so are binary key files (keygen -B). Keys with more than two primes only
+// give n and d here, see rsa_read_priv_primes(). n stays 0 if the file
+// cannot be read.
+// All mpz_t arguments are expected to be initialized.
+//
+// n: will store the public modulus.
+// d: will store the private key.
+// p, q, dp, dq, qinv: will store the CRT components if present.
+// pvfile: the file containing the private key.
+// returns: true if the CRT components were read and are consistent with n,
+//          false if only n and d are usable.
+//
+bool rsa_read_priv_crt(mpz_t n, mpz_t d, mpz_t p, mpz_t q, mpz_t dp, mpz_t dq,
+                       mpz_t qinv, FILE *pvfile);
+
+// the most primes the modulus of a multi-prime key may have
+#define RSA_MAX_PRIMES 4
+
+//
+// Generates the components for a new public RSA key whose modulus is the
+// product of count balanced primes (multi-prime RSA, as in PKCS #1).
+// Each prime has about nbits / count bits, so they are much cheaper to
+// find than the two primes of rsa_make_pub(). e is drawn the same way as in
+// rsa_make_pub().
+// All mpz_t arguments are expected to be initialized.
+//
+// primes: will store the distinct primes, count entries.
+// count: the number of primes, 2 to RSA_MAX_PRIMES.
+// n: will store the product of the primes.
+// e: will store the public exponent.
+//
+void rsa_make_pub_primes(mpz_t *primes, uint64_t count, mpz_t n, mpz_t e,
+                         uint64_t nbits, uint64_t iters);
+
+//
+// Generates the components for a new multi-prime public RSA key with a
+// fixed public exponent, like rsa_make_pub_fixed().
+// All mpz_t arguments are expected to be initialized.
+//
+// primes: will store the distinct primes, count entries.
+// count: the number of primes, 2 to RSA_MAX_PRIMES.
+// n: will store the product of the primes.
+// e: the public exponent to use, odd and at least 3.
+//
+void rsa_make_pub_primes_fixed(mpz_t *primes, uint64_t count, mpz_t n,
+                               mpz_t e, uint64_t nbits, uint64_t iters);
+
+//
+// Generates the private key for a public key with any number of primes,
+// the inverse of e mod lambda(n) = lcm(primes[i] - 1).
+// All mpz_t arguments are expected to be initialized.
+//
+// d: will store the RSA private key.
+// e: the public exponent.
+// primes: the primes of n.
+// count: the number of primes.
+//
+void rsa_make_priv_primes(mpz_t d, mpz_t e, mpz_t *primes, uint64_t count);
+
+//
+// Generates the CRT components of a private key with any number of primes.
+// With two primes these are the same as rsa_make_crt() computes. Each
+// further prime gets the coefficient PKCS #1 gives it, which lets the
+// decrypted residues be combined one prime at a time.
+// All mpz_t arguments are expected to be initialized.
+//
+// exps: will store d mod (primes[i] - 1), count entries.
+// coeffs: will store the coefficients, count entries: coeffs[0] is the
+//         inverse of primes[1] mod primes[0] (qinv), coeffs[1] is 0 and
+//         every further coeffs[i] is the inverse of
+//         primes[0] * ... * primes[i - 1] mod primes[i].
+// d: the private key.
+// primes: the primes of n.
+// count: the number of primes.
+//
+void rsa_make_crt_primes(mpz_t *exps, mpz_t *coeffs, mpz_t d, mpz_t *primes,
+                         uint64_t count);
+
+//
+// Writes a private RSA key with any number of primes to a file.
+// Private key contents: n, d, p, q, dp, dq, qinv, then a prime, its
+// exponent and its coefficient for every prime after the second.
+// With two primes this is the same file as rsa_write_priv_crt() writes.
+// Readers that only know two primes find that p and q do not factor n and
+// fall back to d.
+// All mpz_t arguments are expected to be initialized.
+//
+// n: the public modulus.
+// d: the private key.
+// primes, exps, coeffs: the primes and CRT components from
+//                       rsa_make_crt_primes().
+// count: the number of primes.
+// pvfile: the file to write the private key to.
+//
+void rsa_write_priv_primes(mpz_t n, mpz_t d, mpz_t *primes, mpz_t *exps,
+                           mpz_t *coeffs, uint64_t count, FILE *pvfile);
+
+//
+// Reads a private RSA key from a file with all of its primes and CRT
+// components, if the file has them. Accepts everything rsa_read_priv_crt()
+// does. n stays 0 if the file cannot be read.
 // All mpz_t arguments are expected to be initialized.
 //
 // n: will store the public modulus.
 // d: will store the private key.
-void rsa_read_priv(mpz_t n, mpz_t d, FILE *pvfile);
+// primes, exps, coeffs: will store the primes and CRT components,
+//                       RSA_MAX_PRIMES entries each.
+// pvfile: the file containing the private key.
+// returns: the number of primes if they were read and factor n, 0 if only
+//          n and d are usable.
+//
+uint64_t rsa_read_priv_primes(mpz_t n, mpz_t d, mpz_t *primes, mpz_t *exps,
+                              mpz_t *coeffs, FILE *pvfile);
+
+//
+// Ciphertext formats written by rsa_encrypt_file().
+// RSA_FORMAT_HEX: one hex line per block (the original, legacy format).
+// RSA_FORMAT_BINARY: a container header followed by fixed-width big-endian
+//                    records, see container.h.
+//
+typedef enum { RSA_FORMAT_HEX, RSA_FORMAT_BINARY } rsa_format_t;
+
+//
+// Sets the ciphertext format written by rsa_encrypt_file().
+// Decryption detects the format on its own. Defaults to RSA_FORMAT_HEX.
+//
+// format: the format to write.
+//
+void rsa_set_format(rsa_format_t format);
+
+//
+// Sets whether the file encryption and decryption functions may use memory
+// mappings. When enabled, a regular input file is mapped for reading, and a
+// regular output file that was opened for reading and writing (e.g. "w+")
+// is presized and mapped for writing. Anything else, such as stdin/stdout
+// pipes, always uses the streaming stdio path. Defaults to enabled.
+//
+// enabled: true to allow memory mappings.
+//
+void rsa_set_mmap(bool enabled);
+
+//
+// Sets the number of threads used by the file encryption and decryption
+// functions. Blocks are processed in parallel batches and always written
+// in their original order. Defaults to 1.
+//
+// threads: the number of threads to use (values below 1 are treated as 1).
+//
+void rsa_set_threads(uint64_t threads);
+
+// default memory cap of the streaming file loops, in bytes
+#define RSA_DEFAULT_MEMORY ((uint64_t)64 << 20)
+
+//
+// Sets how much memory the streaming (non-mapped) file encryption and
+// decryption loops may hold in flight. Those loops read, compute and write
+// on separate threads with a few batches of blocks between them, and the
+// batches shrink when they would not fit in half the cap. The other half
+// goes to the read and write chunks kept in flight (see io.h), up to
+// IO_DEPTH chunks of IO_CHUNK bytes each way. Defaults to
+// RSA_DEFAULT_MEMORY.
+//
+// bytes: the memory cap in bytes.
+//
+void rsa_set_memory(uint64_t bytes);
+
+//
+// Sets the number of threads rsa_make_pub() and rsa_make_pub_fixed() search
+// for p and q on. With any threads at all, both primes are searched for
+// concurrently and the keys depend on the random seed but not on the number
+// of threads. Defaults to 0, the original serial search.
+//
+// threads: the number of threads to use, or 0 for the serial search.
+//
+void rsa_set_keygen_threads(uint64_t threads);
 
 //
 // Encrypts a message given an RSA public exponent and modulus.
@@ -98,8 +326,45 @@ void rsa_encrypt(mpz_t c, mpz_t m, mpz_t e, mpz_t n);
 // outfile: the output file to write the encrypted input to.
 // n: the public modulus.
 // e: the public exponent.
+// returns: false if reading the input or writing the output failed.
 //
-void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
+bool rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
+
+//
+// Encrypts an entire file for several recipients at once.
+// The input is read a single time, so it may be a pipe, and the blocks of
+// every recipient are encrypted in parallel. Each output is the same as
+// rsa_encrypt_file() would write for that recipient's key.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to encrypt.
+// outfiles: one output file per recipient.
+// n: the public modulus of each recipient.
+// e: the public exponent of each recipient.
+// count: the number of recipients.
+// returns: false if reading the input or writing any output failed.
+//
+bool rsa_encrypt_file_multi(FILE *infile, FILE **outfiles, mpz_t *n, mpz_t *e,
+                            uint64_t count);
+
+//
+// Encrypts an entire file with a fresh random session key.
+// The session key is wrapped once with rsa_encrypt() and the data itself is
+// sealed in chunks with ChaCha20-Poly1305, so the cost per byte no longer
+// depends on the size of n. The output is always a binary hybrid container
+// (see container.h). Chunks are sealed on rsa_set_threads() threads.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to encrypt.
+// outfile: the output file to write the encrypted input to.
+// n: the public modulus.
+// e: the public exponent.
+// returns: false if no random session key could be drawn, the input couldn't
+//          be read or the ciphertext couldn't be written, true otherwise.
+//
+bool rsa_encrypt_file_hybrid(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
 
 //
 // Decrypts some ciphertext given an RSA private key and public modulus.
@@ -112,8 +377,76 @@ void rsa_encrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t e);
 //
 void rsa_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t n);
 
+//
+// Decrypts some ciphertext using the CRT components of a private key.
+// Produces the same result as rsa_decrypt() with the matching d and n.
+// All mpz_t arguments are expected to be initialized.
+//
+// m: will store the decrypted message.
+// c: the ciphertext to decrypt.
+// p, q: the primes of the public modulus.
+// dp, dq, qinv: the CRT components from rsa_make_crt().
+//
+void rsa_decrypt_crt(mpz_t m, mpz_t c, mpz_t p, mpz_t q, mpz_t dp, mpz_t dq,
+                     mpz_t qinv);
+
 //
 // Decrypts an entire file given an RSA public modulus and private key.
+// The input may be in either ciphertext format.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to decrypt.
+// outfile: the output file to write the decrypted input to.
+// n: the public modulus.
+// d: the private key.
+// returns: false if the input is a binary container for a different key,
+//          has a malformed header or has fewer records than its block
+//          count, or if a block decrypts to more than the k bytes the key
+//          encrypts (a wrong key or a damaged ciphertext, where the output
+//          stops before that block), or if reading or writing failed, true
+//          otherwise.
+//
+bool rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d);
+
+//
+// Decrypts an entire file using the CRT components of a private key.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to decrypt.
+// outfile: the output file to write the decrypted input to.
+// n: the public modulus.
+// p, q: the primes of the public modulus.
+// dp, dq, qinv: the CRT components from rsa_make_crt().
+// returns: the same as rsa_decrypt_file().
+//
+bool rsa_decrypt_file_crt(FILE *infile, FILE *outfile, mpz_t n, mpz_t p,
+                          mpz_t q, mpz_t dp, mpz_t dq, mpz_t qinv);
+
+//
+// Decrypts an entire file using the CRT components of a private key with
+// any number of primes. Each block takes count exponentiations, each on a
+// modulus count times smaller than n.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to decrypt.
+// outfile: the output file to write the decrypted input to.
+// n: the public modulus.
+// primes, exps, coeffs: the primes and CRT components from
+//                       rsa_make_crt_primes().
+// count: the number of primes, 2 to RSA_MAX_PRIMES.
+// returns: the same as rsa_decrypt_file().
+//
+bool rsa_decrypt_file_primes(FILE *infile, FILE *outfile, mpz_t n,
+                             mpz_t *primes, mpz_t *exps, mpz_t *coeffs,
+                             uint64_t count);
+
+//
+// Decrypts a file written by rsa_encrypt_file_hybrid().
+// Each chunk is authenticated before any of it is written, so on failure
+// the output holds only the chunks before the first bad one.
 // All mpz_t arguments are expected to be initialized.
 // All FILE * arguments are expected to be properly opened.
 //
@@ -121,8 +454,179 @@ void rsa_decrypt(mpz_t m, mpz_t c, mpz_t d, mpz_t n);
 // outfile: the output file to write the decrypted input to.
 // n: the public modulus.
 // d: the private key.
+// returns: false if the header is for a different key, the session key does
+//          not unwrap, a chunk is forged, reordered or missing, or the
+//          plaintext couldn't be written.
+//
+bool rsa_decrypt_file_hybrid(FILE *infile, FILE *outfile, mpz_t n, mpz_t d);
+
+//
+// Decrypts a hybrid file using the CRT components of a private key.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to decrypt.
+// outfile: the output file to write the decrypted input to.
+// n: the public modulus.
+// p, q: the primes of the public modulus.
+// dp, dq, qinv: the CRT components from rsa_make_crt().
+// returns: the same as rsa_decrypt_file_hybrid().
+//
+bool rsa_decrypt_file_hybrid_crt(FILE *infile, FILE *outfile, mpz_t n,
+                                 mpz_t p, mpz_t q, mpz_t dp, mpz_t dq,
+                                 mpz_t qinv);
+
+//
+// Decrypts a hybrid file using the CRT components of a private key with
+// any number of primes.
+// All mpz_t arguments are expected to be initialized.
+// All FILE * arguments are expected to be properly opened.
+//
+// infile: the input file to decrypt.
+// outfile: the output file to write the decrypted input to.
+// n: the public modulus.
+// primes, exps, coeffs: the primes and CRT components from
+//                       rsa_make_crt_primes().
+// count: the number of primes, 2 to RSA_MAX_PRIMES.
+// returns: the same as rsa_decrypt_file_hybrid().
+//
+bool rsa_decrypt_file_hybrid_primes(FILE *infile, FILE *outfile, mpz_t n,
+                                    mpz_t *primes, mpz_t *exps,
+                                    mpz_t *coeffs, uint64_t count);
+
+//
+// A loaded key with everything derived from it, for encrypting and
+// decrypting buffers in memory: the Montgomery contexts and window
+// schedules, the block scratch space and the kernel scratch space are all
+// set up when the context is created, so the buffer functions allocate
+// nothing, touch no files and start no threads. The ciphertext is the same
+// as rsa_encrypt_file() writes, so either side can be a file.
+// A context must only be used by one thread at a time.
 //
-void rsa_decrypt_file(FILE *infile, FILE *outfile, mpz_t n, mpz_t d);
+typedef struct rsa_ctx rsa_ctx;
+
+//
+// Creates a context that encrypts with a public key.
+// The context keeps its own copy of the key.
+// All mpz_t arguments are expected to be initialized.
+//
+// n, e: the public modulus and exponent.
+// returns: the new context, or NULL if the key is unusable.
+//
+rsa_ctx *rsa_ctx_create_pub(mpz_t n, mpz_t e);
+
+//
+// Creates a context that decrypts with a private key.
+// All mpz_t arguments are expected to be initialized.
+//
+// n, d: the public modulus and the private exponent.
+// returns: the new context, or NULL if the key is unusable.
+//
+rsa_ctx *rsa_ctx_create_priv(mpz_t n, mpz_t d);
+
+//
+// Creates a context that decrypts with the CRT components of a private key.
+// Falls back to plain decryption if p and q do not factor n.
+// All mpz_t arguments are expected to be initialized.
+//
+// n, d: the public modulus and the private exponent.
+// p, q: the primes of n.
+// dp, dq, qinv: the CRT components from rsa_make_crt().
+// returns: the new context, or NULL if the key is unusable.
+//
+rsa_ctx *rsa_ctx_create_priv_crt(mpz_t n, mpz_t d, mpz_t p, mpz_t q,
+                                 mpz_t dp, mpz_t dq, mpz_t qinv);
+
+//
+// Creates a context that decrypts with the CRT components of a private key
+// with any number of primes.
+// Falls back to plain decryption if the primes do not factor n.
+// All mpz_t arguments are expected to be initialized.
+//
+// n, d: the public modulus and the private exponent.
+// primes, exps, coeffs: the primes and CRT components from
+//                       rsa_make_crt_primes().
+// count: the number of primes, 2 to RSA_MAX_PRIMES.
+// returns: the new context, or NULL if the key is unusable.
+//
+rsa_ctx *rsa_ctx_create_priv_primes(mpz_t n, mpz_t d, mpz_t *primes,
+                                    mpz_t *exps, mpz_t *coeffs,
+                                    uint64_t count);
+
+//
+// Reads a public key file (hex or binary) into a new context.
+// A binary key file stays mapped until the context is deleted.
+//
+// pbfile: the file containing the public key.
+// returns: the new context, or NULL if the file is not a usable key.
+//
+rsa_ctx *rsa_ctx_read_pub(FILE *pbfile);
+
+//
+// Reads a private key file (hex or binary, with or without CRT components,
+// with any number of primes) into a new context. A binary key file stays
+// mapped until the context is deleted.
+//
+// pvfile: the file containing the private key.
+// returns: the new context, or NULL if the file is not a usable key.
+//
+rsa_ctx *rsa_ctx_read_priv(FILE *pvfile);
+
+//
+// Frees a context and everything in it.
+//
+// ctx: the context, or NULL.
+//
+void rsa_ctx_delete(rsa_ctx *ctx);
+
+//
+// Sets the ciphertext format rsa_encrypt_buffer() writes.
+// Defaults to RSA_FORMAT_HEX, like rsa_set_format().
+//
+// ctx: the context.
+// format: the format to write.
+//
+void rsa_ctx_set_format(rsa_ctx *ctx, rsa_format_t format);
+
+//
+// Returns the most bytes rsa_encrypt_buffer() can write for an input.
+//
+// ctx: a public key context.
+// length: the number of plaintext bytes.
+//
+size_t rsa_encrypt_size(rsa_ctx *ctx, size_t length);
+
+//
+// Encrypts a buffer.
+//
+// ctx: a public key context.
+// out: will store the ciphertext.
+// out_size: the size of out, at least rsa_encrypt_size(ctx, length).
+// in: the plaintext.
+// length: the number of plaintext bytes.
+// written: will store the number of ciphertext bytes.
+// returns: false if ctx has no public key or out is too small.
+//
+bool rsa_encrypt_buffer(rsa_ctx *ctx, uint8_t *out, size_t out_size,
+                        const uint8_t *in, size_t length, size_t *written);
+
+//
+// Decrypts a buffer of either ciphertext format.
+// The plaintext is never longer than the ciphertext, so an out_size of
+// length always suffices.
+//
+// ctx: a private key context.
+// out: will store the plaintext.
+// out_size: the size of out.
+// in: the ciphertext.
+// length: the number of ciphertext bytes.
+// written: will store the number of plaintext bytes.
+// returns: false if ctx has no private key, the container header is for a
+//          different key or has fewer records than its block count, a
+//          block does not decrypt to at most k bytes, or out is too small.
+//
+bool rsa_decrypt_buffer(rsa_ctx *ctx, uint8_t *out, size_t out_size,
+                        const uint8_t *in, size_t length, size_t *written);
 
 //
 // Signs some message given an RSA private key and public modulus.
@@ -147,3 +651,29 @@ void rsa_sign(mpz_t s, mpz_t m, mpz_t d, mpz_t n);
 // returns: true if signature is verified, false otherwise.
 //
 bool rsa_verify(mpz_t m, mpz_t s, mpz_t e, mpz_t n);
+
+//
+// Verifies many signatures made with the same key at once.
+// Chunks of signatures are screened together with a randomized product
+// test, (prod s_i^r_i)^2e = (prod m_i^r_i)^2 mod n for random 64-bit r_i,
+// which costs far less than one exponentiation by e per signature. A chunk
+// that fails the test is split in half until the bad signatures are found
+// and checked one at a time. Chunks run on rsa_set_threads() threads.
+// The squares hide the sign of s^e, so each signature must also have the
+// same Jacobi symbol as its message, which rejects n - s in place of s
+// exactly when n = 3 mod 4. For other moduli, and for e of 64 bits or
+// fewer, every signature is checked on its own. The results are those of
+// rsa_verify(), except that whoever knows the factors of n can still make
+// a signature that passes the screen.
+// All mpz_t arguments are expected to be initialized.
+//
+// m: the expected messages.
+// s: the signatures to verify.
+// count: the number of messages and signatures.
+// e: the public exponent.
+// n: the public modulus.
+// valid: will store whether each signature verified, count entries.
+// returns: the number of signatures that verified.
+//
+uint64_t rsa_verify_batch(mpz_t *m, mpz_t *s, uint64_t count, mpz_t e,
+                          mpz_t n, bool *valid);
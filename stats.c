@@ -0,0 +1,88 @@
+// clang-format off
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+// clang-format on
+
+static bool enabled = false;
+
+static atomic_uint_fast64_t counters[STAT_COUNTERS];
+static atomic_uint_fast64_t timer_calls[STAT_TIMERS];
+static atomic_uint_fast64_t timer_nanos[STAT_TIMERS];
+
+// names in the JSON output, in enum order
+static const char *counter_names[STAT_COUNTERS] = {
+    "pow_mod",       "squarings", "multiplies", "mr_rounds",
+    "size_rejected", "composite", "e_rejected", "e_tried",
+};
+
+static const char *timer_names[STAT_TIMERS] = {
+    "pow_mod",   "gcd",      "mod_inverse",   "is_prime",      "make_prime",
+    "make_pub",  "make_priv", "encrypt_block", "decrypt_block",
+};
+
+#ifndef RSA_NO_STATS
+static void print_at_exit(void) { stats_print(stderr); }
+#endif
+
+void stats_init(bool verbose) {
+#ifndef RSA_NO_STATS
+  const char *env = getenv("RSA_STATS");
+  bool wanted = (env != NULL) && (env[0] != '\0') && (strcmp(env, "0") != 0);
+  if ((verbose || wanted) && !enabled) {
+    enabled = true;
+    atexit(print_at_exit);
+  }
+#else
+  (void)verbose;
+#endif
+}
+
+bool stats_enabled(void) { return enabled; }
+
+void stats_add(stat_counter counter, uint64_t n) {
+  if (enabled) {
+    atomic_fetch_add_explicit(&counters[counter], n, memory_order_relaxed);
+  }
+}
+
+uint64_t stats_now(void) {
+  if (!enabled) {
+    return 0;
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+void stats_time(stat_timer timer, uint64_t start) {
+  if (!enabled) {
+    return;
+  }
+  uint64_t elapsed = stats_now() - start;
+  atomic_fetch_add_explicit(&timer_calls[timer], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&timer_nanos[timer], elapsed, memory_order_relaxed);
+}
+
+void stats_print(FILE *out) {
+  fprintf(out, "{\"stats\": {\n  \"counters\": {");
+  for (int i = 0; i < STAT_COUNTERS; i++) {
+    fprintf(out, "%s\"%s\": %" PRIu64, (i == 0) ? "" : ", ", counter_names[i],
+            (uint64_t)atomic_load(&counters[i]));
+  }
+  fprintf(out, "},\n  \"timers\": {");
+  for (int i = 0; i < STAT_TIMERS; i++) {
+    fprintf(out, "%s\n    \"%s\": {\"calls\": %" PRIu64 ", \"seconds\": %.6f}",
+            (i == 0) ? "" : ",", timer_names[i],
+            (uint64_t)atomic_load(&timer_calls[i]),
+            atomic_load(&timer_nanos[i]) / 1e9);
+  }
+  fprintf(out, "\n  }\n}}\n");
+}
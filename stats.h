@@ -0,0 +1,96 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+//
+// Hot-path counters and timers for the number theory and RSA functions.
+// They cost nothing beyond a branch until stats_init() turns them on, and
+// building with make STATS=0 (-DRSA_NO_STATS) removes them altogether.
+// Counts and times are summed over every thread, so with several threads
+// the seconds of a timer can exceed the wall-clock time.
+//
+typedef enum {
+  STAT_POW_MOD,       // exponentiations through pow_mod and Miller-Rabin
+  STAT_SQUARINGS,     // modular squarings inside the exponentiations
+  STAT_MULTIPLIES,    // modular multiplies inside the exponentiations
+  STAT_MR_ROUNDS,     // Miller-Rabin rounds, one per witness
+  STAT_SIZE_REJECTED, // prime candidates of the wrong size
+  STAT_COMPOSITE,     // prime candidates found composite
+  STAT_E_REJECTED,    // primes redrawn because gcd(e, p - 1) != 1
+  STAT_E_TRIED,       // public exponents tried by rsa_make_pub
+  STAT_COUNTERS
+} stat_counter;
+
+typedef enum {
+  TIMER_POW_MOD,
+  TIMER_GCD,
+  TIMER_MOD_INVERSE,
+  TIMER_IS_PRIME,
+  TIMER_MAKE_PRIME,
+  TIMER_MAKE_PUB,
+  TIMER_MAKE_PRIV,
+  TIMER_ENCRYPT_BLOCK,
+  TIMER_DECRYPT_BLOCK,
+  STAT_TIMERS
+} stat_timer;
+
+#ifndef RSA_NO_STATS
+
+#define STAT_ADD(counter, n) stats_add((counter), (n))
+#define STAT_INC(counter) stats_add((counter), 1)
+#define STAT_TIMER_START(start) uint64_t start = stats_now()
+#define STAT_TIMER_STOP(timer, start) stats_time((timer), (start))
+
+#else
+
+#define STAT_ADD(counter, n) ((void)(n))
+#define STAT_INC(counter) ((void)0)
+#define STAT_TIMER_START(start) ((void)0)
+#define STAT_TIMER_STOP(timer, start) ((void)0)
+
+#endif
+
+//
+// Turns the counters and timers on if verbose is set or the RSA_STATS
+// environment variable is set to anything but 0, and arranges for
+// stats_print() to write them to stderr when the program exits.
+// Call it before starting any threads.
+//
+// verbose: whether the program was asked for verbose output.
+//
+void stats_init(bool verbose);
+
+//
+// Returns whether the counters and timers are on.
+//
+bool stats_enabled(void);
+
+//
+// Adds n to a counter, if the counters are on.
+//
+// counter: the counter.
+// n: the amount to add.
+//
+void stats_add(stat_counter counter, uint64_t n);
+
+//
+// Returns the start time of a timed call, or 0 if the timers are off.
+//
+uint64_t stats_now(void);
+
+//
+// Adds one call and the time since start to a timer, if the timers are on.
+//
+// timer: the timer.
+// start: what stats_now() returned when the call began.
+//
+void stats_time(stat_timer timer, uint64_t start);
+
+//
+// Writes the counters and timers as a JSON object.
+//
+// out: where to write them.
+//
+void stats_print(FILE *out);
@@ -0,0 +1,354 @@
+// clang-format off
+#include <stdio.h>
+#include <gmp.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chacha.h"
+#include "container.h"
+#include "randstate.h"
+#include "rsa.h"
+
+// clang-format on
+
+#define TEST_BITS 512
+#define TEST_ITERS 25
+
+// the ChaCha20-Poly1305 test vector of RFC 8439, section 2.8.2
+static const uint8_t rfc_key[CHACHA_KEY_SIZE] = {
+    0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8a,
+    0x8b, 0x8c, 0x8d, 0x8e, 0x8f, 0x90, 0x91, 0x92, 0x93, 0x94, 0x95,
+    0x96, 0x97, 0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f};
+static const uint8_t rfc_nonce[CHACHA_NONCE_SIZE] = {
+    0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47};
+static const uint8_t rfc_aad[] = {0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1,
+                                  0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7};
+static const char rfc_plaintext[] =
+    "Ladies and Gentlemen of the class of '99: If I could offer you only one "
+    "tip for the future, sunscreen would be it.";
+static const uint8_t rfc_ciphertext[] = {
+    0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb, 0x7b, 0x86, 0xaf, 0xbc,
+    0x53, 0xef, 0x7e, 0xc2, 0xa4, 0xad, 0xed, 0x51, 0x29, 0x6e, 0x08, 0xfe,
+    0xa9, 0xe2, 0xb5, 0xa7, 0x36, 0xee, 0x62, 0xd6, 0x3d, 0xbe, 0xa4, 0x5e,
+    0x8c, 0xa9, 0x67, 0x12, 0x82, 0xfa, 0xfb, 0x69, 0xda, 0x92, 0x72, 0x8b,
+    0x1a, 0x71, 0xde, 0x0a, 0x9e, 0x06, 0x0b, 0x29, 0x05, 0xd6, 0xa5, 0xb6,
+    0x7e, 0xcd, 0x3b, 0x36, 0x92, 0xdd, 0xbd, 0x7f, 0x2d, 0x77, 0x8b, 0x8c,
+    0x98, 0x03, 0xae, 0xe3, 0x28, 0x09, 0x1b, 0x58, 0xfa, 0xb3, 0x24, 0xe4,
+    0xfa, 0xd6, 0x75, 0x94, 0x55, 0x85, 0x80, 0x8b, 0x48, 0x31, 0xd7, 0xbc,
+    0x3f, 0xf4, 0xde, 0xf0, 0x8e, 0x4b, 0x7a, 0x9d, 0xe5, 0x76, 0xd2, 0x65,
+    0x86, 0xce, 0xc6, 0x4b, 0x61, 0x16};
+static const uint8_t rfc_tag[POLY1305_TAG_SIZE] = {
+    0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+    0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91};
+
+// a test key and the buffers of one hybrid ciphertext
+typedef struct {
+  mpz_t n, e, d;
+  uint8_t *plain;
+  size_t plain_size;
+  uint8_t *cipher;
+  size_t cipher_size;
+} hybrid_case;
+
+// seals the RFC plaintext, checks the ciphertext and tag, and checks that
+// aead_open() recovers it and rejects a flipped bit in the tag, the
+// ciphertext or the additional data
+// returns: the number of failed checks
+static uint64_t check_rfc_vector(void) {
+  size_t len = sizeof(rfc_plaintext) - 1;
+  uint8_t out[sizeof(rfc_plaintext)], back[sizeof(rfc_plaintext)];
+  uint8_t tag[POLY1305_TAG_SIZE], aad[sizeof(rfc_aad)];
+  uint64_t wrong = 0;
+
+  aead_seal(out, tag, (const uint8_t *)rfc_plaintext, len, rfc_aad,
+            sizeof(rfc_aad), rfc_key, rfc_nonce);
+  if ((len != sizeof(rfc_ciphertext)) ||
+      (memcmp(out, rfc_ciphertext, len) != 0)) {
+    fprintf(stderr, "aead_seal: the RFC 8439 ciphertext differs\n");
+    wrong += 1;
+  }
+  if (memcmp(tag, rfc_tag, POLY1305_TAG_SIZE) != 0) {
+    fprintf(stderr, "aead_seal: the RFC 8439 tag differs\n");
+    wrong += 1;
+  }
+  if (!aead_open(back, out, len, tag, rfc_aad, sizeof(rfc_aad), rfc_key,
+                 rfc_nonce) ||
+      (memcmp(back, rfc_plaintext, len) != 0)) {
+    fprintf(stderr, "aead_open: the RFC 8439 vector doesn't open\n");
+    wrong += 1;
+  }
+
+  memcpy(aad, rfc_aad, sizeof(aad));
+  tag[0] ^= 1;
+  wrong += aead_open(back, out, len, tag, aad, sizeof(aad), rfc_key,
+                     rfc_nonce);
+  tag[0] ^= 1;
+  out[len - 1] ^= 0x80;
+  wrong += aead_open(back, out, len, tag, aad, sizeof(aad), rfc_key,
+                     rfc_nonce);
+  out[len - 1] ^= 0x80;
+  aad[3] ^= 0x10;
+  wrong += aead_open(back, out, len, tag, aad, sizeof(aad), rfc_key,
+                     rfc_nonce);
+  if (wrong != 0) {
+    fprintf(stderr, "aead_open: a forged RFC 8439 message opens\n");
+  }
+  return wrong;
+}
+
+// decrypts a hybrid ciphertext held in memory, returns whether it opened
+// and, if out is not NULL, stores the plaintext size in *out_size
+static bool hybrid_open(hybrid_case *t, const uint8_t *cipher, size_t size,
+                        uint8_t **out, size_t *out_size) {
+  FILE *in = tmpfile();
+  FILE *plain = tmpfile();
+  fwrite(cipher, sizeof(uint8_t), size, in);
+  rewind(in);
+  bool ok = rsa_decrypt_file_hybrid(in, plain, t->n, t->d);
+  if (out != NULL) {
+    *out_size = (size_t)ftell(plain);
+    *out = (uint8_t *)malloc(*out_size + 1);
+    rewind(plain);
+    *out_size = fread(*out, sizeof(uint8_t), *out_size, plain);
+  }
+  fclose(in);
+  fclose(plain);
+  return ok;
+}
+
+// encrypts size random bytes into t->cipher
+static void hybrid_seal_case(hybrid_case *t, size_t size) {
+  t->plain_size = size;
+  t->plain = (uint8_t *)malloc(size + 1);
+  for (size_t i = 0; i < size; i++) {
+    t->plain[i] = (uint8_t)gmp_urandomb_ui(state, 8);
+  }
+  FILE *in = tmpfile();
+  FILE *out = tmpfile();
+  fwrite(t->plain, sizeof(uint8_t), size, in);
+  rewind(in);
+  if (!rsa_encrypt_file_hybrid(in, out, t->n, t->e)) {
+    fprintf(stderr, "rsa_encrypt_file_hybrid: %zu bytes don't encrypt\n",
+            size);
+    exit(1);
+  }
+  t->cipher_size = (size_t)ftell(out);
+  t->cipher = (uint8_t *)malloc(t->cipher_size);
+  rewind(out);
+  t->cipher_size = fread(t->cipher, sizeof(uint8_t), t->cipher_size, out);
+  fclose(in);
+  fclose(out);
+}
+
+// the session key of a hybrid ciphertext, from its first wrap record;
+// returns the offset of the first chunk
+static size_t hybrid_session_key(hybrid_case *t,
+                                 uint8_t key[CHACHA_KEY_SIZE]) {
+  hybrid_header header;
+  hybrid_decode(&header, t->cipher);
+  size_t k = (mpz_sizeinbase(t->n, 2) - 1) / 8;
+  uint8_t *kblock = (uint8_t *)malloc(k);
+  mpz_t m, c;
+  mpz_inits(m, c, NULL);
+  container_import(c, t->cipher + HYBRID_HEADER_SIZE, header.record_size);
+  rsa_decrypt(m, c, t->d, t->n);
+  container_export(kblock, k, m);
+  memcpy(key, kblock + 1, CHACHA_KEY_SIZE); // behind the 0xFF marker
+  mpz_clears(m, c, NULL);
+  free(kblock);
+  return HYBRID_HEADER_SIZE + (header.wrap_count * header.record_size);
+}
+
+// the nonce rsa.c gives chunk i: a final flag, then i big-endian
+static void chunk_nonce(uint8_t nonce[CHACHA_NONCE_SIZE], uint64_t i,
+                        bool final) {
+  memset(nonce, 0, CHACHA_NONCE_SIZE);
+  nonce[0] = final ? 1 : 0;
+  for (int b = 11; b >= 4; b--) {
+    nonce[b] = (uint8_t)(i & 0xFF);
+    i >>= 8;
+  }
+}
+
+// appends a chunk of len bytes of t->plain from offset, sealed as chunk i
+// with the given final flag, to buf at *pos
+static void append_chunk(uint8_t *buf, size_t *pos, hybrid_case *t,
+                         const uint8_t key[CHACHA_KEY_SIZE], size_t offset,
+                         size_t len, uint64_t i, bool final) {
+  uint8_t nonce[CHACHA_NONCE_SIZE];
+  chunk_nonce(nonce, i, final);
+  for (int b = 3; b >= 0; b--) {
+    buf[*pos + (size_t)(3 - b)] = (uint8_t)(len >> (8 * b));
+  }
+  aead_seal(buf + *pos + 4, buf + *pos + 4 + len, t->plain + offset, len,
+            t->cipher, HYBRID_HEADER_SIZE, key, nonce);
+  *pos += 4 + len + POLY1305_TAG_SIZE;
+}
+
+// encrypts size bytes, checks the round trip, then rebuilds the chunks
+// with the session key: sealed as rsa.c does they must reproduce the file
+// byte for byte, and with the final flag flipped on the last chunk, or set
+// on a short chunk cut at a chunk boundary, the file must not decrypt
+// returns: the number of failed checks
+static uint64_t check_final_flag(hybrid_case *t, size_t size) {
+  uint64_t wrong = 0;
+  hybrid_seal_case(t, size);
+
+  uint8_t *back;
+  size_t back_size;
+  if (!hybrid_open(t, t->cipher, t->cipher_size, &back, &back_size) ||
+      (back_size != size) || (memcmp(back, t->plain, size) != 0)) {
+    fprintf(stderr, "hybrid: %zu bytes don't round trip\n", size);
+    wrong += 1;
+  }
+  free(back);
+
+  // an input that fills its last chunk ends with an empty final one
+  uint8_t key[CHACHA_KEY_SIZE];
+  size_t start = hybrid_session_key(t, key);
+  uint64_t chunks = (size / HYBRID_CHUNK_SIZE) + 1;
+  size_t rebuilt_cap = t->cipher_size + HYBRID_CHUNK_SIZE;
+  uint8_t *rebuilt = (uint8_t *)malloc(rebuilt_cap);
+  for (int flip = 0; flip < 2; flip++) {
+    memcpy(rebuilt, t->cipher, start);
+    size_t pos = start;
+    for (uint64_t i = 0; i < chunks; i++) {
+      size_t offset = i * HYBRID_CHUNK_SIZE;
+      size_t len = ((size - offset) < HYBRID_CHUNK_SIZE) ? size - offset
+                                                         : HYBRID_CHUNK_SIZE;
+      bool final = (i + 1 == chunks);
+      append_chunk(rebuilt, &pos, t, key, offset, len, i, final != flip);
+    }
+    bool same = (pos == t->cipher_size) &&
+                (memcmp(rebuilt, t->cipher, pos) == 0);
+    bool opens = hybrid_open(t, rebuilt, pos, NULL, NULL);
+    if (!flip && (!same || !opens)) {
+      fprintf(stderr, "hybrid: the chunks of %zu bytes aren't sealed with "
+                      "the expected nonces\n",
+              size);
+      wrong += 1;
+    }
+    if (flip && opens) {
+      fprintf(stderr, "hybrid: %zu bytes open with the final flag "
+                      "flipped\n",
+              size);
+      wrong += 1;
+    }
+  }
+
+  // dropping the chunks after a boundary and cutting the one before it
+  // short makes it look final, but it was sealed as an inner chunk
+  if (chunks > 1) {
+    memcpy(rebuilt, t->cipher, start);
+    size_t pos = start;
+    for (uint64_t i = 0; i + 2 < chunks; i++) {
+      append_chunk(rebuilt, &pos, t, key, i * HYBRID_CHUNK_SIZE,
+                   HYBRID_CHUNK_SIZE, i, false);
+    }
+    uint64_t last = chunks - 2;
+    append_chunk(rebuilt, &pos, t, key, last * HYBRID_CHUNK_SIZE,
+                 HYBRID_CHUNK_SIZE - 1, last, false);
+    if (hybrid_open(t, rebuilt, pos, NULL, NULL)) {
+      fprintf(stderr, "hybrid: %zu bytes cut at chunk %" PRIu64
+                      " open without a final chunk\n",
+              size, last);
+      wrong += 1;
+    }
+  }
+
+  free(rebuilt);
+  free(t->plain);
+  free(t->cipher);
+  return wrong;
+}
+
+// encrypts size bytes and checks that no prefix of the ciphertext ending in
+// the header, the wrap records, a length prefix, a chunk or a tag decrypts
+// returns: the number of failed checks
+static uint64_t check_truncated(hybrid_case *t, size_t size) {
+  uint64_t wrong = 0;
+  hybrid_seal_case(t, size);
+
+  hybrid_header header;
+  hybrid_decode(&header, t->cipher);
+  size_t start =
+      HYBRID_HEADER_SIZE + (header.wrap_count * header.record_size);
+  size_t cuts[64];
+  size_t count = 0;
+  cuts[count++] = 0;
+  cuts[count++] = HYBRID_HEADER_SIZE / 2;
+  cuts[count++] = HYBRID_HEADER_SIZE;
+  cuts[count++] = start - 1;
+  cuts[count++] = start;
+  for (size_t pos = start; pos < t->cipher_size;) {
+    size_t len = (size_t)t->cipher[pos] << 24 |
+                 (size_t)t->cipher[pos + 1] << 16 |
+                 (size_t)t->cipher[pos + 2] << 8 | t->cipher[pos + 3];
+    cuts[count++] = pos + 2;                          // in the prefix
+    cuts[count++] = pos + 4 + (len / 2);              // in the chunk
+    cuts[count++] = pos + 4 + len;                    // before the tag
+    cuts[count++] = pos + 4 + len + 1;                // in the tag
+    pos += 4 + len + POLY1305_TAG_SIZE;
+    cuts[count++] = (pos < t->cipher_size) ? pos : 0; // at the boundary
+  }
+  cuts[count++] = t->cipher_size - 1;
+
+  for (size_t i = 0; i < count; i++) {
+    if ((cuts[i] < t->cipher_size) &&
+        hybrid_open(t, t->cipher, cuts[i], NULL, NULL)) {
+      fprintf(stderr, "hybrid: %zu bytes truncated to %zu of %zu decrypt\n",
+              size, cuts[i], t->cipher_size);
+      wrong += 1;
+    }
+  }
+  // and a byte more than the final chunk is refused too
+  uint8_t *longer = (uint8_t *)malloc(t->cipher_size + 1);
+  memcpy(longer, t->cipher, t->cipher_size);
+  longer[t->cipher_size] = 0;
+  if (hybrid_open(t, longer, t->cipher_size + 1, NULL, NULL)) {
+    fprintf(stderr, "hybrid: %zu bytes with trailing data decrypt\n", size);
+    wrong += 1;
+  }
+  free(longer);
+  free(t->plain);
+  free(t->cipher);
+  return wrong;
+}
+
+int main(void) {
+  const size_t sizes[] = {0,
+                          1,
+                          HYBRID_CHUNK_SIZE - 1,
+                          HYBRID_CHUNK_SIZE,
+                          HYBRID_CHUNK_SIZE + 1,
+                          2 * HYBRID_CHUNK_SIZE,
+                          4 * HYBRID_CHUNK_SIZE,
+                          (4 * HYBRID_CHUNK_SIZE) + 1};
+  uint64_t wrong = check_rfc_vector();
+
+  randstate_init(1234);
+  hybrid_case t;
+  mpz_t p, q;
+  mpz_inits(p, q, t.n, t.e, t.d, NULL);
+  rsa_make_pub(p, q, t.n, t.e, TEST_BITS, TEST_ITERS);
+  rsa_make_priv(t.d, t.e, p, q);
+  // one thread seals 4 chunks per batch, so 4 chunks also end a batch
+  rsa_set_threads(1);
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    wrong += check_final_flag(&t, sizes[i]);
+  }
+  wrong += check_truncated(&t, 2 * HYBRID_CHUNK_SIZE + 100);
+  wrong += check_truncated(&t, 0);
+  mpz_clears(p, q, t.n, t.e, t.d, NULL);
+  randstate_clear();
+
+  if (wrong != 0) {
+    fprintf(stderr, "test_chacha: %" PRIu64 " checks failed\n", wrong);
+    return 1;
+  }
+  fprintf(stderr, "test_chacha: ok\n");
+  return 0;
+}
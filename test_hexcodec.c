@@ -0,0 +1,200 @@
+// clang-format off
+#include <stdio.h>
+#include <gmp.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "randstate.h"
+
+// the vector paths are static, so the codec is built into the test
+#include "hexcodec.c"
+
+// clang-format on
+
+#define TEST_MAX_LIMBS 9
+#define TEST_BAD_LIMBS 5
+#define TEST_TRIALS 500
+
+// an encoder or decoder of full limbs, checked against the scalar one
+typedef struct {
+  const char *name;
+  void (*encode)(uint8_t *dst, const mp_limb_t *limbs, mp_size_t count);
+  bool (*decode)(mp_limb_t *limbs, const uint8_t *src, mp_size_t count);
+} codec_path;
+
+// the bytes just outside each range of digits, and a few far from them
+static const uint8_t bad_bytes[] = {'/', ':', '@', 'G', '`', 'g', 'x',
+                                    ' ', 0x00, 0x80, 0xb0, 0xff};
+
+// the paths this build and machine can run, returns how many
+static size_t codec_paths(codec_path *paths) {
+  size_t count = 0;
+#ifdef HEX_X86
+  paths[count++] = (codec_path){"sse2", encode_sse2, decode_sse2};
+  if (have_avx2()) {
+    paths[count++] = (codec_path){"avx2", encode_avx2, decode_avx2};
+  }
+#endif
+  (void)paths;
+  return count;
+}
+
+// a random limb, now and then one made only of digits or only of letters
+static mp_limb_t random_limb(mpz_t t) {
+  switch (gmp_urandomm_ui(state, 8)) {
+  case 0:
+    return 0;
+  case 1:
+    return GMP_NUMB_MAX;
+  case 2:
+    return (mp_limb_t)0x0123456789abcdefULL;
+  default:
+    mpz_urandomb(t, state, GMP_NUMB_BITS);
+    return mpz_getlimbn(t, 0);
+  }
+}
+
+// encodes and decodes count random limbs with every path and compares them
+// with the scalar code, then checks hex_encode() and hex_decode_mpz() on
+// the same number, with a partial top limb and mixed case, against GMP
+// returns: the number of mismatches
+static uint64_t check_round_trip(const codec_path *paths, size_t path_count,
+                                 mp_size_t count, mpz_t t) {
+  mp_limb_t limbs[TEST_MAX_LIMBS], out[TEST_MAX_LIMBS];
+  uint8_t expected[TEST_MAX_LIMBS * LIMB_DIGITS];
+  uint8_t buffer[TEST_MAX_LIMBS * LIMB_DIGITS + 1];
+  size_t length = (size_t)count * LIMB_DIGITS;
+  uint64_t wrong = 0;
+
+  for (mp_size_t i = 0; i < count; i++) {
+    limbs[i] = random_limb(t);
+  }
+  encode_scalar(expected, limbs, count);
+  memcpy(buffer, expected, length);
+  // upper case about half of the letters
+  for (size_t i = 0; i < length; i++) {
+    if ((buffer[i] >= 'a') && gmp_urandomb_ui(state, 1)) {
+      buffer[i] -= 'a' - 'A';
+    }
+  }
+  if (!decode_scalar(out, buffer, count) ||
+      (memcmp(out, limbs, (size_t)count * sizeof(mp_limb_t)) != 0)) {
+    fprintf(stderr, "scalar: %ld limbs don't decode\n", (long)count);
+    wrong += 1;
+  }
+
+  for (size_t p = 0; p < path_count; p++) {
+    uint8_t digits_out[TEST_MAX_LIMBS * LIMB_DIGITS];
+    paths[p].encode(digits_out, limbs, count);
+    if (memcmp(digits_out, expected, length) != 0) {
+      fprintf(stderr, "%s: %ld limbs encode differently\n", paths[p].name,
+              (long)count);
+      wrong += 1;
+    }
+    if (!paths[p].decode(out, buffer, count) ||
+        (memcmp(out, limbs, (size_t)count * sizeof(mp_limb_t)) != 0)) {
+      fprintf(stderr, "%s: %ld limbs decode differently\n", paths[p].name,
+              (long)count);
+      wrong += 1;
+    }
+  }
+
+  // the same limbs with a partial top limb, through the public functions
+  limbs[count - 1] >>= gmp_urandomm_ui(state, GMP_NUMB_BITS);
+  if (limbs[count - 1] == 0) {
+    limbs[count - 1] = 1;
+  }
+  mpz_t x, y;
+  mpz_roinit_n(x, limbs, count);
+  mpz_init(y);
+  size_t written = hex_encode(buffer, limbs, count);
+  buffer[written] = '\0';
+  char *gmp_digits = mpz_get_str(NULL, 16, x);
+  if (strcmp((char *)buffer, gmp_digits) != 0) {
+    fprintf(stderr, "hex_encode: %s, gmp: %s\n", buffer, gmp_digits);
+    wrong += 1;
+  }
+  for (size_t i = 0; i < written; i++) {
+    if ((buffer[i] >= 'a') && gmp_urandomb_ui(state, 1)) {
+      buffer[i] -= 'a' - 'A';
+    }
+  }
+  if (!hex_decode_mpz(y, buffer, written) || (mpz_cmp(x, y) != 0)) {
+    fprintf(stderr, "hex_decode_mpz: %s doesn't decode\n", buffer);
+    wrong += 1;
+  }
+  free(gmp_digits);
+  mpz_clear(y);
+  return wrong;
+}
+
+// puts each bad byte at each position of count limbs of digits, inside
+// and across the 16 and 32 byte vectors, and checks every path rejects it
+// returns: the number of mismatches
+static uint64_t check_invalid(const codec_path *paths, size_t path_count,
+                              mp_size_t count, mpz_t t) {
+  mp_limb_t limbs[TEST_BAD_LIMBS], out[TEST_BAD_LIMBS];
+  uint8_t buffer[TEST_BAD_LIMBS * LIMB_DIGITS];
+  size_t length = (size_t)count * LIMB_DIGITS;
+  uint64_t wrong = 0;
+
+  for (mp_size_t i = 0; i < count; i++) {
+    limbs[i] = random_limb(t);
+  }
+  for (size_t pos = 0; pos < length; pos++) {
+    for (size_t b = 0; b < sizeof(bad_bytes); b++) {
+      encode_scalar(buffer, limbs, count);
+      buffer[pos] = bad_bytes[b];
+      bool accepted = decode_scalar(out, buffer, count);
+      for (size_t p = 0; p < path_count; p++) {
+        if (paths[p].decode(out, buffer, count)) {
+          fprintf(stderr,
+                  "%s: byte 0x%02x at %zu of %ld limbs is accepted\n",
+                  paths[p].name, bad_bytes[b], pos, (long)count);
+          accepted = true;
+        }
+      }
+      if (hex_decode(out, buffer, length) ||
+          (hex_span(buffer, length) != pos)) {
+        fprintf(stderr, "hex_decode: byte 0x%02x at %zu is missed\n",
+                bad_bytes[b], pos);
+        accepted = true;
+      }
+      wrong += accepted;
+    }
+  }
+  return wrong;
+}
+
+int main(void) {
+  codec_path paths[2];
+  size_t path_count = codec_paths(paths);
+  uint64_t wrong = 0;
+  mpz_t t;
+
+  randstate_init(1234);
+  mpz_init(t);
+  for (uint64_t trial = 0; trial < TEST_TRIALS; trial++) {
+    mp_size_t count = (mp_size_t)(1 + (trial % TEST_MAX_LIMBS));
+    wrong += check_round_trip(paths, path_count, count, t);
+  }
+  for (mp_size_t count = 1; count <= TEST_BAD_LIMBS; count++) {
+    wrong += check_invalid(paths, path_count, count, t);
+  }
+  mpz_clear(t);
+  randstate_clear();
+
+  if (wrong != 0) {
+    fprintf(stderr, "test_hexcodec: %" PRIu64 " mismatches\n", wrong);
+    return 1;
+  }
+  fprintf(stderr, "test_hexcodec: ok (scalar");
+  for (size_t p = 0; p < path_count; p++) {
+    fprintf(stderr, ", %s", paths[p].name);
+  }
+  fprintf(stderr, ")\n");
+  return 0;
+}
@@ -0,0 +1,84 @@
+// clang-format off
+#include <stdio.h>
+#include <gmp.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "randstate.h"
+#include "rsa.h"
+
+// clang-format on
+
+#define TEST_BITS 512
+#define TEST_ITERS 25
+#define TEST_COUNT 40
+#define TEST_TRIALS 8
+
+// replaces the signatures at pairs of random positions with n - s, which
+// have the same square as s, and checks that rsa_verify_batch() agrees
+// with rsa_verify() on every one of them
+// returns: the number of signatures where the two disagree
+static uint64_t check_key(mpz_t n, mpz_t e, mpz_t d) {
+  mpz_t m[TEST_COUNT], s[TEST_COUNT];
+  bool valid[TEST_COUNT];
+  uint64_t wrong = 0;
+
+  for (uint64_t i = 0; i < TEST_COUNT; i++) {
+    mpz_inits(m[i], s[i], NULL);
+  }
+  for (uint64_t trial = 0; trial < TEST_TRIALS; trial++) {
+    for (uint64_t i = 0; i < TEST_COUNT; i++) {
+      mpz_urandomm(m[i], state, n);
+      rsa_sign(s[i], m[i], d, n);
+    }
+    // 2 forgeries on even trials, 4 on odd ones
+    for (uint64_t j = 0; j < 2 + (trial & 1) * 2; j++) {
+      uint64_t i = gmp_urandomm_ui(state, TEST_COUNT);
+      mpz_sub(s[i], n, s[i]);
+    }
+    rsa_verify_batch(m, s, TEST_COUNT, e, n, valid);
+    for (uint64_t i = 0; i < TEST_COUNT; i++) {
+      if (valid[i] != rsa_verify(m[i], s[i], e, n)) {
+        fprintf(stderr, "n = %lu mod 4, trial %" PRIu64 ": signature %" PRIu64
+                        " verified %s in the batch\n",
+                mpz_fdiv_ui(n, 4), trial, i, valid[i] ? "true" : "false");
+        wrong += 1;
+      }
+    }
+  }
+  for (uint64_t i = 0; i < TEST_COUNT; i++) {
+    mpz_clears(m[i], s[i], NULL);
+  }
+  return wrong;
+}
+
+int main(void) {
+  mpz_t p, q, n, e, d;
+  uint64_t wrong = 0;
+  bool tested[4] = {false};
+
+  randstate_init(1234);
+  mpz_inits(p, q, n, e, d, NULL);
+  // a random e is far wider than 64 bits, so the batch is screened
+  while (!tested[1] || !tested[3]) {
+    rsa_make_pub(p, q, n, e, TEST_BITS, TEST_ITERS);
+    uint64_t r = mpz_fdiv_ui(n, 4);
+    if (tested[r]) {
+      continue;
+    }
+    rsa_make_priv(d, e, p, q);
+    wrong += check_key(n, e, d);
+    tested[r] = true;
+  }
+  mpz_clears(p, q, n, e, d, NULL);
+  randstate_clear();
+
+  if (wrong != 0) {
+    fprintf(stderr, "test_verify: %" PRIu64 " signatures disagree\n", wrong);
+    return 1;
+  }
+  fprintf(stderr, "test_verify: ok\n");
+  return 0;
+}
@@ -0,0 +1,247 @@
+// clang-format off
+#include <stdio.h>
+#include <gmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "numtheory.h"
+#include "randstate.h"
+#include "rsa.h"
+
+// clang-format on
+
+// prints the program synopsis and usage
+static void usage(void) {
+  fprintf(stderr, "Usage: ./verify [options]\n");
+  fprintf(stderr, "  ./verify checks a list of signed records against the "
+                  "specified public key file.\n");
+  fprintf(stderr, "  Every input line holds a message and its signature in "
+                  "hex, separated by a space.\n");
+  fprintf(stderr, "  The numbers of the records that fail are written to "
+                  "standard output.\n");
+  fprintf(stderr, "    -i <infile> : Read records from <infile>. Default: "
+                  "standard input.\n");
+  fprintf(stderr, "    -n <keyfile>: Public key is in <keyfile>. Default: "
+                  "rsa.pub.\n");
+  fprintf(stderr, "    -t <threads>: Verify on <threads> threads. "
+                  "Default: 1.\n");
+  fprintf(stderr, "    -A <backend>: Arithmetic backend: reference, gmp, "
+                  "fast, or <a>,<b> to\n");
+  fprintf(stderr, "                  cross-check a against b. Default: "
+                  "$NUMTHEORY_BACKEND or fast.\n");
+  fprintf(stderr, "    -v          : Enable verbose output.\n");
+  fprintf(stderr, "    -h          : Display program synopsis and usage.\n");
+}
+
+int main(int argc, char **argv) {
+  randstate_init(69420);
+
+  int opt = 0;
+  int input_stdin = 1;
+  int verbose = 0;
+  uint64_t threads = 1;
+
+  char *input_file_name = (char *)(calloc(sizeof(char), 4096));
+  char *pb_file_name = (char *)(calloc(sizeof(char), 4096));
+  if ((input_file_name == NULL) || (pb_file_name == NULL)) {
+    fprintf(stderr, "No more memory!\n");
+    return 1;
+  }
+  strcpy(pb_file_name, "rsa.pub");
+
+  while ((opt = getopt(argc, argv, "i:n:t:A:vh")) != -1) {
+    switch (opt) {
+    case 'i': // input file name
+      strcpy(input_file_name, optarg);
+      input_stdin = 0;
+      break;
+
+    case 'n': // public key file name
+      strcpy(pb_file_name, optarg);
+      break;
+
+    case 't': // number of verification threads
+      threads = strtoul(optarg, NULL, 10);
+      if ((threads < 1) || (threads > 1024)) {
+        fprintf(stderr, "Number of threads must be 1-1024, not %s.\n",
+                optarg);
+        free(pb_file_name);
+        free(input_file_name);
+        return 1;
+      }
+      break;
+
+    case 'A': // arithmetic backend
+      if (!numtheory_set_backend(optarg)) {
+        fprintf(stderr,
+                "Unknown arithmetic backend %s, expected reference, gmp, "
+                "fast, <a>,<b> or check.\n",
+                optarg);
+        free(pb_file_name);
+        free(input_file_name);
+        return 1;
+      }
+      break;
+
+    case 'v': // verbose
+      verbose = 1;
+      break;
+
+    case 'h': // help message
+      usage();
+      free(pb_file_name);
+      free(input_file_name);
+      return 0;
+
+    default: // invalid option, print help message and return non-zero
+      usage();
+      free(pb_file_name);
+      free(input_file_name);
+      return 1;
+    }
+  }
+
+  FILE *input_file = stdin;
+  if (input_stdin == 0) {
+    input_file = fopen(input_file_name, "r");
+    if (input_file == NULL) {
+      fprintf(stderr, "verify: Couldn't open %s to read records.\n",
+              input_file_name);
+      return 1;
+    }
+  }
+
+  FILE *pb_file = fopen(pb_file_name, "r");
+  if (pb_file == NULL) {
+    fprintf(stderr, "./verify: couldn't open %s to read public key.\n",
+            pb_file_name);
+    return 1;
+  }
+
+  mpz_t n, e, s;
+  mpz_inits(n, e, s, NULL);
+  char *username = (char *)(calloc(sizeof(char), 4096));
+  bool read = rsa_read_pub(n, e, s, username, pb_file);
+  fclose(pb_file);
+  if (!read) {
+    fprintf(stderr, "./verify: couldn't read a public key from %s.\n",
+            pb_file_name);
+    mpz_clears(n, e, s, NULL);
+    free(username);
+    return 1;
+  }
+
+  // read every record, one per line, growing the arrays as needed; blank
+  // lines are skipped, anything else must be exactly two hex numbers
+  uint64_t capacity = 1024;
+  uint64_t count = 0;
+  mpz_t *messages = (mpz_t *)malloc(capacity * sizeof(mpz_t));
+  mpz_t *signatures = (mpz_t *)malloc(capacity * sizeof(mpz_t));
+  char *line = NULL;
+  size_t line_size = 0;
+  uint64_t line_number = 0;
+  uint64_t bad_line = 0;
+  while (getline(&line, &line_size, input_file) >= 0) {
+    line_number += 1;
+    if (strspn(line, " \t\r\n") == strlen(line)) {
+      continue;
+    }
+    if (count == capacity) {
+      capacity *= 2;
+      messages = (mpz_t *)realloc(messages, capacity * sizeof(mpz_t));
+      signatures = (mpz_t *)realloc(signatures, capacity * sizeof(mpz_t));
+    }
+    mpz_init(messages[count]);
+    mpz_init(signatures[count]);
+    int end = 0;
+    if ((gmp_sscanf(line, "%Zx %Zx %n", messages[count], signatures[count],
+                    &end) != 2) ||
+        (line[end] != '\0')) {
+      mpz_clear(messages[count]);
+      mpz_clear(signatures[count]);
+      bad_line = line_number;
+      break;
+    }
+    count += 1;
+  }
+  free(line);
+
+  // a malformed line or a read error must not pass as the end of the input
+  bool read_error = (bad_line == 0) && ferror(input_file);
+  if ((bad_line != 0) || read_error) {
+    if (read_error) {
+      fprintf(stderr, "./verify: couldn't read records after line %lu.\n",
+              line_number);
+    } else {
+      fprintf(stderr,
+              "./verify: line %lu is not a hex message and signature.\n",
+              bad_line);
+    }
+    for (uint64_t i = 0; i < count; i++) {
+      mpz_clear(messages[i]);
+      mpz_clear(signatures[i]);
+    }
+    free(messages);
+    free(signatures);
+    free(username);
+    mpz_clears(n, e, s, NULL);
+    if (input_stdin == 0) {
+      fclose(input_file);
+    }
+    free(input_file_name);
+    free(pb_file_name);
+    randstate_clear();
+    return 1;
+  }
+
+  bool *valid = (bool *)calloc(count + 1, sizeof(bool));
+  rsa_set_threads(threads);
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint64_t passed =
+      rsa_verify_batch(messages, signatures, count, e, n, valid);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  for (uint64_t i = 0; i < count; i++) {
+    if (!valid[i]) {
+      printf("record %lu: bad signature\n", i + 1);
+    }
+  }
+
+  if (verbose == 1) { // if verbose is on
+    double elapsed =
+        (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9);
+    gmp_fprintf(stderr, "n - modulus (%zu bits): %Zd\n", mpz_sizeinbase(n, 2),
+                n);
+    gmp_fprintf(stderr, "e - public exponent (%zu bits): %Zd\n",
+                mpz_sizeinbase(e, 2), e);
+    fprintf(stderr,
+            "verified %lu records: %lu valid, %lu bad (%.3f s, %.1f "
+            "records/sec)\n",
+            count, passed, count - passed, elapsed,
+            (elapsed > 0) ? count / elapsed : 0.0);
+  }
+
+  for (uint64_t i = 0; i < count; i++) {
+    mpz_clear(messages[i]);
+    mpz_clear(signatures[i]);
+  }
+  free(messages);
+  free(signatures);
+  free(valid);
+  free(username);
+  mpz_clears(n, e, s, NULL);
+
+  if (input_stdin == 0) {
+    fclose(input_file);
+  }
+  free(input_file_name);
+  free(pb_file_name);
+
+  randstate_clear();
+  return (passed == count) ? 0 : 1;
+}